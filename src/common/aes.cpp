@@ -14,6 +14,7 @@
 #include "common/aes.h"
 #include "common/digest.h"
 #include <string.h>
+#include <algorithm>
 #include <memory>
 #include <openssl/evp.h>
 #include <openssl/rand.h>
@@ -129,5 +130,52 @@ std::string evp_aes_decrypt(std::string_view ciphertext, std::string_view passwo
 	return plaintext;
 }
 
+bool evp_aes_decrypt(std::string_view ciphertext, std::string_view password,
+		size_t chunk_size, const std::function<bool(std::string &&)> &output) {
+	EvpAesKey key = evp_aes_key_gen(password);
+	size_t iv_len = EvpAesIV().size();
+	if (ciphertext.size() < iv_len) {
+		return false;
+	}
+
+	std::string_view real_ciphertext = {ciphertext.data() + iv_len, ciphertext.size() - iv_len};
+
+	std::unique_ptr<EVP_CIPHER_CTX, void (*)(EVP_CIPHER_CTX *)> ctx{EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free};
+	if (ctx == nullptr) {
+		return false;
+	}
+
+	if (EVP_DecryptInit_ex(ctx.get(), EVP_aes_256_cbc(), nullptr, key.data(),
+				reinterpret_cast<const unsigned char *>(ciphertext.data())) != 1) {
+		return false;
+	}
+
+	int block_size = EVP_CIPHER_CTX_block_size(ctx.get());
+	while (!real_ciphertext.empty()) {
+		size_t len = std::min(chunk_size, real_ciphertext.size());
+		std::string plaintext(len + block_size, '\0');
+		int plaintext_len;
+		if (EVP_DecryptUpdate(ctx.get(), reinterpret_cast<unsigned char *>(&plaintext[0]), &plaintext_len,
+					reinterpret_cast<const unsigned char *>(real_ciphertext.data()), len) != 1) {
+			return false;
+		}
+		real_ciphertext.remove_prefix(len);
+
+		if (real_ciphertext.empty()) {
+			int final_len;
+			if (EVP_DecryptFinal_ex(ctx.get(), reinterpret_cast<unsigned char *>(&plaintext[plaintext_len]), &final_len) != 1) {
+				return false;
+			}
+			plaintext_len += final_len;
+		}
+
+		plaintext.resize(plaintext_len);
+		if (!plaintext.empty() && !output(std::move(plaintext))) {
+			return false;
+		}
+	}
+	return true;
+}
+
 
 } // namespace tiary
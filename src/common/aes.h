@@ -22,6 +22,8 @@
  */
 
 #include <array>
+#include <functional>
+#include <string>
 #include <string_view>
 #include <openssl/evp.h>
 
@@ -49,6 +51,17 @@ std::string evp_aes_encrypt(std::string_view plaintext, std::string_view passwor
  */
 std::string evp_aes_decrypt(std::string_view ciphertext, std::string_view password);
 
+/**
+ * Same as above, but passes the plaintext to output in pieces, each
+ * decrypted from at most chunk_size bytes of ciphertext.
+ *
+ * Returns false in case of any error, or if output returns false.
+ * The padding is checked only at the very end, so the caller must not
+ * trust anything it has received unless true is returned.
+ */
+bool evp_aes_decrypt(std::string_view ciphertext, std::string_view password,
+		size_t chunk_size, const std::function<bool(std::string &&)> &output);
+
 } // namespace tiary
 
 #endif // Include guard
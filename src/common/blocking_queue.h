@@ -0,0 +1,92 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+
+#ifndef TIARY_COMMON_BLOCKING_QUEUE_H
+#define TIARY_COMMON_BLOCKING_QUEUE_H
+
+/**
+ * @file	common/blocking_queue.h
+ * @author	chys <admin@chys.info>
+ * @brief	A bounded queue for passing data between threads
+ */
+
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace tiary {
+
+/**
+ * @brief	A FIFO queue with limited capacity, safe to use from multiple threads
+ *
+ * push blocks while the queue is full, and pop blocks while it's empty.
+ *
+ * Either side may close the queue.  After that, push always fails, and
+ * pop fails as soon as the remaining items are taken.  So a producer
+ * closes the queue to signal the end of data, and a consumer closes it
+ * to tell the producer to stop.
+ */
+template <typename T>
+class BlockingQueue {
+public:
+	explicit BlockingQueue(size_t capacity) : capacity_(capacity) {}
+
+	BlockingQueue(const BlockingQueue &) = delete;
+	BlockingQueue &operator = (const BlockingQueue &) = delete;
+
+	/// @result	false if the queue has been closed
+	bool push(T &&item) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		not_full_.wait(lock, [this] { return closed_ || queue_.size() < capacity_; });
+		if (closed_) {
+			return false;
+		}
+		queue_.push_back(std::move(item));
+		not_empty_.notify_one();
+		return true;
+	}
+
+	/// @result	false if the queue is empty and has been closed
+	bool pop(T *item) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		not_empty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+		if (queue_.empty()) {
+			return false;
+		}
+		*item = std::move(queue_.front());
+		queue_.pop_front();
+		not_full_.notify_one();
+		return true;
+	}
+
+	void close() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		closed_ = true;
+		not_full_.notify_all();
+		not_empty_.notify_all();
+	}
+
+private:
+	std::mutex mutex_;
+	std::condition_variable not_full_;
+	std::condition_variable not_empty_;
+	std::deque<T> queue_;
+	size_t capacity_;
+	bool closed_ = false;
+};
+
+} // namespace tiary
+
+#endif // include guard
@@ -22,6 +22,8 @@
 
 
 #include <stdint.h>
+#include <string.h>
+#include <string>
 
 namespace tiary {
 
@@ -60,6 +62,48 @@ inline constexpr uint64_t bswap64(uint64_t x) {
 	return x;
 }
 
+// Conversion between native and little endian (in both directions)
+
+inline constexpr uint32_t le32(uint32_t x) {
+#ifdef TIARY_BIG_ENDIAN
+	return bswap32(x);
+#else
+	return x;
+#endif
+}
+
+inline constexpr uint64_t le64(uint64_t x) {
+#ifdef TIARY_BIG_ENDIAN
+	return bswap64(x);
+#else
+	return x;
+#endif
+}
+
+// Reads or appends little endian integers in byte strings
+
+inline uint32_t load_le32(const char *p) {
+	uint32_t x;
+	memcpy(&x, p, 4);
+	return le32(x);
+}
+
+inline uint64_t load_le64(const char *p) {
+	uint64_t x;
+	memcpy(&x, p, 8);
+	return le64(x);
+}
+
+inline void append_le32(std::string *s, uint32_t x) {
+	x = le32(x);
+	s->append(reinterpret_cast<const char *>(&x), 4);
+}
+
+inline void append_le64(std::string *s, uint64_t x) {
+	x = le64(x);
+	s->append(reinterpret_cast<const char *>(&x), 8);
+}
+
 } // namespace tiary
 
 #endif // include guard
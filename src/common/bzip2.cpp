@@ -4,7 +4,7 @@
 /***************************************************************************
  *
  * Tiary, a terminal-based diary keeping system for Unix-like systems
- * Copyright (C) 2009, chys <admin@CHYS.INFO>
+ * Copyright (C) 2009, 2024, chys <admin@CHYS.INFO>
  *
  * This software is licensed under the 3-clause BSD license.
  * See LICENSE in the source package and/or online info for details.
@@ -18,54 +18,488 @@
  */
 
 #include "common/bzip2.h"
+#include "common/bswap.h"
+#include "common/parallel.h"
+#include "common/string.h"
 #include <bzlib.h>
+#include <limits.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
 
 namespace tiary {
 
-std::string bunzip2(const void *data, size_t len) {
-	std::string ret;
-	int bzret;
+namespace {
+
+// Each stream we generate contains exactly this many bytes of uncompressed
+// data (except the last one), which is also the block size of level 9.
+constexpr size_t kStreamInputSize = 900000;
+
+// Upper limit of the compressed size of the streams we generate
+constexpr size_t kMaxStreamSize = kStreamInputSize + kStreamInputSize / 64 + 650;
+
+// Bunzip2Stream passes data to its output in pieces of this size when
+// it has to decompress sequentially
+constexpr size_t kOutputChunkSize = 256 * 1024;
+
+/*
+ * Layout of the size trailer (all integers are 32-bit little endian):
+ *
+ * For each stream: compressed size, uncompressed size
+ * Number of streams
+ * kTrailerMagic
+ */
+constexpr std::string_view kTrailerMagic = "TiaryBzT"sv;
+constexpr size_t kTrailerFixedSize = 4 + kTrailerMagic.size();
+
+// Every stream with at least one block begins with "BZh", the block size
+// ('1' to '9'), and then the magic number of the first block
+constexpr std::string_view kStreamMagic = "BZh"sv;
+constexpr std::string_view kBlockMagic = "\x31\x41\x59\x26\x53\x59"sv;
+constexpr size_t kStreamHeaderSize = 4 + kBlockMagic.size();
+
+bool is_stream_header(std::string_view s) {
+	return s.size() >= kStreamHeaderSize &&
+		s.starts_with(kStreamMagic) &&
+		s[3] >= '1' && s[3] <= '9' &&
+		s.substr(4).starts_with(kBlockMagic);
+}
+
+// If data ends with a size trailer, returns its size; otherwise 0
+size_t trailer_size(std::string_view data) {
+	if (data.size() < kTrailerFixedSize || !data.ends_with(kTrailerMagic)) {
+		return 0;
+	}
+	size_t count = load_le32(data.data() + data.size() - kTrailerFixedSize);
+	if (count > (data.size() - kTrailerFixedSize) / 8) {
+		return 0;
+	}
+	return kTrailerFixedSize + count * 8;
+}
+
+struct StreamInfo {
+	size_t compressed_size;
+	size_t uncompressed_size;
+};
+
+// We never produce more than this in total (see common/bzip2.h)
+constexpr size_t kMaxTotalSize = INT_MAX;
+
+/**
+ * Parses the trailer written by bzip2 with size_trailer set.
+ * On success, shrinks len to exclude the trailer, and returns the info
+ * of all streams and the total uncompressed size.
+ *
+ * The trailer is not trusted: Sizes that bzip2 can't have written are
+ * rejected, so that we don't allocate huge amounts of memory for them.
+ */
+bool parse_trailer(const char *data, size_t *len, std::vector<StreamInfo> *streams, size_t *total_size) {
+	size_t l = *len;
+	if (l < kTrailerFixedSize || std::string_view(data + l - kTrailerMagic.size(), kTrailerMagic.size()) != kTrailerMagic) {
+		return false;
+	}
+	size_t count = load_le32(data + l - kTrailerFixedSize);
+	if (count == 0 || count > (l - kTrailerFixedSize) / 8) {
+		return false;
+	}
+	size_t streams_len = l - kTrailerFixedSize - count * 8;
+	const char *p = data + streams_len;
+	size_t compressed_total = 0;
+	size_t uncompressed_total = 0;
+	streams->resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		StreamInfo &info = (*streams)[i];
+		info.compressed_size = load_le32(p);
+		info.uncompressed_size = load_le32(p + 4);
+		p += 8;
+		// Every stream but the last has exactly kStreamInputSize bytes
+		if (info.compressed_size > kMaxStreamSize ||
+				info.compressed_size > streams_len - compressed_total ||
+				(i + 1 < count ? info.uncompressed_size != kStreamInputSize :
+				 info.uncompressed_size > kStreamInputSize)) {
+			return false;
+		}
+		// An empty input is compressed to a stream without blocks
+		if (info.uncompressed_size != 0 &&
+				!is_stream_header(std::string_view(data + compressed_total, info.compressed_size))) {
+			return false;
+		}
+		compressed_total += info.compressed_size;
+		uncompressed_total += info.uncompressed_size;
+	}
+	if (compressed_total != streams_len || uncompressed_total > kMaxTotalSize) {
+		return false;
+	}
+	*len = streams_len;
+	*total_size = uncompressed_total;
+	return true;
+}
 
+/**
+ * Decompresses one stream from the beginning of [in, in+len), and appends
+ * the result to out.
+ * Returns the number of bytes consumed, or 0 on error
+ */
+size_t decompress_stream(const char *in, size_t len, std::string *out) {
 	bz_stream stream = {}; // Initialize with all zeroes
-	if (BZ2_bzDecompressInit (&stream, 0, 0) == BZ_OK) {
-		size_t size_used = 0;
-		size_t size_guess = len*2;
-		ret.resize (size_guess);
-		stream.next_in = (char *)data;
-		stream.avail_in = len;
-		while (
-				stream.next_out = &ret[size_used],
-				stream.avail_out = size_guess - size_used,
-				(bzret = BZ2_bzDecompress (&stream)) == BZ_OK
-				) {
-			size_used = stream.total_out_lo32; // Simply ignore high bits, each on 64-bit systems
-			size_guess *= 2;
-			ret.resize (size_guess);
-		}
-		ret.resize (bzret == BZ_STREAM_END ? // Success?
-				stream.total_out_lo32 :
-				0);
-		BZ2_bzDecompressEnd (&stream);
+	if (BZ2_bzDecompressInit (&stream, 0, 0) != BZ_OK) {
+		return 0;
+	}
+	size_t size_used = out->size();
+	stream.next_in = const_cast<char *>(in);
+	stream.avail_in = len;
+	int bzret;
+	for (;;) {
+		if (size_used == out->size()) {
+			out->resize(std::max(size_used + len * 2, out->size() * 2));
+		}
+		stream.next_out = &(*out)[size_used];
+		stream.avail_out = out->size() - size_used;
+		bzret = BZ2_bzDecompress (&stream);
+		size_used = stream.next_out - out->data();
+		if (bzret != BZ_OK) {
+			break;
+		}
+		if (stream.avail_in == 0 && stream.avail_out != 0) {
+			// Input exhausted before the stream ends
+			break;
+		}
+	}
+	BZ2_bzDecompressEnd (&stream);
+	out->resize(size_used);
+	if (bzret != BZ_STREAM_END) {
+		return 0;
+	}
+	return stream.next_in - in;
+}
+
+// Decompress streams of known sizes in parallel, directly into the final buffer
+std::string bunzip2_with_trailer(const char *in, const std::vector<StreamInfo> &streams, size_t total_size) {
+	std::string ret;
+	std::atomic<bool> failed{false};
+	auto decompress_all = [&](char *out) {
+		std::vector<std::pair<const char *, char *>> offsets;
+		offsets.reserve(streams.size());
+		for (const StreamInfo &info: streams) {
+			offsets.emplace_back(in, out);
+			in += info.compressed_size;
+			out += info.uncompressed_size;
+		}
+		parallel_for(streams.size(), [&](size_t i) {
+			unsigned destlen = streams[i].uncompressed_size;
+			if (BZ2_bzBuffToBuffDecompress(offsets[i].second, &destlen,
+						const_cast<char *>(offsets[i].first), streams[i].compressed_size, 0, 0) != BZ_OK ||
+					destlen != streams[i].uncompressed_size) {
+				failed.store(true, std::memory_order_relaxed);
+			}
+		});
+	};
+#ifdef __cpp_lib_string_resize_and_overwrite
+	ret.resize_and_overwrite(total_size, [&](char *out, size_t) {
+		decompress_all(out);
+		return total_size;
+	});
+#else
+	ret.resize(total_size);
+	decompress_all(ret.data());
+#endif
+	if (failed.load(std::memory_order_relaxed)) {
+		ret.clear();
 	}
 	return ret;
 }
 
-std::string bzip2(const void *data, size_t len) {
+bool bzip2_stream(std::string *ret, const char *data, size_t len) {
 	unsigned destlen = len/64 + len + 650; // ref to libbzip2's documentation
 
+	ret->resize(destlen);
+	if (BZ2_bzBuffToBuffCompress (&(*ret)[0], &destlen, const_cast<char *>(data), len, 9, 0, 0) != BZ_OK) {
+		ret->clear();
+		return false;
+	}
+	ret->resize(destlen);
+	return true;
+}
+
+} // anonymous namespace
+
+std::string bunzip2(const void *data, size_t len) {
+	const char *in = static_cast<const char *>(data);
+
+	std::vector<StreamInfo> streams;
+	size_t total_size;
+	size_t streams_len = len;
+	if (parse_trailer(in, &streams_len, &streams, &total_size)) {
+		std::string ret = bunzip2_with_trailer(in, streams, total_size);
+		if (!ret.empty() || total_size == 0) {
+			return ret;
+		}
+		// Perhaps it just happened to look like a trailer
+	}
+
 	std::string ret;
-	ret.resize(destlen);
+	Bunzip2Stream stream([&](std::string &&s) {
+		if (ret.empty()) {
+			ret = std::move(s);
+		} else {
+			ret += s;
+		}
+		return true;
+	});
+	if (!stream.feed({in, len}) || !stream.finish()) {
+		ret.clear();
+	}
+	return ret;
+}
 
-	unsigned newsize;
+struct Bunzip2Stream::SequentialState {
+	bz_stream stream = {}; // Initialize with all zeroes
 
-	if (BZ2_bzBuffToBuffCompress (&ret[0], &destlen, (char *)data, len, 9, 0, 0) == BZ_OK) {
-		newsize = destlen;
+	~SequentialState() {
+		BZ2_bzDecompressEnd(&stream);
 	}
-	else {
-		newsize = 0;
+};
+
+Bunzip2Stream::Bunzip2Stream(Output output)
+	: output_(std::move(output)),
+	sequential_(parallel_concurrency() <= 1) {
+}
+
+Bunzip2Stream::~Bunzip2Stream() = default;
+
+bool Bunzip2Stream::feed(std::string_view data) {
+	if (failed_) {
+		return false;
+	}
+	pending_ += data;
+	if (!(sequential_ ? decode_sequential(false) : decode_segments(false))) {
+		failed_ = true;
+	}
+	return !failed_;
+}
+
+bool Bunzip2Stream::finish() {
+	if (failed_) {
+		return false;
+	}
+	if (!(sequential_ ? decode_sequential(true) : decode_segments(true))) {
+		failed_ = true;
+	}
+	return !failed_;
+}
+
+void Bunzip2Stream::drop_pending(size_t len) {
+	pending_.erase(0, len);
+	scan_pos_ -= std::min(scan_pos_, len);
+	for (size_t &pos: starts_) {
+		pos -= len;
+	}
+}
+
+bool Bunzip2Stream::decode_segments(bool at_end) {
+	std::string_view data = pending_;
+
+	if (starts_.empty()) {
+		if (data.size() < kStreamHeaderSize && !at_end) {
+			return true;
+		}
+		if (!is_stream_header(data)) {
+			// Not what we generate.  Perhaps an empty stream.
+			sequential_ = true;
+			return decode_sequential(at_end);
+		}
+		starts_.push_back(0);
+		scan_pos_ = 1;
+	}
+
+	// Find more streams
+	size_t pos = scan_pos_;
+	while ((pos = data.find(kStreamMagic, pos)) != data.npos && data.size() - pos >= kStreamHeaderSize) {
+		if (is_stream_header(data.substr(pos))) {
+			starts_.push_back(pos);
+		}
+		++pos;
+	}
+	scan_pos_ = (pos != data.npos) ? pos : std::max(scan_pos_, data.size() - std::min(data.size(), kStreamMagic.size() - 1));
+
+	// Segments known to be complete: [starts_[i], starts_[i+1])
+	std::vector<size_t> ends(starts_.begin() + 1, starts_.end());
+	if (at_end) {
+		ends.push_back(data.size() - trailer_size(data.substr(starts_.back())));
+	}
+
+	// Streams we generate are never so large.  Don't wait for the next stream
+	// header; decompress the remaining data in this thread
+	bool switch_to_sequential = !at_end && data.size() - starts_.back() > kMaxStreamSize;
+
+	size_t batch_size = 2 * parallel_concurrency();
+	for (size_t first = 0; first < ends.size(); first += batch_size) {
+		size_t n = std::min(batch_size, ends.size() - first);
+		std::vector<std::string> outputs(n);
+		std::vector<char> ok(n);
+		parallel_for(n, [&](size_t i) {
+			size_t start = starts_[first + i];
+			size_t len = ends[first + i] - start;
+			// What we found may be a false positive. Make sure it's exactly one stream
+			ok[i] = (decompress_stream(data.data() + start, len, &outputs[i]) == len);
+		});
+		for (size_t i = 0; i < n; ++i) {
+			if (!ok[i]) {
+				// Fall back to the slow path from this segment on
+				size_t start = starts_[first + i];
+				starts_.clear();
+				drop_pending(start);
+				sequential_ = true;
+				return decode_sequential(at_end);
+			}
+			++streams_;
+			if (!output_(std::move(outputs[i]))) {
+				return false;
+			}
+		}
+	}
+
+	if (at_end) {
+		if (streams_ == 0) {
+			return false;
+		}
+		pending_.clear();
+		starts_.clear();
+		return true;
+	}
+
+	size_t start = starts_[ends.size()];
+	starts_.erase(starts_.begin(), starts_.begin() + ends.size());
+	drop_pending(start);
+	if (switch_to_sequential) {
+		starts_.clear();
+		sequential_ = true;
+		return decode_sequential(at_end);
+	}
+	return true;
+}
+
+bool Bunzip2Stream::decode_sequential(bool at_end) {
+	size_t consumed = 0;
+	for (;;) {
+		std::string_view rest = std::string_view(pending_).substr(consumed);
+		if (!seq_) {
+			// Between streams
+			if (rest.empty()) {
+				break;
+			}
+			if (rest.size() < kStreamMagic.size() && !at_end) {
+				break;
+			}
+			if (!rest.starts_with(kStreamMagic)) {
+				// The size trailer, or padding some tools add after the last
+				// stream (stock bzip2 ignores it, too).  Wait until the end,
+				// in case more streams follow
+				if (!at_end) {
+					break;
+				}
+				if (streams_ == 0) {
+					return false;
+				}
+				consumed = pending_.size();
+				break;
+			}
+			seq_ = std::make_unique<SequentialState>();
+			if (BZ2_bzDecompressInit(&seq_->stream, 0, 0) != BZ_OK) {
+				seq_.reset();
+				return false;
+			}
+		}
+
+		bz_stream &stream = seq_->stream;
+		stream.next_in = const_cast<char *>(rest.data());
+		stream.avail_in = rest.size();
+		int bzret;
+		do {
+			std::string out;
+#ifdef __cpp_lib_string_resize_and_overwrite
+			out.resize_and_overwrite(kOutputChunkSize, [&](char *buf, size_t size) {
+				stream.next_out = buf;
+				stream.avail_out = size;
+				bzret = BZ2_bzDecompress(&stream);
+				return stream.next_out - buf;
+			});
+#else
+			out.resize(kOutputChunkSize);
+			stream.next_out = out.data();
+			stream.avail_out = out.size();
+			bzret = BZ2_bzDecompress(&stream);
+			out.resize(stream.next_out - out.data());
+#endif
+			if (bzret != BZ_OK && bzret != BZ_STREAM_END) {
+				return false;
+			}
+			if (!out.empty() && !output_(std::move(out))) {
+				return false;
+			}
+		} while (bzret == BZ_OK && (stream.avail_in != 0 || stream.avail_out == 0));
+		consumed = stream.next_in - pending_.data();
+
+		if (bzret == BZ_STREAM_END) {
+			seq_.reset();
+			++streams_;
+		} else {
+			// Need more input
+			break;
+		}
+	}
+	drop_pending(consumed);
+
+	if (at_end) {
+		return !seq_ && streams_ != 0;
+	}
+	return true;
+}
+
+std::string bzip2(const void *data, size_t len, bool size_trailer) {
+	const char *in = static_cast<const char *>(data);
+
+	// Compress every kStreamInputSize bytes into a separate stream in parallel.
+	// Concatenated streams are still a valid bzip2 file
+	std::vector<std::string> streams(std::max<size_t>(1, (len + kStreamInputSize - 1) / kStreamInputSize));
+	std::atomic<bool> failed{false};
+	parallel_for(streams.size(), [&](size_t i) {
+		size_t offset = i * kStreamInputSize;
+		if (!bzip2_stream(&streams[i], in + offset, std::min(kStreamInputSize, len - offset))) {
+			failed.store(true, std::memory_order_relaxed);
+		}
+	});
+	if (failed.load(std::memory_order_relaxed)) {
+		return {};
+	}
+	if (streams.size() == 1 && !size_trailer) {
+		return std::move(streams[0]);
+	}
+
+	std::string ret;
+	size_t total_size = kTrailerFixedSize + 8 * streams.size();
+	for (const std::string &stream: streams) {
+		total_size += stream.size();
+	}
+	ret.reserve(total_size);
+	for (const std::string &stream: streams) {
+		ret += stream;
 	}
 
-	ret.resize (newsize);
+	if (size_trailer) {
+		for (size_t i = 0; i < streams.size(); ++i) {
+			append_le32(&ret, streams[i].size());
+			append_le32(&ret, std::min(kStreamInputSize, len - i * kStreamInputSize));
+		}
+		append_le32(&ret, streams.size());
+		ret += kTrailerMagic;
+	}
+	return ret;
+}
+
+std::string bzip2_single_stream(const void *data, size_t len) {
+	std::string ret;
+	bzip2_stream(&ret, static_cast<const char *>(data), len);
 	return ret;
 }
 
@@ -22,6 +22,8 @@
 #define TIARY_COMMON_BZIP2_H
 
 #include <stddef.h>
+#include <functional>
+#include <memory>
 #include <vector>
 #include <string>
 #include <string_view>
@@ -35,18 +37,80 @@ namespace tiary {
 // The second argument, though having type size_t, cannot exceed
 // the limit of signed int. (Sure, this could be fixed, which however
 // is unnecessary here.)
+//
+// bzip2 splits data larger than the block size (900000 bytes) into
+// multiple concatenated streams and compresses them in parallel.  Stock
+// bzip2 also accepts such data.  bunzip2 decompresses all streams.
+// (The segmented diary file format compresses its segments in parallel,
+// and only a segment with a huge entry is that large.)
+//
+// If size_trailer is true, the sizes of all streams are appended to the
+// result, so that bunzip2 can allocate memory only once and decompress
+// all streams in parallel.  Stock bzip2 ignores the trailer with a warning.
+// The segmented diary file format has it in every segment.
+//
+// Tiary versions before 2024 decompress only the first stream, so files
+// they may read must be written with bzip2_single_stream, which doesn't
+// compress in parallel.
 
 std::string bunzip2(const void *, size_t);
-std::string bzip2(const void *, size_t);
+std::string bzip2(const void *, size_t, bool size_trailer = false);
+std::string bzip2_single_stream(const void *, size_t);
 
 inline std::string bunzip2(std::string_view s) {
 	return bunzip2(s.data(), s.length());
 }
 
-inline std::string bzip2(std::string_view s) {
-	return bzip2 (s.data (), s.length ());
+inline std::string bzip2(std::string_view s, bool size_trailer = false) {
+	return bzip2 (s.data (), s.length (), size_trailer);
+}
+
+inline std::string bzip2_single_stream(std::string_view s) {
+	return bzip2_single_stream(s.data(), s.length());
 }
 
+/**
+ * @brief	Decompresses bzip2 data that arrives in pieces
+ *
+ * Decompressed data is passed to the output callback in order, as soon as
+ * it's available.  Complete streams are decompressed in parallel if
+ * possible.
+ */
+class Bunzip2Stream {
+public:
+	/// Receives decompressed data.  Return false to stop decompression
+	using Output = std::function<bool(std::string &&)>;
+
+	explicit Bunzip2Stream(Output output);
+	~Bunzip2Stream();
+
+	Bunzip2Stream(const Bunzip2Stream &) = delete;
+	Bunzip2Stream &operator = (const Bunzip2Stream &) = delete;
+
+	/// @result	false if the data is corrupt or the output callback returned false
+	bool feed(std::string_view data);
+	/// Call after all data has been fed
+	/// @result	false if the data is incomplete or corrupt
+	bool finish();
+
+private:
+	bool decode_segments(bool at_end);
+	bool decode_sequential(bool at_end);
+	void drop_pending(size_t len);
+
+private:
+	struct SequentialState;
+
+	Output output_;
+	bool failed_ = false;
+	bool sequential_; ///< Decompress in this thread one stream after another
+	unsigned streams_ = 0; ///< Number of complete streams decompressed
+	std::string pending_; ///< Data not yet decompressed
+	size_t scan_pos_ = 0; ///< pending_ before this position has been searched for stream headers
+	std::vector<size_t> starts_; ///< Positions of stream headers found in pending_
+	std::unique_ptr<SequentialState> seq_; ///< Non-null if in the middle of a stream
+};
+
 } // namespace tiary
 
 #endif // Include guard
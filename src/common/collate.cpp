@@ -0,0 +1,27 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+
+#include "common/collate.h"
+#include <locale>
+
+namespace tiary {
+
+std::wstring collation_key(std::wstring_view str) {
+	// The same facet std::locale::operator() uses to compare strings
+	std::locale loc;
+	const std::collate<wchar_t> &facet = std::use_facet<std::collate<wchar_t>>(loc);
+	return facet.transform(str.data(), str.data() + str.size());
+}
+
+} // namespace tiary
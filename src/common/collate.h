@@ -0,0 +1,136 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+
+#ifndef TIARY_COMMON_COLLATE_H
+#define TIARY_COMMON_COLLATE_H
+
+#include <stddef.h>
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+
+/**
+ * @file	common/collate.h
+ * @author	chys <admin@chys.info>
+ * @brief	Sorts strings by the locale without collating them again and again
+ */
+
+namespace tiary {
+
+/**
+ * @brief	Collation key of a string in the current global locale
+ *
+ * Keys compare (as wide strings) in the same order as std::locale()
+ * compares the strings themselves, but much faster.
+ * Keys are invalidated if the global locale changes.
+ */
+std::wstring collation_key(std::wstring_view);
+
+/**
+ * @brief	Set of strings ordered by the current global locale
+ *
+ * Works like std::set<std::wstring, std::locale>, except that the
+ * collation key of every string is computed only once, when it is
+ * inserted, and comparisons are then simple comparisons of the keys.
+ * Strings collating equally are ordered by their code points.
+ */
+class CollatedWStringSet {
+	struct Item {
+		std::wstring key;
+		std::wstring str;
+	};
+	struct ItemLess {
+		typedef void is_transparent;
+		template <typename A, typename B>
+		bool operator () (const A &a, const B &b) const {
+			return std::pair<std::wstring_view, std::wstring_view>(a.key, a.str) <
+				std::pair<std::wstring_view, std::wstring_view>(b.key, b.str);
+		}
+	};
+	struct ItemView {
+		std::wstring_view key;
+		std::wstring_view str;
+	};
+	typedef std::set<Item, ItemLess> Items;
+
+public:
+	class const_iterator {
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef std::wstring value_type;
+		typedef ptrdiff_t difference_type;
+		typedef const std::wstring *pointer;
+		typedef const std::wstring &reference;
+
+		const_iterator() = default;
+		explicit const_iterator(Items::const_iterator it) : it_(it) {}
+
+		reference operator * () const { return it_->str; }
+		pointer operator -> () const { return &it_->str; }
+		const_iterator &operator ++ () { ++it_; return *this; }
+		const_iterator operator ++ (int) { return const_iterator(it_++); }
+		const_iterator &operator -- () { --it_; return *this; }
+		const_iterator operator -- (int) { return const_iterator(it_--); }
+		friend bool operator == (const const_iterator &, const const_iterator &) = default;
+
+	private:
+		Items::const_iterator it_;
+	};
+	typedef const_iterator iterator;
+
+	const_iterator begin() const { return const_iterator(items_.begin()); }
+	const_iterator end() const { return const_iterator(items_.end()); }
+	size_t size() const { return items_.size(); }
+	bool empty() const { return items_.empty(); }
+	void clear() { items_.clear(); }
+
+	std::pair<const_iterator, bool> insert(std::wstring str) {
+		std::wstring key = collation_key(str);
+		return insert_with_key(std::move(key), std::move(str));
+	}
+	std::pair<const_iterator, bool> emplace(std::wstring_view str) { return insert(std::wstring(str)); }
+	/// The same as insert(str), if key is already known to be collation_key(str)
+	std::pair<const_iterator, bool> insert_with_key(std::wstring key, std::wstring str) {
+		auto [it, inserted] = items_.insert(Item{std::move(key), std::move(str)});
+		return {const_iterator(it), inserted};
+	}
+
+	const_iterator find(std::wstring_view str) const {
+		std::wstring key = collation_key(str);
+		return const_iterator(items_.find(ItemView{key, str}));
+	}
+	size_t erase(std::wstring_view str) {
+		auto it = items_.find(ItemView{collation_key(str), str});
+		if (it == items_.end()) {
+			return 0;
+		}
+		items_.erase(it);
+		return 1;
+	}
+
+	friend bool operator == (const CollatedWStringSet &a, const CollatedWStringSet &b) {
+		return a.items_.size() == b.items_.size() &&
+			std::equal(a.begin(), a.end(), b.begin());
+	}
+
+private:
+	Items items_;
+};
+
+} // namespace tiary
+
+#endif // include guard
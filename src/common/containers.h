@@ -15,6 +15,7 @@
 #ifndef TIARY_COMMON_CONTAINERS_H
 #define TIARY_COMMON_CONTAINERS_H
 
+#include "common/collate.h"
 #include <stddef.h> // size_t
 #include <locale>
 #include <string>
@@ -24,7 +25,7 @@
 
 namespace tiary {
 
-typedef std::set<std::wstring,std::locale> WStringLocaleOrderedSet;
+typedef CollatedWStringSet WStringLocaleOrderedSet;
 typedef std::set<std::string, std::locale> StringLocaleOrderedSet;
 typedef std::map<std::wstring,std::wstring,std::locale> WStringLocaleOrderedMap;
 typedef std::map<std::string, std::string, std::locale> StringLocaleOrderedMap;
@@ -0,0 +1,64 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+
+#include "common/delayed_call.h"
+
+namespace tiary {
+
+DelayedCall::~DelayedCall() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+	}
+	cond_.notify_one();
+	if (thread_.joinable()) {
+		thread_.join();
+	}
+}
+
+void DelayedCall::schedule(Clock::duration delay) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		deadline_ = Clock::now() + delay;
+		if (!thread_.joinable()) {
+			thread_ = std::thread([this] { run(); });
+		}
+	}
+	cond_.notify_one();
+}
+
+void DelayedCall::cancel() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		deadline_.reset();
+	}
+	cond_.notify_one();
+}
+
+void DelayedCall::run() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (!quit_) {
+		if (!deadline_) {
+			cond_.wait(lock);
+		} else if (cond_.wait_until(lock, *deadline_) == std::cv_status::timeout &&
+				deadline_ && Clock::now() >= *deadline_) {
+			deadline_.reset();
+			lock.unlock();
+			func_();
+			lock.lock();
+		}
+	}
+}
+
+} // namespace tiary
@@ -0,0 +1,67 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+
+#ifndef TIARY_COMMON_DELAYED_CALL_H
+#define TIARY_COMMON_DELAYED_CALL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+/**
+ * @file	common/delayed_call.h
+ * @author	chys <admin@chys.info>
+ * @brief	Calls a function after a delay, in a background thread
+ */
+
+namespace tiary {
+
+/**
+ * @brief	Calls a function after a delay, in a background thread
+ *
+ * Every call to schedule replaces the previous one, so a burst of events
+ * each calling schedule results in only one call, after the burst ends.
+ */
+class DelayedCall {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	/// func is called from the background thread
+	explicit DelayedCall(std::function<void()> func) : func_(std::move(func)) {}
+	~DelayedCall();
+
+	DelayedCall(const DelayedCall &) = delete;
+	DelayedCall &operator = (const DelayedCall &) = delete;
+
+	void schedule(Clock::duration delay);
+	void cancel();
+
+private:
+	void run();
+
+private:
+	std::function<void()> func_;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::optional<Clock::time_point> deadline_;
+	bool quit_ = false;
+	std::thread thread_; // Started on first use
+};
+
+} // namespace tiary
+
+#endif // include guard
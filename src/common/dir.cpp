@@ -19,6 +19,7 @@
 
 
 #include "common/dir.h"
+#include "common/collate.h"
 #include "common/unicode.h"
 #include "common/string.h"
 #include "common/algorithm.h"
@@ -34,6 +35,7 @@
 #include <locale>
 #include <functional>
 #include <algorithm>
+#include <atomic>
 #include <locale>
 #include <string_view>
 #include <stdint.h>
@@ -372,31 +374,7 @@ std::wstring combine_pathname(std::wstring_view path, std::wstring_view basename
 
 namespace {
 
-class DefaultDirEntComparator
-{
-	std::locale loc;
-public:
-	bool operator () (const DirEnt &, const DirEnt &) const;
-};
-
-bool DefaultDirEntComparator::operator () (const DirEnt &a, const DirEnt &b) const
-{
-	// Directory < Non-directory
-	if ((a.attr ^ b.attr) & FILE_ATTR_DIRECTORY) {
-		return (a.attr & FILE_ATTR_DIRECTORY);
-	}
-	// Otherwise, compare name
-	return loc (a.name, b.name);
-}
-
-} // anonymous namespace
-
-
-DirEntList list_dir (
-			const std::wstring &directory,
-			const std::function<bool(const DirEnt &)> &filter,
-			const std::function<bool(const DirEnt &, const DirEnt &)> &comp
-		)
+DirEntList read_dir(const std::wstring &directory, const std::function<bool(const DirEnt &)> &filter)
 {
 	DirEntList filelist;
 
@@ -416,15 +394,51 @@ DirEntList list_dir (
 			}
 		}
 		closedir (dir);
-		// Sort them
-		std::sort(filelist.begin(), filelist.end(), comp);
 	}
 	return filelist;
 }
 
+} // anonymous namespace
+
+DirEntList list_dir (
+			const std::wstring &directory,
+			const std::function<bool(const DirEnt &)> &filter,
+			const std::function<bool(const DirEnt &, const DirEnt &)> &comp
+		)
+{
+	DirEntList filelist = read_dir(directory, filter);
+	std::sort(filelist.begin(), filelist.end(), comp);
+	return filelist;
+}
+
 DirEntList list_dir(const std::wstring &directory, const std::function<bool(const DirEnt &)> &filter) {
-	static const std::function<bool(const DirEnt &, const DirEnt &)> comp{DefaultDirEntComparator()};
-	return list_dir(directory, filter, comp);
+	DirEntList filelist = read_dir(directory, filter);
+
+	// Compute the collation key of every name only once
+	struct SortItem {
+		bool is_dir;
+		std::wstring key;
+		DirEnt *ent;
+	};
+	std::vector<SortItem> items;
+	items.reserve(filelist.size());
+	for (DirEnt &ent: filelist) {
+		items.push_back({bool(ent.attr & FILE_ATTR_DIRECTORY), collation_key(ent.name), &ent});
+	}
+	// Directory < Non-directory. Otherwise, compare name
+	std::sort(items.begin(), items.end(), [](const SortItem &a, const SortItem &b) {
+			if (a.is_dir != b.is_dir) {
+				return a.is_dir;
+			}
+			return a.key < b.key;
+		});
+
+	DirEntList sorted;
+	sorted.reserve(filelist.size());
+	for (SortItem &item: items) {
+		sorted.push_back(std::move(*item.ent));
+	}
+	return sorted;
 }
 
 // Explicit instantiations (char)
@@ -483,9 +497,11 @@ int my_mkstemp(std::string *name, std::string_view name_template) {
 		return -1;
 	}
 	struct timeval tv;
-	static uint64_t seed = 0;
+	// May be called from multiple threads (e.g., saving in the background)
+	static std::atomic<uint64_t> last_seed = 0;
 	gettimeofday (&tv, 0);
-	seed += uint64_t (getpid ()) ^ (uint64_t (tv.tv_usec) << 16) ^ tv.tv_sec;
+	uint64_t increment = uint64_t (getpid ()) ^ (uint64_t (tv.tv_usec) << 16) ^ tv.tv_sec;
+	uint64_t seed = last_seed.fetch_add(increment, std::memory_order_relaxed) + increment;
 
 	*name = name_template.substr(0, pipe_sign);
 	*name += "||||||"sv;
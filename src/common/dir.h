@@ -123,7 +123,7 @@ DirEntList list_dir (const std::wstring &dir, ///< Dir name
 		const std::function<bool(const DirEnt &, const DirEnt &)> &comp ///< A callback function to compare two items (less_than semantics)
 		);
 
-// Default order. Strings are compared using std::locale.
+// Default order. Strings are compared by their collation keys (same as std::locale).
 // Directories have precedence over normal files
 DirEntList list_dir(const std::wstring &dir, const std::function<bool(const DirEnt &)> &filter);
 
@@ -0,0 +1,74 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+
+#include "common/mapped_file.h"
+#include "common/misc.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
+
+namespace tiary {
+
+bool MappedFile::load(int fd) {
+	release();
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		return false;
+	}
+
+#ifdef HAVE_MMAP
+	// Very small files are cheaper to read
+	if (S_ISREG(st.st_mode) && st.st_size >= 16384 &&
+			static_cast<unsigned long long>(st.st_size) <= size_t(-1)) {
+		size_t size = st.st_size;
+		void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+# if defined HAVE_MADVISE && defined MADV_SEQUENTIAL
+			madvise(map, size, MADV_SEQUENTIAL);
+# endif
+			map_ = map;
+			view_ = {static_cast<const char *>(map), size};
+			return true;
+		}
+	}
+#endif
+
+	// Fall back to read
+	size_t estimated_size = 4096;
+	if (S_ISREG(st.st_mode) && st.st_size > 0) {
+		estimated_size = st.st_size + 1; // +1 so that we can see the EOF in one read
+	}
+	if (!read_whole_file(fd, &buffer_, estimated_size)) {
+		buffer_.clear();
+		return false;
+	}
+	view_ = buffer_;
+	return true;
+}
+
+void MappedFile::release() {
+#ifdef HAVE_MMAP
+	if (map_) {
+		munmap(map_, view_.size());
+		map_ = nullptr;
+	}
+#endif
+	std::string().swap(buffer_);
+	view_ = {};
+}
+
+} // namespace tiary
@@ -0,0 +1,70 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+
+#ifndef TIARY_COMMON_MAPPED_FILE_H
+#define TIARY_COMMON_MAPPED_FILE_H
+
+#include <stddef.h>
+#include <string>
+#include <string_view>
+
+/**
+ * @file	common/mapped_file.h
+ * @author	chys <admin@chys.info>
+ * @brief	Read-only access to the whole contents of a file
+ */
+
+namespace tiary {
+
+/**
+ * @brief	Contents of a whole file, mapped into memory if possible
+ *
+ * Regular files are mapped with mmap, so that reading them costs neither
+ * a copy nor repeated reallocation.  Pipes, special files, and systems
+ * without mmap fall back to read.
+ *
+ * A mapped file must not be truncated by anyone while the object is alive.
+ * We always replace diary files by renaming, so this is not a problem.
+ */
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile() { release(); }
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator = (const MappedFile &) = delete;
+
+	/**
+	 * @brief	Loads the contents of fd (which the caller still has to close)
+	 * @result	false on error
+	 */
+	bool load(int fd);
+
+	std::string_view view() const { return view_; }
+	const char *data() const { return view_.data(); }
+	size_t size() const { return view_.size(); }
+	bool empty() const { return view_.empty(); }
+	operator std::string_view () const { return view_; }
+
+	void release();
+
+private:
+	std::string_view view_;
+	void *map_ = nullptr;
+	std::string buffer_; // If not mapped
+};
+
+} // namespace tiary
+
+#endif // include guard
@@ -18,6 +18,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -130,6 +131,27 @@ bool safe_write_file(const char *filename, std::string_view data, std::string_vi
 	}
 }
 
+bool write_file_at(const char *filename, uint64_t offset, std::string_view data) {
+	int fd = open(filename, O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
+	if (fd < 0) {
+		return false;
+	}
+	bool ok = true;
+	for (std::string_view rest = data; ok && !rest.empty(); ) {
+		ssize_t l = pwrite(fd, rest.data(), rest.size(), offset);
+		if (l > 0) {
+			rest.remove_prefix(l);
+			offset += l;
+		} else if (l < 0 && errno == EINTR) {
+			continue;
+		} else {
+			ok = false;
+		}
+	}
+	ok = ok && ftruncate(fd, offset) == 0 && fsync(fd) == 0;
+	close(fd);
+	return ok;
+}
 
 std::string environment_expand(std::string_view s) {
 	std::string r;
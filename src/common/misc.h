@@ -15,6 +15,7 @@
 #ifndef TIARY_COMMON_MISC_H
 #define TIARY_COMMON_MISC_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string>
 #include <string_view>
@@ -29,6 +30,10 @@ bool read_whole_file(int, std::string *, size_t estimated_size = 4096);
 // Save or overwrite a file as safely as possible
 bool safe_write_file(const char *filename, std::string_view data, std::string_view data2 = {});
 
+// Write data at the specified offset of a file (creating it if necessary),
+// discard anything after it, and flush it to disk
+bool write_file_at(const char *filename, uint64_t offset, std::string_view data);
+
 // Expand environment variable representations like $param and ${param}
 // Returns the number of expansions
 std::string environment_expand(std::string_view);
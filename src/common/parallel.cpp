@@ -0,0 +1,103 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+
+#include "common/parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace tiary {
+
+namespace {
+
+// More threads don't help.  Our jobs are mostly limited by memory bandwidth
+constexpr unsigned kMaxThreads = 8;
+
+// Number of i's parallel_find_first tries at a time
+constexpr size_t kFindBlockSize = 256;
+
+// 0 = Not yet known
+std::atomic<unsigned> g_concurrency{0};
+
+} // namespace
+
+unsigned parallel_concurrency() {
+	unsigned concurrency = g_concurrency.load(std::memory_order_relaxed);
+	if (concurrency == 0) {
+		concurrency = std::clamp(std::thread::hardware_concurrency(), 1u, kMaxThreads);
+		g_concurrency.store(concurrency, std::memory_order_relaxed);
+	}
+	return concurrency;
+}
+
+void parallel_for(size_t n, const std::function<void(size_t)> &func) {
+	size_t threads = std::min<size_t>(n, parallel_concurrency());
+	if (threads <= 1) {
+		for (size_t i = 0; i < n; ++i) {
+			func(i);
+		}
+		return;
+	}
+
+	// Jobs may take very different time, so let every thread grab the next
+	// job when it's done with the previous one
+	std::atomic<size_t> next{0};
+	auto worker = [&]() {
+		size_t i;
+		while ((i = next.fetch_add(1, std::memory_order_relaxed)) < n) {
+			func(i);
+		}
+	};
+
+	std::vector<std::thread> helpers;
+	helpers.reserve(threads - 1);
+	for (size_t k = 1; k < threads; ++k) {
+		helpers.emplace_back(worker);
+	}
+	worker();
+	for (std::thread &t: helpers) {
+		t.join();
+	}
+}
+
+size_t parallel_find_first(size_t n, const std::function<bool(size_t)> &pred) {
+	size_t first_end = std::min(n, kFindBlockSize);
+	for (size_t i = 0; i < first_end; ++i) {
+		if (pred(i)) {
+			return i;
+		}
+	}
+
+	size_t blocks = (n - first_end + kFindBlockSize - 1) / kFindBlockSize;
+	std::atomic<size_t> found{n};
+	parallel_for(blocks, [&](size_t b) {
+		size_t begin = first_end + b * kFindBlockSize;
+		size_t end = std::min(n, begin + kFindBlockSize);
+		for (size_t i = begin; i < end; ++i) {
+			if (i > found.load(std::memory_order_relaxed)) {
+				return;
+			}
+			if (pred(i)) {
+				size_t prev = found.load(std::memory_order_relaxed);
+				while (i < prev && !found.compare_exchange_weak(prev, i, std::memory_order_relaxed)) {
+				}
+				return;
+			}
+		}
+	});
+	return found.load(std::memory_order_relaxed);
+}
+
+} // namespace tiary
@@ -0,0 +1,55 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+
+#ifndef TIARY_COMMON_PARALLEL_H
+#define TIARY_COMMON_PARALLEL_H
+
+#include <stddef.h>
+#include <functional>
+
+/**
+ * @file	common/parallel.h
+ * @author	chys <admin@chys.info>
+ * @brief	Runs independent jobs in multiple threads
+ */
+
+namespace tiary {
+
+// Number of threads parallel_for may use at most (including the caller)
+unsigned parallel_concurrency();
+
+/**
+ * @brief	Calls func(i) for every i in [0, n)
+ *
+ * The calls may happen in several threads in any order, so func must be
+ * safe to call concurrently with different arguments.
+ * The calling thread also does its share of work.
+ * Returns after all calls have finished.
+ */
+void parallel_for(size_t n, const std::function<void(size_t)> &func);
+
+/**
+ * @brief	Finds the smallest i in [0, n) for which pred(i) is true
+ * @result	n if there's none
+ *
+ * pred must be safe to call concurrently with different arguments.
+ * The first few i's are tried in the calling thread, since matches are
+ * often near; then blocks of i's are tried in several threads, in
+ * increasing order, skipping blocks after one with a match.
+ */
+size_t parallel_find_first(size_t n, const std::function<bool(size_t)> &pred);
+
+} // namespace tiary
+
+#endif // include guard
@@ -42,11 +42,27 @@ std::vector<std::pair<size_t, size_t>> Re::match(std::wstring_view str) const {
 	re2::StringPiece input(utf8);
 	re2::StringPiece match;
 
+	// Offsets of matches are in bytes.  Characters are counted from the
+	// end of the last match, instead of from the beginning every time
+	size_t byte_pos = 0;
+	size_t wchar_pos = 0; // Number of characters in utf8[0, byte_pos)
 	while (RE2::FindAndConsume(&input, re_, &match)) {
-		// Values in ovector are in bytes, not in UTF-8 characters
-		size_t wchar_offset = utf8_count_chars({utf8.data(), size_t(match.data() - utf8.data())});
+		if (match.empty()) {
+			// Would match again at the same place forever
+			if (input.empty()) {
+				break;
+			}
+			size_t next = input.data() - utf8.data();
+			utf8_next(utf8, &next);
+			input = re2::StringPiece(utf8.data() + next, utf8.length() - next);
+			continue;
+		}
+		size_t match_pos = match.data() - utf8.data();
+		wchar_pos += utf8_count_chars({utf8.data() + byte_pos, match_pos - byte_pos});
 		size_t wchar_len = utf8_count_chars({match.data(), match.length()});
-		ret.push_back (std::make_pair (wchar_offset, wchar_len));
+		ret.push_back (std::make_pair (wchar_pos, wchar_len));
+		byte_pos = match_pos + match.length();
+		wchar_pos += wchar_len;
 	}
 
 	return ret;
@@ -56,6 +72,10 @@ bool Re::basic_match(std::wstring_view str) const {
 	return RE2::PartialMatch(wstring_to_utf8(str), re_);
 }
 
+bool Re::basic_match_utf8(std::string_view str) const {
+	return RE2::PartialMatch(str, re_);
+}
+
 } // namespace tiary
 
 
@@ -43,6 +43,7 @@ public:
 	 * @result	@c true if there is any match; @c false otherwise
 	 */
 	bool basic_match(std::wstring_view) const;
+	bool basic_match_utf8(std::string_view) const;
 
 private:
 	std::string utf8_re_string_;
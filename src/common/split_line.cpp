@@ -16,10 +16,29 @@
 
 namespace tiary {
 
-size_t split_line(SplitStringLine *result, unsigned wid, std::wstring_view str, size_t offset, unsigned options) {
-	str.remove_prefix(offset);
-	const wchar_t *s = str.data();
-	size_t slen = str.length();
+namespace {
+
+// Reads characters from wide and UTF-8 strings alike
+inline char32_t next_char(std::wstring_view s, size_t *pos) {
+	return s[(*pos)++];
+}
+
+inline char32_t next_char(std::string_view s, size_t *pos) {
+	return utf8_next(s, pos);
+}
+
+inline char32_t prev_char(std::wstring_view s, size_t *pos) {
+	return s[--*pos];
+}
+
+inline char32_t prev_char(std::string_view s, size_t *pos) {
+	return utf8_prev(s, pos);
+}
+
+template <typename C>
+size_t split_line_impl(SplitStringLine *result, unsigned wid, std::basic_string_view<C> s, size_t offset, unsigned options) {
+	s.remove_prefix(offset);
+	size_t slen = s.length();
 
 	size_t cur = 0;     // Current position
 	unsigned curwid = 0;// Used screen width
@@ -31,37 +50,45 @@ size_t split_line(SplitStringLine *result, unsigned wid, std::wstring_view str,
 			result->wid = curwid;
 			return (offset + slen);
 		}
-		if (!(options & SPLIT_NEWLINE_AS_SPACE) && s[cur] == L'\n') {
+		size_t next = cur;
+		char32_t c = next_char(s, &next);
+		if (!(options & SPLIT_NEWLINE_AS_SPACE) && c == U'\n') {
 			result->begin = offset;
 			result->len = cur;
 			result->wid = curwid;
 			return (offset + cur + 1); // Skip the newline character
 		}
-		unsigned w = ucs_width (s[cur]);
+		unsigned w = ucs_width (c);
 		if (curwid + w > wid) {
 			break;
 		}
 		curwid += w;
-		++cur;
+		cur = next;
 	}
 	// Not the whold string. Neither has a newline character been encountered
 	// Now scan backward to find a proper line-breaking point
 	unsigned extra_skip = 0;
 	if (!(options & SPLIT_CUT_WORD)) {
-		unsigned xcur = cur;
+		size_t xcur = cur;
+		size_t tmp = xcur;
+		char32_t right = next_char(s, &tmp); // The character at xcur
 		for (;;) {
 			if (xcur == 0) { // This means that a single word is longer than a line. We have to split it
 				break;
 			}
-			if ((!ucs_isalnum (s[xcur-1]) || !ucs_isalnum (s[xcur])) &&
-					allow_line_end (s[xcur-1]) &&
-					allow_line_beginning (s[xcur])) {
+			size_t before = xcur;
+			char32_t left = prev_char(s, &before); // The character before xcur
+			if ((!ucs_isalnum (left) || !ucs_isalnum (right)) &&
+					allow_line_end (left) &&
+					allow_line_beginning (right)) {
 				cur = xcur;
 				break;
 			}
-			curwid -= ucs_width (s[--xcur]);
+			curwid -= ucs_width (left);
+			xcur = before;
+			right = left;
 		}
-		while (cur+extra_skip+1<slen && s[cur+extra_skip]==L' ') {
+		while (cur+extra_skip+1<slen && s[cur+extra_skip]==C(' ')) {
 			++extra_skip;
 		}
 	}
@@ -71,29 +98,60 @@ size_t split_line(SplitStringLine *result, unsigned wid, std::wstring_view str,
 	return (offset + cur + extra_skip);
 }
 
-unsigned split_line (SplitStringLine *result, unsigned max_lines, unsigned wid, std::wstring_view s) {
-	unsigned offset = 0;
+template <typename C>
+unsigned split_line_impl(SplitStringLine *result, unsigned max_lines, unsigned wid, std::basic_string_view<C> s) {
+	size_t offset = 0;
 	unsigned lines = 0;
 	for (; lines < max_lines && offset < s.length(); ++lines) {
-		offset = split_line(result++, wid, s, offset, 0);
+		offset = split_line_impl(result++, wid, s, offset, 0);
 	}
 	return lines;
 }
 
-SplitStringLineList split_line(unsigned wid, std::wstring_view s) {
+template <typename C>
+SplitStringLineList split_line_impl(unsigned wid, std::basic_string_view<C> s) {
 	SplitStringLineList ret;
 	if (wid < 2) { // Robustness. Avoid dead loops
-		for (size_t k = 0; k < s.length(); ++k) {
-			ret.push_back({k, 1, ucs_width(s[k])});
+		for (size_t k = 0; k < s.length(); ) {
+			size_t next = k;
+			char32_t c = next_char(s, &next);
+			ret.push_back({k, next - k, ucs_width(c)});
+			k = next;
 		}
 	} else {
-		for (unsigned offset = 0; offset < s.length(); ) {
+		for (size_t offset = 0; offset < s.length(); ) {
 			SplitStringLine line;
-			offset = split_line(&line, wid, s, offset, 0);
+			offset = split_line_impl(&line, wid, s, offset, 0);
 			ret.push_back(std::move(line));
 		}
 	}
 	return ret;
 }
 
+} // namespace
+
+size_t split_line(SplitStringLine *result, unsigned wid, std::wstring_view s, size_t offset, unsigned options) {
+	return split_line_impl(result, wid, s, offset, options);
+}
+
+size_t split_line(SplitStringLine *result, unsigned wid, std::string_view s, size_t offset, unsigned options) {
+	return split_line_impl(result, wid, s, offset, options);
+}
+
+unsigned split_line(SplitStringLine *result, unsigned max_lines, unsigned wid, std::wstring_view s) {
+	return split_line_impl(result, max_lines, wid, s);
+}
+
+unsigned split_line(SplitStringLine *result, unsigned max_lines, unsigned wid, std::string_view s) {
+	return split_line_impl(result, max_lines, wid, s);
+}
+
+SplitStringLineList split_line(unsigned wid, std::wstring_view s) {
+	return split_line_impl(wid, s);
+}
+
+SplitStringLineList split_line(unsigned wid, std::string_view s) {
+	return split_line_impl(wid, s);
+}
+
 } // namespace tiary
@@ -20,6 +20,8 @@
 
 namespace tiary {
 
+// Every function has two versions, for wide strings and UTF-8 strings.
+// For UTF-8 strings, offsets and lengths are in bytes
 struct SplitStringLine
 {
 	size_t begin; // Characters in [begin,begin+len) should be on this line. (Newline characters are excluded)
@@ -36,11 +38,14 @@ const unsigned SPLIT_CUT_WORD = 2;
 
 // Only one line. Returns the offset of the starting point of the next line
 size_t split_line(SplitStringLine *, unsigned wid, std::wstring_view s, size_t offset = 0, unsigned options = 0);
+size_t split_line(SplitStringLine *, unsigned wid, std::string_view s, size_t offset = 0, unsigned options = 0);
 
 // Limited number of lines. Returns the actual number of lines
 unsigned split_line(SplitStringLine [], unsigned max_lines, unsigned wid, std::wstring_view);
+unsigned split_line(SplitStringLine [], unsigned max_lines, unsigned wid, std::string_view);
 // Unlimited number of lines. Returns a vector
 SplitStringLineList split_line (unsigned wid, std::wstring_view);
+SplitStringLineList split_line (unsigned wid, std::string_view);
 
 } // namespace tiary
 
@@ -13,6 +13,7 @@
 
 
 #include "common/string.h"
+#include "common/unicode.h"
 #include <algorithm>
 #include <wctype.h>
 
@@ -65,6 +66,22 @@ std::wstring strlower(std::wstring_view str) {
 	return result;
 }
 
+std::string strlower(std::string_view str) {
+	std::string result;
+	result.reserve(str.length());
+	for (size_t i = 0; i < str.length(); ) {
+		unsigned char c = str[i];
+		if (c < 0x80) {
+			result += char((c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c);
+			++i;
+		} else {
+			char buf[4];
+			result.append(buf, wchar_to_utf8(buf, towlower(utf8_next(str, &i))));
+		}
+	}
+	return result;
+}
+
 std::vector <std::pair <size_t, size_t> >
 find_all(std::wstring_view haystack, std::wstring_view needle)
 {
@@ -58,6 +58,8 @@ inline wchar_t *strchrnul (wchar_t *str, wchar_t ch) { return const_cast <wchar_
 
 /// @brief	Make a string lowercase
 std::wstring strlower(std::wstring_view);
+/// @brief	Make a UTF-8 string lowercase
+std::string strlower(std::string_view);
 
 /**
  * @brief	Find all occurrences of a substring
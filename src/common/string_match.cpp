@@ -4,7 +4,7 @@
 /***************************************************************************
  *
  * Tiary, a terminal-based diary keeping system for Unix-like systems
- * Copyright (C) 2009, 2018, 2019, chys <admin@CHYS.INFO>
+ * Copyright (C) 2009, 2018, 2019, 2024, chys <admin@CHYS.INFO>
  *
  * This software is licensed under the 3-clause BSD license.
  * See LICENSE in the source package and/or online info for details.
@@ -13,11 +13,308 @@
 
 
 #include "common/string_match.h"
-#include "common/string.h"
+#include "common/unicode.h"
+#include <wctype.h>
+#include <algorithm>
+#include <numeric>
+#include <utility>
+#if defined __AVX2__
+# include <immintrin.h>
+#elif defined __SSE2__
+# include <emmintrin.h>
+#endif
 
 
 namespace tiary {
 
+namespace {
+
+// towlower as a table, built on first use, except that ASCII letters are
+// always lower-cased as in the C locale (as strlower does for UTF-8).
+// Only the first two planes are in the table, since no character beyond
+// them has case.
+class LowerTable {
+public:
+	static constexpr char32_t LIMIT = 0x20000;
+
+	LowerTable();
+
+	char32_t operator()(char32_t c) const {
+		if (c < LIMIT) {
+			const char32_t *block = blocks_[c / 256].get();
+			return block ? block[c % 256] : c;
+		}
+		return towlower(c);
+	}
+
+	// Calls f(u) for every character u lower-cased to c
+	template <typename F>
+	void for_each_preimage(char32_t c, F &&f) const {
+		if ((*this)(c) == c) {
+			f(c);
+		}
+		auto it = std::lower_bound(changed_.begin(), changed_.end(), std::pair<char32_t, char32_t>(c, 0));
+		for (; it != changed_.end() && it->first == c; ++it) {
+			f(it->second);
+		}
+	}
+
+private:
+	std::unique_ptr<char32_t[]> blocks_[LIMIT / 256]; // nullptr if no character in the block changes
+	std::vector<std::pair<char32_t, char32_t>> changed_; // (towlower(c), c) for every c changed; sorted
+};
+
+LowerTable::LowerTable() {
+	for (char32_t c = 0; c < LIMIT; ++c) {
+		char32_t d = (c >= 0x80) ? char32_t(towlower(c)) : (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+		if (d != c) {
+			std::unique_ptr<char32_t[]> &block = blocks_[c / 256];
+			if (!block) {
+				block.reset(new char32_t[256]);
+				std::iota(block.get(), block.get() + 256, c / 256 * 256);
+			}
+			block[c % 256] = d;
+			changed_.emplace_back(d, c);
+		}
+	}
+	std::sort(changed_.begin(), changed_.end());
+}
+
+const LowerTable &lower_table() {
+	static const LowerTable table;
+	return table;
+}
+
+// Invalid UTF-8 sequences are decoded as question marks (see utf8_next),
+// which may begin with any non-ASCII byte
+constexpr char32_t INVALID_UTF8 = U'?';
+
+} // anonymous namespace
+
+CaseInsensitiveFinder::CaseInsensitiveFinder(std::wstring_view pattern) {
+	if (pattern.empty()) {
+		return;
+	}
+	const LowerTable &lower = lower_table();
+	lower_.reserve(pattern.length());
+	for (wchar_t c: pattern) {
+		lower_.push_back(lower(c));
+	}
+
+	ascii_ = true;
+	for (char32_t c: lower_) {
+		unsigned n = 0;
+		lower.for_each_preimage(c, [&](char32_t u) {
+			if (u >= 0x80 || u == INVALID_UTF8) {
+				ascii_ = false;
+			}
+			++n;
+		});
+		if (n == 0 || n > 2) {
+			ascii_ = false;
+		}
+	}
+
+	if (ascii_) {
+		unsigned n = 0;
+		lower.for_each_preimage(lower_.front(), [&](char32_t u) { first_[n++] = u; });
+		first_[1] = first_[n - 1];
+		n = 0;
+		lower.for_each_preimage(lower_.back(), [&](char32_t u) { last_[n++] = u; });
+		last_[1] = last_[n - 1];
+		nfirst_ = 2;
+	} else if (lower_.front() != INVALID_UTF8) {
+		bool ok = true;
+		lower.for_each_preimage(lower_.front(), [&](char32_t u) {
+			char buf[4];
+			wchar_to_utf8(buf, u);
+			unsigned char b = buf[0];
+			if (std::find(first_, first_ + nfirst_, b) == first_ + nfirst_) {
+				if (nfirst_ < std::size(first_)) {
+					first_[nfirst_++] = b;
+				} else {
+					ok = false;
+				}
+			}
+		});
+		if (!ok) {
+			nfirst_ = 0;
+		}
+	}
+	std::fill(first_ + nfirst_, std::end(first_), first_[0]);
+}
+
+size_t CaseInsensitiveFinder::find(std::wstring_view haystack, size_t pos) const {
+	size_t n = lower_.length();
+	if (n == 0) {
+		return (pos <= haystack.length()) ? pos : haystack.npos;
+	}
+	const LowerTable &lower = lower_table();
+	for (size_t i = pos; i + n <= haystack.length(); ++i) {
+		if (lower(haystack[i]) == lower_[0]) {
+			size_t k = 1;
+			while (k < n && lower(haystack[i + k]) == lower_[k]) {
+				++k;
+			}
+			if (k == n) {
+				return i;
+			}
+		}
+	}
+	return haystack.npos;
+}
+
+bool CaseInsensitiveFinder::contains_utf8(std::string_view haystack) const {
+	if (lower_.empty()) {
+		return true;
+	}
+	if (ascii_) {
+		return find_ascii(haystack) != haystack.npos;
+	}
+	if (nfirst_ == 0) {
+		for (size_t i = 0; i < haystack.length(); utf8_next(haystack, &i)) {
+			if (match_utf8_at(haystack, i)) {
+				return true;
+			}
+		}
+		return false;
+	}
+	// Any of first_ begins a character
+	for (size_t i = 0; (i = find_first_byte(haystack, i)) != haystack.npos; ++i) {
+		if (match_utf8_at(haystack, i)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Checks the first and last bytes of every possible match, 16 or 32 at a time
+size_t CaseInsensitiveFinder::find_ascii(std::string_view haystack) const {
+	size_t n = lower_.length();
+	if (haystack.length() < n) {
+		return haystack.npos;
+	}
+	const char *s = haystack.data();
+	size_t end = haystack.length() - n + 1; // Possible beginnings of matches are [0, end)
+	size_t i = 0;
+#if defined __AVX2__
+	const __m256i f0 = _mm256_set1_epi8(first_[0]);
+	const __m256i f1 = _mm256_set1_epi8(first_[1]);
+	const __m256i l0 = _mm256_set1_epi8(last_[0]);
+	const __m256i l1 = _mm256_set1_epi8(last_[1]);
+	for (; i + 32 <= end; i += 32) {
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i + n - 1));
+		__m256i fa = _mm256_or_si256(_mm256_cmpeq_epi8(a, f0), _mm256_cmpeq_epi8(a, f1));
+		__m256i lb = _mm256_or_si256(_mm256_cmpeq_epi8(b, l0), _mm256_cmpeq_epi8(b, l1));
+		for (unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(fa, lb)); mask; mask &= mask - 1) {
+			size_t k = i + __builtin_ctz(mask);
+			if (match_ascii_at(s + k)) {
+				return k;
+			}
+		}
+	}
+#elif defined __SSE2__
+	const __m128i f0 = _mm_set1_epi8(first_[0]);
+	const __m128i f1 = _mm_set1_epi8(first_[1]);
+	const __m128i l0 = _mm_set1_epi8(last_[0]);
+	const __m128i l1 = _mm_set1_epi8(last_[1]);
+	for (; i + 16 <= end; i += 16) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i + n - 1));
+		__m128i fa = _mm_or_si128(_mm_cmpeq_epi8(a, f0), _mm_cmpeq_epi8(a, f1));
+		__m128i lb = _mm_or_si128(_mm_cmpeq_epi8(b, l0), _mm_cmpeq_epi8(b, l1));
+		for (unsigned mask = _mm_movemask_epi8(_mm_and_si128(fa, lb)); mask; mask &= mask - 1) {
+			size_t k = i + __builtin_ctz(mask);
+			if (match_ascii_at(s + k)) {
+				return k;
+			}
+		}
+	}
+#endif
+	for (; i < end; ++i) {
+		unsigned char a = s[i];
+		unsigned char b = s[i + n - 1];
+		if ((a == first_[0] || a == first_[1]) && (b == last_[0] || b == last_[1]) && match_ascii_at(s + i)) {
+			return i;
+		}
+	}
+	return haystack.npos;
+}
+
+size_t CaseInsensitiveFinder::find_first_byte(std::string_view haystack, size_t pos) const {
+	const char *s = haystack.data();
+	size_t end = haystack.length();
+	size_t i = pos;
+#if defined __AVX2__
+	const __m256i f0 = _mm256_set1_epi8(first_[0]);
+	const __m256i f1 = _mm256_set1_epi8(first_[1]);
+	const __m256i f2 = _mm256_set1_epi8(first_[2]);
+	const __m256i f3 = _mm256_set1_epi8(first_[3]);
+	for (; i + 32 <= end; i += 32) {
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+		__m256i eq = _mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(a, f0), _mm256_cmpeq_epi8(a, f1)),
+				_mm256_or_si256(_mm256_cmpeq_epi8(a, f2), _mm256_cmpeq_epi8(a, f3)));
+		if (unsigned mask = _mm256_movemask_epi8(eq)) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+#elif defined __SSE2__
+	const __m128i f0 = _mm_set1_epi8(first_[0]);
+	const __m128i f1 = _mm_set1_epi8(first_[1]);
+	const __m128i f2 = _mm_set1_epi8(first_[2]);
+	const __m128i f3 = _mm_set1_epi8(first_[3]);
+	for (; i + 16 <= end; i += 16) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+		__m128i eq = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(a, f0), _mm_cmpeq_epi8(a, f1)),
+				_mm_or_si128(_mm_cmpeq_epi8(a, f2), _mm_cmpeq_epi8(a, f3)));
+		if (unsigned mask = _mm_movemask_epi8(eq)) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+#endif
+	for (; i < end; ++i) {
+		unsigned char a = s[i];
+		if (a == first_[0] || a == first_[1] || a == first_[2] || a == first_[3]) {
+			return i;
+		}
+	}
+	return haystack.npos;
+}
+
+// The first and last characters are already checked by find_ascii
+bool CaseInsensitiveFinder::match_ascii_at(const char *s) const {
+	const LowerTable &lower = lower_table();
+	for (size_t k = 1; k + 1 < lower_.length(); ++k) {
+		unsigned char b = s[k];
+		if (b >= 0x80 || lower(b) != lower_[k]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool CaseInsensitiveFinder::match_utf8_at(std::string_view haystack, size_t pos) const {
+	const LowerTable &lower = lower_table();
+	for (char32_t c: lower_) {
+		if (pos >= haystack.length()) {
+			return false;
+		}
+		char32_t u = static_cast<unsigned char>(haystack[pos]);
+		if (u < 0x80) {
+			++pos;
+		} else {
+			u = utf8_next(haystack, &pos);
+		}
+		if (lower(u) != c) {
+			return false;
+		}
+	}
+	return true;
+}
+
 
 StringMatch::StringMatch ()
 	: pattern_()
@@ -37,11 +334,15 @@ StringMatch::StringMatch(std::wstring_view pattern, bool use_regex)
 		return;
 	}
 #ifdef TIARY_USE_RE2
-	if (regex_ && !*regex_) {
-		pattern_.clear();
-		regex_.reset();
+	if (regex_) {
+		if (!*regex_) {
+			pattern_.clear();
+			regex_.reset();
+		}
+		return;
 	}
 #endif
+	finder_ = CaseInsensitiveFinder(pattern);
 }
 
 StringMatch::~StringMatch ()
@@ -56,7 +357,15 @@ std::vector<std::pair<size_t, size_t>> StringMatch::match(std::wstring_view hays
 	else
 #endif
 	{
-		return find_all(strlower(haystack), strlower(pattern_));
+		std::vector<std::pair<size_t, size_t>> ret;
+		if (finder_.empty()) {
+			return ret;
+		}
+		size_t n = finder_.length();
+		for (size_t offset = 0; (offset = finder_.find(haystack, offset)) != haystack.npos; offset += n) {
+			ret.emplace_back(offset, n);
+		}
+		return ret;
 	}
 }
 
@@ -68,7 +377,19 @@ bool StringMatch::basic_match(std::wstring_view haystack) const {
 	else
 #endif
 	{
-		return (strlower(haystack).find(strlower(pattern_)) != std::wstring::npos);
+		return finder_.contains(haystack);
+	}
+}
+
+bool StringMatch::basic_match_utf8(std::string_view haystack) const {
+#ifdef TIARY_USE_RE2
+	if (regex_) {
+		return regex_->basic_match_utf8(haystack);
+	}
+	else
+#endif
+	{
+		return finder_.contains_utf8(haystack);
 	}
 }
 
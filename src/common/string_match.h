@@ -16,12 +16,63 @@
 #define TIARY_COMMON_STRING_MATCH_H
 
 #include "common/re.h"
+#include <stddef.h>
 #include <memory>
+#include <string>
 #include <string_view>
 #include <vector>
 
 namespace tiary {
 
+/**
+ * @brief	Finds a string in others, ignoring case
+ *
+ * Case is ignored the same way as tiary::strlower does for UTF-8 strings,
+ * i.e., by <code>towlower</code> in the LC_CTYPE locale in effect when the
+ * first finder is constructed, except for ASCII letters.
+ *
+ * The pattern is lower-cased once in the constructor; finding never
+ * allocates memory.
+ */
+class CaseInsensitiveFinder {
+public:
+	CaseInsensitiveFinder() = default;
+	explicit CaseInsensitiveFinder(std::wstring_view pattern);
+
+	bool empty() const { return lower_.empty(); }
+	/// Length of the pattern, in characters
+	size_t length() const { return lower_.length(); }
+
+	/// Offset of the first match at or after pos, or npos
+	size_t find(std::wstring_view haystack, size_t pos = 0) const;
+	bool contains(std::wstring_view haystack) const { return find(haystack) != haystack.npos; }
+	/// Same as above, but the haystack is in UTF-8
+	bool contains_utf8(std::string_view haystack) const;
+
+private:
+	size_t find_ascii(std::string_view haystack) const;
+	size_t find_first_byte(std::string_view haystack, size_t pos) const;
+	bool match_ascii_at(const char *) const;
+	bool match_utf8_at(std::string_view haystack, size_t pos) const;
+
+private:
+	std::u32string lower_;
+	/**
+	 * Whether every character that may be part of a match is ASCII,
+	 * so that a match has the same length in UTF-8 as the pattern
+	 */
+	bool ascii_ = false;
+	/**
+	 * If ascii_, the bytes that may begin (first_[0,1]) or end (last_)
+	 * a match.  Otherwise, the first bytes of the characters that may
+	 * begin a match (unused if nfirst_ == 0).
+	 * Unused elements are copies of first_[0].
+	 */
+	unsigned char nfirst_ = 0;
+	unsigned char first_[4] = {};
+	unsigned char last_[2] = {};
+};
+
 class StringMatch
 {
 public:
@@ -44,6 +95,8 @@ public:
 	 * @brief	Match against a string, returning only true/false
 	 */
 	bool basic_match(std::wstring_view) const;
+	/// Same as above, but matches against a UTF-8 string, without converting it
+	bool basic_match_utf8(std::string_view) const;
 
 
 	/**
@@ -63,6 +116,7 @@ public:
 
 private:
 	std::wstring pattern_;
+	CaseInsensitiveFinder finder_; ///< Used if not regex_
 #ifdef TIARY_USE_RE2
 	std::unique_ptr<Re> regex_; ///< Re object related to search_text, if it is a regular expression
 #endif
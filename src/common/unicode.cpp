@@ -127,6 +127,50 @@ size_t utf8_count_chars(std::string_view str) {
 	return r;
 }
 
+char32_t utf8_next(std::string_view s, size_t *pos) {
+	size_t i = *pos;
+	uint8_t b = s[i];
+	if (b < 0x80) {
+		*pos = i + 1;
+		return b;
+	}
+	unsigned n = utf8_len_by_first_byte(b);
+	if (n >= 2 && s.length() - i >= n) {
+		char32_t u = b & (0xffu >> n);
+		unsigned k = 1;
+		for (; k < n; ++k) {
+			uint8_t c = s[i + k];
+			if ((c & 0xc0) != 0x80) {
+				break;
+			}
+			u = (u << 6) | (c & 0x3f);
+		}
+		if (k == n && utf8_len_by_wchar(u) == n) {
+			*pos = i + n;
+			return u;
+		}
+	}
+	*pos = i + 1;
+	return U'?';
+}
+
+char32_t utf8_prev(std::string_view s, size_t *pos) {
+	size_t end = *pos;
+	size_t start = end - 1;
+	while (start > 0 && end - start < 4 && (uint8_t(s[start]) & 0xc0) == 0x80) {
+		--start;
+	}
+	size_t p = start;
+	char32_t c = utf8_next(s, &p);
+	if (p != end) {
+		// The last byte is not the end of a valid sequence
+		*pos = end - 1;
+		return U'?';
+	}
+	*pos = start;
+	return c;
+}
+
 char *wchar_to_utf8(char *dst, char32_t u) {
 	if (u < 0x800) {
 		if (u < 0x80) {
@@ -261,6 +305,14 @@ unsigned ucs_width(std::u32string_view s) {
 	return w;
 }
 
+unsigned utf8_width(std::string_view s) {
+	unsigned w = 0;
+	for (size_t i = 0; i < s.length(); ) {
+		w += ucs_width(utf8_next(s, &i));
+	}
+	return w;
+}
+
 namespace {
 
 template <typename C>
@@ -64,6 +64,21 @@ std::wstring utf8_to_wstring(std::string_view str, wchar_t substitute = L'?');
  */
 size_t utf8_count_chars(std::string_view str);
 
+/**
+ * @brief	Decodes one Unicode character from a UTF-8 string
+ * @param	str	Input UTF-8 string
+ * @param	pos	Offset of the first byte of the character, which is
+ *			advanced to the next character.  Must be less than str.length()
+ * @result	The decoded character.  Every byte of an invalid sequence is
+ *			decoded as a separate <code>U'?'</code>
+ */
+char32_t utf8_next(std::string_view str, size_t *pos);
+/**
+ * @brief	Same as tiary::utf8_next, but decodes the character before @c *pos,
+ *			and moves @c *pos back to its first byte.  @c *pos must be positive
+ */
+char32_t utf8_prev(std::string_view str, size_t *pos);
+
 /**
  * @brief	Converts one single wide (Unicode) character to UTF-8
  * @param	c	The character to be converted.
@@ -121,6 +136,13 @@ unsigned ucs_width(std::wstring_view str);
  *			Abnormal and nonprintable characters are counted as 1.
  */
 unsigned ucs_width(std::u32string_view str);
+/**
+ * @brief	Returns the on-screen width of a UTF-8 string
+ * @param	str	Input UTF-8 string
+ * @result	The total on-screen width of str. \n
+ *			Abnormal and nonprintable characters are counted as 1.
+ */
+unsigned utf8_width(std::string_view str);
 /**
  * @brief	Returns the maximum number of characters to fit in the specified screen width
  * @param	str	The given wide (Unicode) string
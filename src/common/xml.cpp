@@ -13,234 +13,264 @@
 
 
 #include "common/xml.h"
-#include <stack>
 #include <vector>
 #include <libxml/tree.h>
 #include <libxml/parser.h>
+#include <libxml/xmlreader.h>
 #include <libxml/xmlerror.h>
 #include <stdlib.h>
 #include <string.h>
 #include "common/string.h"
+#include "common/unicode.h"
 
 namespace tiary {
 
-void xml_free(XMLNode *root) {
-	if (root == 0) {
-		return;
-	}
-
-	// deque is too complicated; vector is fine
-	std::stack<XMLNode *, std::vector <XMLNode *> > stk;
-
-	XMLNode *p = root; // Current node
-
-	for (;;) {
-		XMLNode *right_sibling = p->next;
-		XMLNode *first_child = 0;
-		if (p->type == XMLNodeType::kTree) {
-			first_child = p->children;
-		}
-		delete p;
-		if (first_child) {
-			// Proceed to children
-			if (right_sibling) {
-				stk.push (right_sibling);
-			}
-			p = first_child;
-		}
-		else if (right_sibling) {
-			// Only right sibling
-			p = right_sibling;
-		}
-		else if (!stk.empty ()) {
-			// Neither right sibling nor children
-			// Pop one from stack
-			p = stk.top ();
-			stk.pop ();
-		}
-		else {
-			// Neither right sibling nor children
-			// And stack is empty.
-			// Everything is done.
-			break;
-		}
-	}
-}
-
 namespace {
 
-// Copy the attribute name and attributes, without children
-XMLNode *shallow_copy(const xmlNode *iptr) {
-	switch (iptr->type) {
-	case XML_TEXT_NODE:
-	case XML_CDATA_SECTION_NODE: { // Text node
-		XMLNode *optr = nullptr;
-		if (const char *text = (const char *)iptr->content) {
-			// If a text node is empty or completely consists of space (tab, newline) etc.
-			// Eliminate it!
-			std::string_view text_sv = text;
-			if (text_sv.find_first_not_of(" \t\r\n\v"sv) != text_sv.npos) {
-				optr = new XMLNode(XMLNode::TextTag(), text_sv);
-			}
-		}
-		return optr;
-	}
-	case XML_ELEMENT_NODE: { // Element node
-		XMLNode *optr = new XMLNode(XMLNode::TreeTag(), (const char *)iptr->name);
-		// Attributes. Not ordered.
-		for (xmlAttrPtr aptr=iptr->properties; aptr; aptr=aptr->next) {
-			if (aptr->name && aptr->children && aptr->children->content) {
-				optr->properties.emplace((const char *)aptr->name, (const char *)aptr->children->content);
-			}
-		}
-		return optr;
-	}
-	default: // Other kinds of nodes. Not supported.
-		return nullptr;
-	}
-}
-
-// The other way
-xmlNodePtr shallow_copy(const XMLNode *iptr) {
-	switch (iptr->type) {
-	case XMLNodeType::kText:
-		return xmlNewTextLen(BAD_CAST(iptr->text().c_str()), iptr->text().length());
-	case XMLNodeType::kTree: {
-		xmlNodePtr optr = xmlNewNode(0, BAD_CAST(iptr->name().c_str()));
-		// Copy attributes.
-		for (const auto &prop_pair: iptr->properties) {
-			xmlNewProp(optr, BAD_CAST(prop_pair.first.c_str()), BAD_CAST(prop_pair.second.c_str()));
-		}
-		return optr;
-	}
-	default:
-		return nullptr;
-	}
+// Spaces, tabs, newlines, etc. between tags are not interesting
+bool is_blank_text(std::string_view text) {
+	return text.find_first_not_of(" \t\r\n\v"sv) == text.npos;
 }
 
 void generic_error_silent (void *, const char *, ...) {}
 // Signature changed - use auto to support old and new libxml2
 void structured_error_silent(void *, auto) {}
 
+// libxml2 keeps these settings per thread, so every thread that parses
+// XML needs to call this
 void libxml2_init ()
 {
-	static bool called = false;
+	thread_local bool called = false;
 	if (!called) {
 		xmlSetGenericErrorFunc (0, generic_error_silent);
 		xmlSetStructuredErrorFunc (0, structured_error_silent);
 		xmlKeepBlanksDefault(0);
-		xmlIndentTreeOutput = 1;
 		called = true;
 	}
 }
 
 } // anonymous namespace
 
-XMLNode *xml_parse(const char *str, size_t len) {
-	libxml2_init ();
-
-	xmlDocPtr doc = xmlReadMemory(str, len, 0, 0, 0);
-	if (doc == nullptr) {
-		return 0;
-	}
+void xml_init() {
+	xmlInitParser();
+	libxml2_init();
+}
 
-	const xmlNode *iptr = xmlDocGetRootElement(doc);
-	if (iptr == nullptr) {
-		xmlFreeDoc (doc);
-		return 0;
+const XMLAttribute *xml_find_attribute(XMLAttributes attributes, std::string_view name) {
+	for (const XMLAttribute &attr: attributes) {
+		if (attr.name == name) {
+			return &attr;
+		}
 	}
+	return nullptr;
+}
 
-	// Successfully parsed. Now we need to construct our own XML tree
-
-	// "(a,b) in stk" means "b's children should be copied as a's children"
-	std::stack<std::pair<XMLNode *, const xmlNode *>, std::vector<std::pair<XMLNode *, const xmlNode *>>> stk;
+namespace {
 
-	XMLNode *root = shallow_copy (iptr);
-				// Current working output node
-				// Current working input node is iptr
-	if (root->type != XMLNodeType::kTree) {
-		// Root is a text node. Error.
-		delete root;
-		return 0;
+bool scan(xmlTextReaderPtr reader, XMLScanHandler &handler) {
+	if (reader == nullptr) {
+		return false;
 	}
-	XMLNode *optr = root;
-	for (;;) {
-		// Shallow copy all children of current node
-		optr->children = nullptr;
-		XMLNode **tail = &optr->children;
-		for (const xmlNode *child_ptr = iptr->xmlChildrenNode; child_ptr; child_ptr = child_ptr->next) {
-			if (XMLNode *newnode = shallow_copy (child_ptr)) {
-				*tail = newnode;
-				tail = &newnode->next;
-				if (child_ptr->xmlChildrenNode) {
-					stk.push(std::make_pair(newnode, child_ptr));
+
+	std::vector<XMLAttribute> attributes; // Reused for all elements
+	bool ok = true;
+	int read_ret;
+	while (ok && (read_ret = xmlTextReaderRead(reader)) == 1) {
+		switch (xmlTextReaderNodeType(reader)) {
+		case XML_READER_TYPE_ELEMENT: {
+			const xmlNode *node = xmlTextReaderCurrentNode(reader);
+			// Attributes without a value are dropped
+			attributes.clear();
+			for (xmlAttrPtr aptr = node->properties; aptr; aptr = aptr->next) {
+				if (aptr->name && aptr->children && aptr->children->content) {
+					attributes.push_back({(const char *)aptr->name, (const char *)aptr->children->content});
 				}
 			}
-		}
-		if (stk.empty ()) {
+			ok = handler.on_start((const char *)node->name, attributes);
+			// <tag /> has no separate closing event
+			if (ok && xmlTextReaderIsEmptyElement(reader) == 1) {
+				ok = handler.on_end();
+			}
 			break;
 		}
-		optr = stk.top().first;
-		iptr = stk.top().second;
-		stk.pop ();
-	}
-	xmlFreeDoc (doc);
-	return root;
-}
-
-std::string xml_make(const XMLNode *root) {
-	/**
-	 * I have considered directly generating the XML text, which should
-	 * not be difficult to implement and obviously more efficient than
-	 * using libxml2.
-	 *
-	 * However, considering there are many details in XML that I may
-	 * easily forget, (say, always remember to replace special characters
-	 * with escape sequences starting with "&")
-	 * I decide to stick to libxml2.
-	 */
-	std::string ret;
-
-	if (root->type == XMLNodeType::kTree) {
-
-		libxml2_init ();
-
-		xmlDocPtr doc = xmlNewDoc (BAD_CAST "1.0"); // "1.0" - XML version
-		xmlNodePtr oroot = xmlNewNode(0, BAD_CAST(root->name().c_str()));
-		xmlDocSetRootElement(doc, oroot);
-
-		// "(a,b) in stk" means "a's children should be copied as b's children"
-		std::stack<std::pair<const XMLNode *, xmlNodePtr>, std::vector<std::pair<const XMLNode *, xmlNodePtr>>> stk;
-		xmlNodePtr optr = oroot;         // Current working output node
-		const XMLNode *iptr = root; // Current working input node
-
-		for (;;) {
-			// Shallow copy all children of current node
-			for (XMLNode *child_ptr = iptr->children; child_ptr; child_ptr = child_ptr->next) {
-				if (xmlNodePtr nptr = shallow_copy (child_ptr)) {
-					xmlAddChild (optr, nptr);
-					if (child_ptr->type == XMLNodeType::kTree && child_ptr->children) {
-						stk.push(std::make_pair(child_ptr, nptr));
-					}
+		case XML_READER_TYPE_END_ELEMENT:
+			ok = handler.on_end();
+			break;
+		case XML_READER_TYPE_TEXT:
+		case XML_READER_TYPE_CDATA:
+		case XML_READER_TYPE_WHITESPACE:
+		case XML_READER_TYPE_SIGNIFICANT_WHITESPACE:
+			if (const char *text = (const char *)xmlTextReaderConstValue(reader)) {
+				std::string_view text_sv = text;
+				if (!is_blank_text(text_sv)) {
+					ok = handler.on_text(text_sv);
 				}
 			}
-			if (stk.empty ()) {
-				break;
+			break;
+		default: // Other kinds of nodes. Not supported.
+			break;
+		}
+	}
+	xmlFreeTextReader(reader);
+	return ok && read_ret == 0;
+}
+
+int read_callback(void *context, char *buffer, int len) {
+	return (*static_cast<const XMLReadFunction *>(context))(buffer, len);
+}
+
+int close_callback(void *) {
+	return 0;
+}
+
+} // anonymous namespace
+
+bool xml_scan(std::string_view str, XMLScanHandler &handler) {
+	libxml2_init ();
+
+	// Unlike xmlReadMemory, the reader frees every node as soon as we have moved
+	// past it, so the document is never held in memory as a whole.
+	return scan(xmlReaderForMemory(str.data(), str.size(), nullptr, nullptr, 0), handler);
+}
+
+bool xml_scan(const XMLReadFunction &read, XMLScanHandler &handler) {
+	libxml2_init ();
+	return scan(xmlReaderForIO(read_callback, close_callback, const_cast<XMLReadFunction *>(&read), nullptr, nullptr, 0), handler);
+}
+
+namespace {
+
+// We escape the same characters as libxml2 does.
+// Returns an empty string if c needs no escaping
+//
+// Other control characters can't be represented in XML 1.0 at all, even
+// escaped.  (libxml2 writes them as they are, and then fails to parse its
+// own output.)  Replace them with '?', as we do with invalid UTF-8
+std::string_view escape_char(char32_t c, bool is_attribute) {
+	switch (c) {
+	case '&':
+		return "&amp;"sv;
+	case '<':
+		return "&lt;"sv;
+	case '>':
+		return "&gt;"sv;
+	case '\r':
+		return "&#13;"sv;
+	case '"':
+		return is_attribute ? "&quot;"sv : std::string_view();
+	case '\n':
+		return is_attribute ? "&#10;"sv : std::string_view();
+	case '\t':
+		return is_attribute ? "&#9;"sv : std::string_view();
+	default:
+		return c < 0x20 ? "?"sv : std::string_view();
+	}
+}
+
+void append_escaped(std::string &out, std::string_view s, bool is_attribute) {
+	out.reserve(out.size() + s.size());
+	const char *run = s.data();
+	for (const char &c: s) {
+		std::string_view escape = escape_char((unsigned char)c, is_attribute);
+		if (!escape.empty()) {
+			out.append(run, &c);
+			out += escape;
+			run = &c + 1;
+		}
+	}
+	out.append(run, s.data() + s.size());
+}
+
+void append_escaped(std::string &out, std::wstring_view s, bool is_attribute) {
+	out.reserve(out.size() + s.size());
+	for (char32_t c: s) {
+		if (c < 0x80) {
+			std::string_view escape = escape_char(c, is_attribute);
+			if (escape.empty()) {
+				out += char(c);
+			} else {
+				out += escape;
 			}
-			iptr = stk.top().first;
-			optr = stk.top().second;
-			stk.pop ();
+		} else {
+			char buf[4];
+			out.append(buf, wchar_to_utf8(buf, c));
 		}
+	}
+}
+
+} // anonymous namespace
+
+void XMLWriter::declaration() {
+	out_ += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"sv;
+}
+
+void XMLWriter::close_pending_start() {
+	if (pending_start_) {
+		out_ += ">\n"sv;
+		pending_start_ = false;
+	}
+}
+
+void XMLWriter::open_tag(std::string_view name, std::initializer_list<XMLAttribute> attributes) {
+	close_pending_start();
+	out_.append(depth_ * 2, ' ');
+	out_ += '<';
+	out_ += name;
+	for (const XMLAttribute &attr: attributes) {
+		out_ += ' ';
+		out_ += attr.name;
+		out_ += "=\""sv;
+		append_escaped(out_, attr.value, true);
+		out_ += '"';
+	}
+}
 
-		xmlChar *str;
-		int len;
-		xmlDocDumpFormatMemoryEnc(doc, &str, &len, "UTF-8", 1);
-		xmlFreeDoc (doc);
+void XMLWriter::start(std::string_view name, std::initializer_list<XMLAttribute> attributes) {
+	open_tag(name, attributes);
+	pending_start_ = true;
+	++depth_;
+}
 
-		ret.assign ((const char*)str, len);
-		xmlFree (str);
+void XMLWriter::end(std::string_view name) {
+	--depth_;
+	if (pending_start_) {
+		// No children
+		out_ += "/>\n"sv;
+		pending_start_ = false;
+	} else {
+		out_.append(depth_ * 2, ' ');
+		out_ += "</"sv;
+		out_ += name;
+		out_ += ">\n"sv;
 	}
-	return ret;
+}
+
+void XMLWriter::empty(std::string_view name, std::initializer_list<XMLAttribute> attributes) {
+	open_tag(name, attributes);
+	out_ += "/>\n"sv;
+}
+
+void XMLWriter::text_element(std::string_view name, std::string_view text) {
+	open_tag(name, {});
+	out_ += '>';
+	append_escaped(out_, text, false);
+	out_ += "</"sv;
+	out_ += name;
+	out_ += ">\n"sv;
+}
+
+void XMLWriter::text_element(std::string_view name, std::wstring_view text) {
+	open_tag(name, {});
+	out_ += '>';
+	append_escaped(out_, text, false);
+	out_ += "</"sv;
+	out_ += name;
+	out_ += ">\n"sv;
+}
+
+void XMLWriter::fragment(std::string_view xml) {
+	close_pending_start();
+	out_ += xml;
 }
 
 } // namespace tiary
@@ -15,68 +15,122 @@
 #ifndef TIARY_COMMON_XML_H
 #define TIARY_COMMON_XML_H
 
-#include "common/containers.h"
 #include <stddef.h>
-#include <stdint.h>
-#include <string.h>
+#include <functional>
+#include <initializer_list>
+#include <span>
 #include <string>
 #include <string_view>
 
 /**
  * @file	common/xml.h
  * @author	chys <admin@chys.info>
- * @brief	Parses and creates XML
+ * @brief	Parses and generates XML
  *
  * Remember everything is in UTF-8
  */
 
 namespace tiary {
 
-enum struct XMLNodeType : uint8_t {
-	kTree,
-	kText,
-	kDummy,
+struct XMLAttribute {
+	std::string_view name;
+	std::string_view value; ///< From xml_scan, always followed by a null terminator
 };
 
-struct XMLNode
-{
-	struct TreeTag {};
-	struct TextTag {};
-
-	XMLNodeType type = XMLNodeType::kDummy;
-	XMLNode *children = nullptr;
-	XMLNode *next = nullptr; // Pointer to right sibling
-	std::string name_or_text; ///< tag name (kTree) or content (kText)
-	StringOrderedMap properties;
-
-	const std::string &name() const { return name_or_text; }
-	const std::string &text() const { return name_or_text; }
-	std::string &text() { return name_or_text; }
-
-	XMLNode() = default;
-	XMLNode(TreeTag, const char *tag_name) : type(XMLNodeType::kTree), name_or_text(tag_name, strlen(tag_name)) {}
-	XMLNode(TreeTag, std::string_view tag_name) : type(XMLNodeType::kTree), name_or_text(tag_name) {}
-	XMLNode(TreeTag, std::string &&tag_name) : type(XMLNodeType::kTree), name_or_text(std::move(tag_name)) {}
-	XMLNode(TextTag, const char *text) : type(XMLNodeType::kText), name_or_text(text, strlen(text)) {}
-	XMLNode(TextTag, std::string_view text) : type(XMLNodeType::kText), name_or_text(text) {}
-	XMLNode(TextTag, std::string &&text) : type(XMLNodeType::kText), name_or_text(std::move(text)) {}
-
-	XMLNode(const XMLNode &) = delete;
-	XMLNode &operator = (const XMLNode &) = delete;
+using XMLAttributes = std::span<const XMLAttribute>;
+
+// Returns nullptr if not found
+const XMLAttribute *xml_find_attribute(XMLAttributes, std::string_view name);
+
+/**
+ * @brief	Callbacks for xml_scan
+ *
+ * Events are delivered in document order.  Text nodes consisting completely
+ * of spaces are eliminated, and so are comments and processing instructions.
+ *
+ * Strings passed to the callbacks are only valid during the call.
+ * Any callback may return false to stop the scan.
+ */
+class XMLScanHandler {
+public:
+	virtual ~XMLScanHandler() = default;
+	virtual bool on_start(std::string_view name, XMLAttributes) = 0;
+	virtual bool on_end() = 0;
+	virtual bool on_text(std::string_view) = 0;
 };
 
-// Parses an XML string and returns the corresponding tree
-// Returns NULL on error
-XMLNode *xml_parse (const char *, size_t);
+/**
+ * @brief	Initializes the XML parser
+ *
+ * Must be called in the main thread before xml_scan is called in other threads
+ */
+void xml_init();
 
-inline XMLNode *xml_parse(std::string_view s) {
-	return xml_parse (s.data (), s.length ());
-}
+/**
+ * @brief	Parses an XML string without building a tree
+ * @result	false if the XML is malformed or a callback returns false
+ */
+bool xml_scan(std::string_view, XMLScanHandler &);
 
-// Recursively deletes an XML tree
-void xml_free (XMLNode *);
+/**
+ * Reads at most len bytes into buffer, and returns the number of bytes read.
+ * Returns 0 at the end of input, or -1 on error
+ */
+using XMLReadFunction = std::function<int(char *buffer, int len)>;
+
+/**
+ * @brief	Same as above, but the XML text is read in pieces from read,
+ * so the caller never needs to hold all of it
+ */
+bool xml_scan(const XMLReadFunction &read, XMLScanHandler &);
 
-std::string xml_make (const XMLNode *);
+/**
+ * @brief	Generates XML text directly into a string, without building a tree
+ *
+ * The output is formatted the same way as libxml2 formats a document:
+ * One tag per line, indented by two spaces per level, and tags without
+ * children are written as <tag/>.
+ *
+ * Attribute values and text are escaped as necessary.  Wide strings are
+ * converted to UTF-8.  Tag and attribute names are written verbatim.
+ */
+class XMLWriter {
+public:
+	/**
+	 * @param	depth	Nesting level of the first tag written.
+	 * Use a nonzero value to generate a fragment for fragment()
+	 */
+	explicit XMLWriter(std::string *out, unsigned depth = 0) : out_(*out), depth_(depth) {}
+
+	XMLWriter(const XMLWriter &) = delete;
+	XMLWriter &operator = (const XMLWriter &) = delete;
+
+	unsigned depth() const { return depth_; }
+
+	/// <?xml version="1.0" encoding="UTF-8"?>
+	void declaration();
+
+	/// <name attributes...>, to be followed by children and end(name)
+	void start(std::string_view name, std::initializer_list<XMLAttribute> attributes = {});
+	/// </name>
+	void end(std::string_view name);
+	/// <name attributes.../>
+	void empty(std::string_view name, std::initializer_list<XMLAttribute> attributes);
+	/// <name>text</name>
+	void text_element(std::string_view name, std::string_view text);
+	void text_element(std::string_view name, std::wstring_view text);
+	/// Appends children generated by another XMLWriter with depth set to depth()
+	void fragment(std::string_view xml);
+
+private:
+	void open_tag(std::string_view name, std::initializer_list<XMLAttribute> attributes);
+	void close_pending_start();
+
+private:
+	std::string &out_;
+	unsigned depth_;
+	bool pending_start_ = false; // The last tag written by start is not closed with ">" yet
+};
 
 } // namespace tiary
 
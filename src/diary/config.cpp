@@ -33,6 +33,8 @@ extern const OptionDescription g_global_option_descriptions[] = {
 	{ GLOBAL_OPTION_DATETIME_FORMAT   , "%m/%d/%Y" },
 	{ GLOBAL_OPTION_LONGTIME_FORMAT   , "%W %B %d, %Y  %h:%M:%S %P" },
 	{ GLOBAL_OPTION_RECENT_FILES      , "4" },
+	{ GLOBAL_OPTION_AUTOSAVE_IDLE     , "30" },
+	{ GLOBAL_OPTION_AUTOSAVE_EDITS    , "20" },
 	{ 0, 0 }
 };
 
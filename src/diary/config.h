@@ -34,6 +34,8 @@ namespace tiary {
 #define GLOBAL_OPTION_DATETIME_FORMAT  "time_format"
 #define GLOBAL_OPTION_LONGTIME_FORMAT  "long_time_format"
 #define GLOBAL_OPTION_RECENT_FILES     "recent_files"
+#define GLOBAL_OPTION_AUTOSAVE_IDLE    "autosave_idle"  // Seconds. 0 = Never
+#define GLOBAL_OPTION_AUTOSAVE_EDITS   "autosave_edits" // Modifications. 0 = Never
 
 
 #define PERFILE_OPTION_MODTIME         "use_mtime"
@@ -0,0 +1,260 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+
+#include "diary/diary.h"
+#include "common/collate.h"
+#include "common/unicode.h"
+#include <string.h>
+#include <algorithm>
+
+namespace tiary {
+
+namespace {
+
+// Texts are put in blocks of this size, unless they are too large
+constexpr size_t kTextBlockSize = 256 * 1024;
+
+// Number of entries in a block of DiaryEntryPool
+constexpr size_t kEntryBlockSize = 1024;
+
+std::shared_ptr<const char[]> copy_text(std::string_view s) {
+	std::shared_ptr<char[]> buffer(new char[s.size()]);
+	memcpy(buffer.get(), s.data(), s.size());
+	return buffer;
+}
+
+bool label_id_less(const DiaryLabel *a, const DiaryLabel *b) {
+	return a->id < b->id;
+}
+
+bool label_collation_less(const DiaryLabel *a, const DiaryLabel *b) {
+	if (int c = a->collation_key.compare(b->collation_key)) {
+		return c < 0;
+	}
+	return a->name < b->name;
+}
+
+} // namespace
+
+DiaryText::DiaryText(std::wstring s) {
+	*this = std::move(s);
+}
+
+DiaryText &DiaryText::operator = (std::wstring s) {
+	std::string utf8 = wstring_to_utf8(s);
+	if (utf8.empty()) {
+		buffer_.reset();
+		utf8_ = {};
+	} else {
+		buffer_ = copy_text(utf8);
+		utf8_ = {buffer_.get(), utf8.size()};
+	}
+	wide_ = std::move(s);
+	return *this;
+}
+
+void DiaryText::materialize() const {
+	wide_ = utf8_to_wstring(utf8_);
+}
+
+DiaryText DiaryTextStore::add(std::string_view s) {
+	if (s.empty()) {
+		return DiaryText();
+	}
+	if (s.size() > kTextBlockSize / 4) {
+		allocated_ += s.size();
+		std::shared_ptr<const char[]> buffer = copy_text(s);
+		return DiaryText(buffer, {buffer.get(), s.size()});
+	}
+	if (capacity_ - used_ < s.size()) {
+		block_.reset(new char[kTextBlockSize]);
+		used_ = 0;
+		capacity_ = kTextBlockSize;
+		allocated_ += kTextBlockSize;
+	}
+	char *p = block_.get() + used_;
+	memcpy(p, s.data(), s.size());
+	used_ += s.size();
+	return DiaryText(block_, {p, s.size()});
+}
+
+LabelDictionary &LabelDictionary::operator = (LabelDictionary &&other) noexcept {
+	if (this != &other) {
+		labels_ = std::move(other.labels_);
+		index_ = std::move(other.index_);
+		other.labels_.clear();
+		other.index_.clear();
+	}
+	return *this;
+}
+
+const DiaryLabel *LabelDictionary::intern(std::wstring_view name) {
+	std::string utf8 = wstring_to_utf8(name);
+	std::lock_guard<std::mutex> guard(lock_);
+	auto it = index_.find(utf8);
+	if (it != index_.end()) {
+		return it->second;
+	}
+	unsigned id = unsigned(labels_.size());
+	const DiaryLabel *label = labels_.emplace_back(
+		new DiaryLabel{std::wstring(name), std::move(utf8), collation_key(name), id}).get();
+	index_.emplace(label->utf8, label);
+	return label;
+}
+
+const DiaryLabel *LabelDictionary::find(std::string_view utf8) const {
+	std::lock_guard<std::mutex> guard(lock_);
+	auto it = index_.find(utf8);
+	return (it == index_.end()) ? nullptr : it->second;
+}
+
+const DiaryLabel *LabelDictionary::find(std::wstring_view name) const {
+	return find(wstring_to_utf8(name));
+}
+
+size_t LabelDictionary::memory_usage() const {
+	std::lock_guard<std::mutex> guard(lock_);
+	size_t bytes = labels_.capacity() * sizeof(labels_[0]);
+	for (const auto &label: labels_) {
+		bytes += sizeof(DiaryLabel) + (label->name.capacity() + label->collation_key.capacity()) * sizeof(wchar_t) +
+			label->utf8.capacity();
+	}
+	return bytes;
+}
+
+bool LabelList::contains(const DiaryLabel *label) const {
+	auto it = std::lower_bound(labels_.begin(), labels_.end(), label, label_id_less);
+	return (it != labels_.end() && *it == label);
+}
+
+bool LabelList::insert(const DiaryLabel *label) {
+	auto it = std::lower_bound(labels_.begin(), labels_.end(), label, label_id_less);
+	if (it != labels_.end() && *it == label) {
+		return false;
+	}
+	labels_.insert(it, label);
+	return true;
+}
+
+bool LabelList::erase(const DiaryLabel *label) {
+	auto it = std::lower_bound(labels_.begin(), labels_.end(), label, label_id_less);
+	if (it == labels_.end() || *it != label) {
+		return false;
+	}
+	labels_.erase(it);
+	return true;
+}
+
+std::vector<const DiaryLabel *> LabelList::sorted() const {
+	std::vector<const DiaryLabel *> res = labels_;
+	if (res.size() > 1) {
+		std::sort(res.begin(), res.end(), label_collation_less);
+	}
+	return res;
+}
+
+WStringLocaleOrderedSet LabelList::names() const {
+	WStringLocaleOrderedSet res;
+	for (const DiaryLabel *label: labels_) {
+		res.insert_with_key(label->collation_key, label->name);
+	}
+	return res;
+}
+
+void DiaryTextStore::merge(DiaryTextStore &&other) {
+	allocated_ += other.allocated_;
+	other.allocated_ = 0;
+}
+
+DiaryEntryPool &DiaryEntryPool::operator = (DiaryEntryPool &&other) noexcept {
+	if (this != &other) {
+		release();
+		blocks_ = std::move(other.blocks_);
+		last_block_used_ = std::exchange(other.last_block_used_, 0);
+		free_list_ = std::exchange(other.free_list_, nullptr);
+		text_store_ = std::move(other.text_store_);
+		other.text_store_ = DiaryTextStore();
+		labels_ = std::move(other.labels_);
+	}
+	return *this;
+}
+
+void *DiaryEntryPool::allocate() {
+	if (Slot *slot = free_list_) {
+		memcpy(&free_list_, slot->storage, sizeof(Slot *));
+		return slot->storage;
+	}
+	if (blocks_.empty() || last_block_used_ == kEntryBlockSize) {
+		blocks_.emplace_back(new Slot[kEntryBlockSize]);
+		last_block_used_ = 0;
+	}
+	return blocks_.back()[last_block_used_++].storage;
+}
+
+void DiaryEntryPool::destroy(DiaryEntry *entry) {
+	entry->~DiaryEntry();
+	Slot *slot = reinterpret_cast<Slot *>(entry);
+	memcpy(slot->storage, &free_list_, sizeof(Slot *));
+	free_list_ = slot;
+}
+
+void DiaryEntryPool::clear(DiaryEntryList *entries) {
+	for (DiaryEntry *entry: *entries) {
+		entry->~DiaryEntry();
+	}
+	entries->clear();
+	release();
+	text_store_ = DiaryTextStore();
+	labels_ = LabelDictionary();
+}
+
+void DiaryEntryPool::merge(DiaryEntryPool &&other) {
+	if (other.blocks_.empty()) {
+		return;
+	}
+	// The unused part of our last block would be lost. Put it in the free list
+	if (!blocks_.empty()) {
+		Slot *block = blocks_.back().get();
+		while (last_block_used_ < kEntryBlockSize) {
+			Slot *slot = &block[last_block_used_++];
+			memcpy(slot->storage, &free_list_, sizeof(Slot *));
+			free_list_ = slot;
+		}
+	}
+	blocks_.reserve(blocks_.size() + other.blocks_.size());
+	for (auto &block: other.blocks_) {
+		blocks_.push_back(std::move(block));
+	}
+	last_block_used_ = other.last_block_used_;
+	while (Slot *slot = other.free_list_) {
+		memcpy(&other.free_list_, slot->storage, sizeof(Slot *));
+		memcpy(slot->storage, &free_list_, sizeof(Slot *));
+		free_list_ = slot;
+	}
+	text_store_.merge(std::move(other.text_store_));
+	other.blocks_.clear();
+	other.last_block_used_ = 0;
+}
+
+size_t DiaryEntryPool::memory_usage() const {
+	return blocks_.size() * kEntryBlockSize * sizeof(Slot) + text_store_.memory_usage() + labels_.memory_usage();
+}
+
+void DiaryEntryPool::release() {
+	blocks_.clear();
+	last_block_used_ = 0;
+	free_list_ = nullptr;
+}
+
+} // namespace tiary
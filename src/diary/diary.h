@@ -17,8 +17,15 @@
 
 #include "common/datetime.h"
 #include "common/containers.h"
+#include <stddef.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 
@@ -27,18 +34,217 @@ namespace tiary {
 struct DiaryEntry;
 typedef std::vector<DiaryEntry *> DiaryEntryList;
 
+/**
+ * @brief	Title or text of a diary entry
+ *
+ * The canonical form is UTF-8, which is usually part of a buffer shared by
+ * all entries loaded together (see DiaryTextStore), so that loading a diary
+ * doesn't allocate memory for every entry.  The wide string form, which
+ * most of the UI needs, is only made when first asked for.
+ *
+ * Assigning a new value never modifies the shared buffer, so copies made
+ * before (e.g., snapshots being saved) are unaffected.
+ *
+ * utf8() may be called from any thread, but wide() should only be called
+ * from the UI thread.
+ */
+class DiaryText {
+public:
+	DiaryText() = default;
+	DiaryText(std::wstring); // Not explicit, as a convenience
+	DiaryText(std::shared_ptr<const char[]> buffer, std::string_view utf8)
+		: buffer_(std::move(buffer)), utf8_(utf8) {}
+
+	DiaryText &operator = (std::wstring);
+
+	std::string_view utf8() const { return utf8_; }
+	const std::wstring &wide() const {
+		if (!wide_) {
+			materialize();
+		}
+		return *wide_;
+	}
+	bool empty() const { return utf8_.empty(); }
+	/// A copy without the wide string form, cheap to make and safe to pass
+	/// to other threads
+	DiaryText share() const { return DiaryText(buffer_, utf8_); }
+
+private:
+	void materialize() const;
+
+private:
+	std::shared_ptr<const char[]> buffer_; // Owns utf8_
+	std::string_view utf8_;
+	mutable std::optional<std::wstring> wide_;
+};
+
+/**
+ * @brief	Append-only storage of UTF-8 text for DiaryText objects
+ *
+ * Texts are copied into large shared blocks, which are freed when all
+ * DiaryText objects referring to them are gone.
+ */
+class DiaryTextStore {
+public:
+	DiaryText add(std::string_view utf8);
+
+	/// Bytes allocated so far
+	size_t memory_usage() const { return allocated_; }
+	/// Counts memory allocated by another store as ours
+	void merge(DiaryTextStore &&);
+
+private:
+	std::shared_ptr<char[]> block_;
+	size_t used_ = 0;
+	size_t capacity_ = 0;
+	size_t allocated_ = 0;
+};
+
+/**
+ * @brief	A label interned in a LabelDictionary
+ *
+ * A label is never modified or freed while its dictionary exists, so entries
+ * refer to labels by pointer, and equal labels are equal pointers.
+ */
+struct DiaryLabel {
+	std::wstring name;
+	std::string utf8; ///< name in UTF-8
+	std::wstring collation_key; ///< collation_key(name), for sorting labels
+	unsigned id; ///< Labels are numbered from 0 in the order they are interned
+};
+
+/**
+ * @brief	Interns the labels of one diary file
+ *
+ * Labels are only added, never removed, until the dictionary is destroyed.
+ * intern and find are thread-safe, so that segments can be loaded in
+ * parallel.
+ */
+class LabelDictionary {
+public:
+	LabelDictionary() = default;
+	LabelDictionary(LabelDictionary &&other) noexcept { *this = std::move(other); }
+	LabelDictionary &operator = (LabelDictionary &&) noexcept;
+
+	/// Returns the label with the given name, adding it if necessary.
+	/// The name must be nonempty, without commas or leading or trailing spaces
+	const DiaryLabel *intern(std::wstring_view name);
+	/// Returns nullptr if there's no such label
+	const DiaryLabel *find(std::string_view utf8) const;
+	const DiaryLabel *find(std::wstring_view name) const;
+
+	/// Bytes of memory allocated for the labels
+	size_t memory_usage() const;
+
+private:
+	mutable std::mutex lock_;
+	std::vector<std::unique_ptr<DiaryLabel>> labels_; // Indexed by id
+	std::unordered_map<std::string_view, const DiaryLabel *> index_; // Keyed by DiaryLabel::utf8
+};
+
+/**
+ * @brief	Labels of an entry
+ *
+ * Kept as a vector of interned labels sorted by id, so that lookups and
+ * comparisons only compare integers.  Use sorted() for display order.
+ */
+class LabelList {
+public:
+	typedef std::vector<const DiaryLabel *>::const_iterator const_iterator;
+
+	const_iterator begin() const { return labels_.begin(); }
+	const_iterator end() const { return labels_.end(); }
+	size_t size() const { return labels_.size(); }
+	bool empty() const { return labels_.empty(); }
+
+	bool contains(const DiaryLabel *) const;
+	bool insert(const DiaryLabel *); ///< Returns false if already present
+	bool erase(const DiaryLabel *); ///< Returns false if not present
+	void clear() { labels_.clear(); }
+
+	/// The labels in the order they're displayed and saved, i.e., names
+	/// sorted by their collation keys
+	std::vector<const DiaryLabel *> sorted() const;
+	/// Names of the labels
+	WStringLocaleOrderedSet names() const;
+
+	friend bool operator == (const LabelList &, const LabelList &) = default;
+
+private:
+	std::vector<const DiaryLabel *> labels_;
+};
+
 struct DiaryEntry
 {
-	typedef WStringLocaleOrderedSet LabelList;
+	typedef tiary::LabelList LabelList;
 
 	DateTime local_time; // Local date and time
-	std::wstring title;
-	std::wstring text;
+	DiaryText title;
+	DiaryText text;
 	LabelList labels;
+	unsigned id = 0; // Assigned by EntryTable. Copies keep the ID of the original
+	unsigned version = 0; // Changed by EntryTable whenever the entry does. See EntryCache
 };
 
 
 
+/**
+ * @brief	Allocates the entries of one diary file
+ *
+ * Entries are constructed in large blocks, and the slots of destroyed
+ * entries are reused by later ones.  Memory is only returned when the pool
+ * is cleared or destroyed, all at once.
+ *
+ * Entries must be destroyed with destroy() or clear(), never deleted.
+ * A pool is not thread-safe; parallel loaders use a pool each, and merge
+ * them afterwards.  Labels, however, must be interned in the dictionary
+ * of the pool they are finally merged into.
+ */
+class DiaryEntryPool {
+public:
+	DiaryEntryPool() = default;
+	DiaryEntryPool(DiaryEntryPool &&other) noexcept { *this = std::move(other); }
+	DiaryEntryPool &operator = (DiaryEntryPool &&) noexcept;
+	~DiaryEntryPool() { release(); }
+
+	template <typename... Args>
+	DiaryEntry *create(Args &&...args) {
+		return new (allocate()) DiaryEntry{std::forward<Args>(args)...};
+	}
+	void destroy(DiaryEntry *);
+	/// Destroys the entries, which must be all entries alive in the pool,
+	/// clears the list, and frees all memory
+	void clear(DiaryEntryList *);
+
+	/// Takes over all entries and memory of another pool
+	void merge(DiaryEntryPool &&);
+
+	/// Titles and texts of entries loaded into the pool should be put here
+	DiaryTextStore &text_store() { return text_store_; }
+
+	/// Labels of entries in the pool
+	LabelDictionary &labels() { return labels_; }
+	const LabelDictionary &labels() const { return labels_; }
+
+	/// Bytes of memory allocated for entries, their loaded texts and labels
+	size_t memory_usage() const;
+
+private:
+	void *allocate();
+	void release();
+
+private:
+	struct Slot {
+		alignas(DiaryEntry) unsigned char storage[sizeof(DiaryEntry)];
+	};
+	std::vector<std::unique_ptr<Slot[]>> blocks_;
+	size_t last_block_used_ = 0; ///< Slots ever used in blocks_.back()
+	Slot *free_list_ = nullptr; ///< Slots of destroyed entries, linked through their first bytes
+	DiaryTextStore text_store_;
+	LabelDictionary labels_;
+};
+
+
 struct RecentFile
 {
 	std::wstring filename;
@@ -0,0 +1,67 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+
+#ifndef TIARY_DIARY_ENTRY_CACHE_H
+#define TIARY_DIARY_ENTRY_CACHE_H
+
+#include "diary/diary.h"
+#include <vector>
+
+/**
+ * @file	diary/entry_cache.h
+ * @author	chys <admin@chys.info>
+ * @brief	Values computed from entries, kept until the entries change
+ */
+
+namespace tiary {
+
+/**
+ * @brief	Values computed from entries, kept until the entries change
+ *
+ * A value is computed again when its entry has a different version
+ * (DiaryEntry::version) from the one it was computed from.  Entries not
+ * in an EntryTable (version 0) are never cached.
+ */
+template <typename T>
+class EntryCache {
+public:
+	template <typename F>
+	T get(const DiaryEntry &entry, F &&compute) {
+		if (entry.version == 0) {
+			return compute(entry);
+		}
+		if (entry.id >= slots_.size()) {
+			slots_.resize(entry.id + 1);
+		}
+		Slot &slot = slots_[entry.id];
+		if (slot.version != entry.version) {
+			slot.value = compute(entry);
+			slot.version = entry.version;
+		}
+		return slot.value;
+	}
+
+	void clear() { slots_.clear(); }
+
+private:
+	struct Slot {
+		unsigned version = 0;
+		T value{};
+	};
+	std::vector<Slot> slots_; // Indexed by DiaryEntry::id
+};
+
+} // namespace tiary
+
+#endif // include guard
@@ -0,0 +1,159 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+
+#include "diary/entry_table.h"
+#include "common/unicode.h"
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+namespace tiary {
+
+void EntryTable::assign(DiaryEntryList &&entries) {
+	entries_ = std::move(entries);
+	times_.resize(entries_.size());
+	title_widths_.resize(entries_.size());
+	positions_.clear();
+	time_order_.resize(entries_.size());
+	for (size_t i = 0; i < entries_.size(); ++i) {
+		add_id(i);
+		fill(i);
+		time_order_[i] = {times_[i], entries_[i]->id};
+	}
+	std::sort(time_order_.begin(), time_order_.end());
+}
+
+DiaryEntryList EntryTable::take() {
+	DiaryEntryList res = std::move(entries_);
+	entries_.clear();
+	times_.clear();
+	title_widths_.clear();
+	positions_.clear();
+	time_order_.clear();
+	return res;
+}
+
+void EntryTable::push_back(DiaryEntry *entry) {
+	entries_.push_back(entry);
+	times_.push_back(0);
+	title_widths_.push_back(0);
+	add_id(entries_.size() - 1);
+	fill(entries_.size() - 1);
+	insert_time_key({times_.back(), entry->id});
+}
+
+void EntryTable::erase(size_t pos) {
+	erase_time_key({times_[pos], entries_[pos]->id});
+	entries_.erase(entries_.begin() + pos);
+	times_.erase(times_.begin() + pos);
+	title_widths_.erase(title_widths_.begin() + pos);
+	update_positions(pos);
+}
+
+void EntryTable::swap(size_t pos) {
+	std::swap(entries_[pos], entries_[pos + 1]);
+	std::swap(times_[pos], times_[pos + 1]);
+	std::swap(title_widths_[pos], title_widths_[pos + 1]);
+	positions_[entries_[pos]->id] = pos;
+	positions_[entries_[pos + 1]->id] = pos + 1;
+}
+
+void EntryTable::set(size_t pos, DiaryEntry *entry) {
+	TimeKey old_key{times_[pos], entries_[pos]->id};
+	entry->id = old_key.id;
+	entries_[pos] = entry;
+	fill(pos);
+	if (times_[pos] != old_key.time) {
+		erase_time_key(old_key);
+		insert_time_key({times_[pos], old_key.id});
+	}
+}
+
+size_t EntryTable::time_lower_bound(uint64_t t) const {
+	return std::lower_bound(time_order_.begin(), time_order_.end(), TimeKey{t, 0}) - time_order_.begin();
+}
+
+size_t EntryTable::time_rank(const DiaryEntry *entry) const {
+	TimeKey key{times_[positions_[entry->id]], entry->id};
+	return std::lower_bound(time_order_.begin(), time_order_.end(), key) - time_order_.begin();
+}
+
+DiaryEntryList EntryTable::time_ordered() const {
+	DiaryEntryList res;
+	res.reserve(time_order_.size());
+	for (const TimeKey &key: time_order_) {
+		res.push_back(entries_[positions_[key.id]]);
+	}
+	return res;
+}
+
+DiaryEntryList EntryTable::time_range(uint64_t from, uint64_t to) const {
+	DiaryEntryList res;
+	for (size_t i = time_lower_bound(from), end = time_lower_bound(to); i < end; ++i) {
+		res.push_back(by_time(i));
+	}
+	return res;
+}
+
+void EntryTable::stable_sort_by_time() {
+	std::vector<uint32_t> order(entries_.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(),
+			[this](uint32_t a, uint32_t b) { return times_[a] < times_[b]; });
+
+	DiaryEntryList entries(entries_.size());
+	std::vector<uint64_t> times(times_.size());
+	std::vector<unsigned> title_widths(title_widths_.size());
+	for (size_t i = 0; i < order.size(); ++i) {
+		entries[i] = entries_[order[i]];
+		times[i] = times_[order[i]];
+		title_widths[i] = title_widths_[order[i]];
+	}
+	entries_ = std::move(entries);
+	times_ = std::move(times);
+	title_widths_ = std::move(title_widths);
+	update_positions(0);
+}
+
+void EntryTable::add_id(size_t pos) {
+	// IDs of removed entries are not reused, so that an entry removed
+	// (but not yet destroyed) is never mistaken for another one
+	entries_[pos]->id = positions_.size();
+	positions_.push_back(pos);
+}
+
+void EntryTable::fill(size_t pos) {
+	entries_[pos]->version = ++last_version_;
+	times_[pos] = entries_[pos]->local_time.get_value();
+	title_widths_[pos] = utf8_width(entries_[pos]->title.utf8());
+}
+
+void EntryTable::insert_time_key(TimeKey key) {
+	time_order_.insert(std::upper_bound(time_order_.begin(), time_order_.end(), key), key);
+}
+
+void EntryTable::erase_time_key(TimeKey key) {
+	auto it = std::lower_bound(time_order_.begin(), time_order_.end(), key);
+	if (it != time_order_.end() && *it == key) {
+		time_order_.erase(it);
+	}
+}
+
+void EntryTable::update_positions(size_t from) {
+	for (size_t i = from; i < entries_.size(); ++i) {
+		positions_[entries_[i]->id] = i;
+	}
+}
+
+} // namespace tiary
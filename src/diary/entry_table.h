@@ -0,0 +1,133 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+
+#ifndef TIARY_DIARY_ENTRY_TABLE_H
+#define TIARY_DIARY_ENTRY_TABLE_H
+
+#include "diary/diary.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * @file	diary/entry_table.h
+ * @author	chys <admin@chys.info>
+ * @brief	The list of all entries, with their most used fields at hand
+ */
+
+namespace tiary {
+
+/**
+ * @brief	All entries of a diary, in order
+ *
+ * Besides the entries themselves, the table keeps copies of the fields
+ * needed to scan or paint many entries (the time and the width of the
+ * title) in arrays parallel to the entry list, so that such scans don't
+ * have to visit every entry on the heap.
+ *
+ * Every entry in the table is given an ID (DiaryEntry::id), which stays
+ * the same as long as the entry is in the table, even if it moves or is
+ * replaced with a copy, and which maps back to its position in constant
+ * time.
+ *
+ * The table also keeps all entries ordered by time (ties broken by ID),
+ * independently of their order in the list, so that entries can be
+ * looked up by time in logarithmic time.
+ *
+ * The table must be told (update) whenever an entry changes, which also
+ * gives the entry a new version (DiaryEntry::version).  Versions are never
+ * reused by a table, not even after assign.
+ */
+class EntryTable {
+public:
+	typedef DiaryEntryList::const_iterator const_iterator;
+
+	const DiaryEntryList &list() const { return entries_; }
+	size_t size() const { return entries_.size(); }
+	bool empty() const { return entries_.empty(); }
+	DiaryEntry *operator [] (size_t pos) const { return entries_[pos]; }
+	const_iterator begin() const { return entries_.begin(); }
+	const_iterator end() const { return entries_.end(); }
+
+	/// DateTime values of DiaryEntry::local_time
+	const std::vector<uint64_t> &times() const { return times_; }
+	uint64_t time(size_t pos) const { return times_[pos]; }
+	/// Screen width of DiaryEntry::title, in one line
+	unsigned title_width(size_t pos) const { return title_widths_[pos]; }
+
+	/// Rank of the first entry whose time is not less than t, in time order
+	size_t time_lower_bound(uint64_t t) const;
+	/// Rank of an entry (which must be in the table) in time order
+	size_t time_rank(const DiaryEntry *) const;
+	/// The entry of the given rank in time order
+	DiaryEntry *by_time(size_t rank) const { return entries_[positions_[time_order_[rank].id]]; }
+	/// All entries in time order
+	DiaryEntryList time_ordered() const;
+	/// Entries whose time is in [from, to), in time order
+	DiaryEntryList time_range(uint64_t from, uint64_t to) const;
+
+	/// The entry with the given ID, or nullptr if it's no longer in the table
+	DiaryEntry *by_id(unsigned id) const {
+		if (id < positions_.size() && positions_[id] < entries_.size() && entries_[positions_[id]]->id == id) {
+			return entries_[positions_[id]];
+		}
+		return nullptr;
+	}
+
+	/// Returns size() if not found
+	size_t find(const DiaryEntry *entry) const {
+		size_t id = entry->id;
+		if (id < positions_.size() && positions_[id] < entries_.size() && entries_[positions_[id]] == entry) {
+			return positions_[id];
+		}
+		return entries_.size();
+	}
+
+	void assign(DiaryEntryList &&);
+	/// Removes and returns all entries (e.g., to destroy them)
+	DiaryEntryList take();
+
+	void push_back(DiaryEntry *);
+	void erase(size_t pos);
+	void swap(size_t pos); ///< Swaps the entries at pos and pos + 1
+	/// The new entry takes over the ID of the old one
+	void set(size_t pos, DiaryEntry *);
+	void update(size_t pos) { set(pos, entries_[pos]); }
+	void stable_sort_by_time();
+
+private:
+	void add_id(size_t pos);
+	void update_positions(size_t from);
+	void fill(size_t pos);
+
+	struct TimeKey {
+		uint64_t time;
+		unsigned id;
+		friend auto operator <=> (const TimeKey &, const TimeKey &) = default;
+	};
+	void insert_time_key(TimeKey);
+	void erase_time_key(TimeKey);
+
+private:
+	DiaryEntryList entries_;
+	std::vector<uint64_t> times_;
+	std::vector<unsigned> title_widths_;
+	std::vector<size_t> positions_; // Indexed by DiaryEntry::id
+	std::vector<TimeKey> time_order_; // Sorted
+	unsigned last_version_ = 0;
+};
+
+} // namespace tiary
+
+#endif // include guard
@@ -53,6 +53,57 @@
  * 0000~000F Signature
  * 0010~004F SHA512(salt_2018a + password + salt_2018b)
  * 0050~     evp_aes_encrypt(bzip2(XML), password)
+ *
+ * The bzip2 data in unencrypted and 2018 encrypted files is a single
+ * stream, because older versions decompress only the first one.
+ *
+ * Diary file format (segmented file 2024):
+ * 0000~000F Signature
+ * 0010~004F SHA512(salt_2018a + password + salt_2018b)
+ * 0050~0053 Number of segments (N), 32-bit little endian
+ * 0054~     N segment records, 48 bytes each:
+ *            Offset of the segment in file (64-bit little endian)
+ *            Size of the segment (32-bit little endian)
+ *            Number of entries in the segment (32-bit little endian)
+ *            First 32 bytes of SHA512(salt_2018b + password + XML)
+ * ....      evp_aes_encrypt(bzip2(XML) + size trailer, password) for each segment
+ *
+ * Each segment is a complete XML document in the same format as above.
+ * The first segment has the options and no entries; each of the others
+ * has a group of consecutive entries.  Segments are compressed and
+ * encrypted separately (each with its own IV), so they can be decoded
+ * independently, and unchanged segments need not be encrypted again.
+ * The size trailer (see common/bzip2.cpp) lets each segment be decompressed
+ * into a buffer allocated only once.
+ *
+ *
+ * Journal file (diary file name + ".journal"):
+ * 0000~000F Signature
+ * 0010~002F First 32 bytes of SHA512 of the diary file it applies to
+ * 0030~     Records, each written by a save:
+ *            Size of data (32-bit little endian)
+ *            First 32 bytes of SHA512(salt_2018b + password + XML)
+ *            Data: evp_aes_encrypt(XML, password), or XML if no password
+ *
+ * XML in the journal has the changes to apply to the diary file, in order:
+ *
+ * <tiary>
+ *  <entry op="insert" pos="N">...</entry>  Inserts an entry at N
+ *  <entry op="replace" pos="N">...</entry> Replaces entry N
+ *  <remove pos="N" />                      Removes entry N
+ *  <swap pos="N" />                        Swaps entries N and N+1
+ *  <sort />                                Stable sorts entries by time
+ *  <options />                             Resets options, followed by
+ *  <option name=".." value=".." />         options different from default
+ * </tiary>
+ *
+ * A journal file whose digest doesn't match the diary file is ignored.
+ * So we can safely rewrite the diary file before removing the journal file.
+ * If a record is damaged (e.g., by a crash while writing it), it and all
+ * records after it are ignored, and overwritten by the next save.
+ *
+ * Only files in the segmented format have journal files.  Older versions,
+ * which can read the other formats, don't know about journal files.
  */
 
 #include "diary/file.h"
@@ -60,17 +111,28 @@
 #include "diary/diary.h"
 #include "common/aes.h"
 #include "common/algorithm.h"
+#include "common/blocking_queue.h"
 #include "common/xml.h"
+#include "common/bswap.h"
 #include "common/bzip2.h"
 #include "common/misc.h"
+#include "common/mapped_file.h"
 #include "common/dir.h"
+#include "common/parallel.h"
 #include "common/unicode.h"
 #include "common/digest.h"
 #include "common/format.h"
 #include "common/string.h"
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <span>
+#include <thread>
 
 
 namespace tiary {
@@ -83,6 +145,8 @@ const char password_salt2018b[] = "TIARY, WRITTEN BY CHYS <ADMIN@CHYS.INFO>";
 
 const char new_format_signature_2009[16] = "TiaryEncrypted\0";
 const char new_format_signature_2018[16] = "TiaryEncrypted2";
+const char new_format_signature_2024[16] = "TiarySegmented1";
+const char journal_signature[16] = "TiaryJournal1\0\0";
 
 /**
  * Parse the time format used in the @c <time> tag
@@ -134,227 +198,743 @@ bool is_legal_label_name(std::wstring_view name) {
 }
 
 /**
- * Given an @c <entry> node, construct and return the corresponding DiaryEntry
- * If any error is encountered, returns 0
+ * Receives events from xml_scan, and extracts useful info.
+ * Applicable for both ~/.tiary and diary files
+ *
+ * Every DiaryEntry is constructed as soon as its @c <entry> tag is closed,
+ * so we never hold a tree of the whole document.
  */
-DiaryEntry *analyze_entry_xml(const XMLNode *entry_node) {
-	uint64_t local_time = 0;
-	std::string_view title;
-	std::string_view text;
-	DiaryEntry::LabelList labels;
+class DiaryXMLHandler final : public XMLScanHandler {
+public:
+	DiaryXMLHandler(OptionGroupBase &opts,
+			DiaryEntryList *entries,
+			DiaryEntryPool *pool, ///< Where entries are allocated. Must be nonnull if entries is
+			LabelDictionary *dictionary, ///< Where labels are interned. Must be nonnull if entries is
+			RecentFileList *recent_files,
+			bool strictest ///< Should be enabled for data file, and disabled for config files
+			)
+		: opts_(opts), entries_(entries), pool_(pool), dictionary_(dictionary), recent_files_(recent_files),
+		strictest_(strictest) {
+		if (entries) {
+			entries->clear ();
+		}
+		if (recent_files) {
+			recent_files->clear ();
+		}
+	}
+
+	bool on_start(std::string_view name, XMLAttributes attributes) override;
+	bool on_end() override;
+	bool on_text(std::string_view text) override;
+
+	// Whether the scan was stopped because of an error in the contents
+	// (as opposed to an XML syntax error)
+	bool content_error() const { return content_error_; }
 
-	if (entry_node->type != XMLNodeType::kTree) {
-		return nullptr;
+private:
+	bool on_start_main_child(std::string_view name, XMLAttributes attributes);
+	bool on_start_entry_child(std::string_view name, XMLAttributes attributes);
+	bool on_end_title_text();
+	bool on_end_entry();
+
+	bool error() {
+		content_error_ = true;
+		return false;
 	}
 
-	for (const XMLNode *ptr = entry_node->children; ptr; ptr = ptr->next) {
-		if (ptr->type != XMLNodeType::kTree) {
-			// Wild text directly within <entry> - Never allowed
-			return 0;
+private:
+	OptionGroupBase &opts_;
+	DiaryEntryList *entries_;
+	DiaryEntryPool *pool_;
+	LabelDictionary *dictionary_;
+	RecentFileList *recent_files_;
+	bool strictest_;
+	bool content_error_ = false;
+
+	// Number of currently open tags. 1 = directly within <tiary>
+	unsigned depth_ = 0;
+
+	// The <entry> being analyzed.
+	bool in_entry_ = false;
+	uint64_t local_time_ = 0;
+	bool has_title_ = false;
+	bool has_text_ = false;
+	DiaryText title_;
+	DiaryText text_;
+	DiaryEntry::LabelList labels_;
+
+	// The <title> or <text> being analyzed
+	enum struct Field : uint8_t { kNone, kTitle, kText };
+	Field field_ = Field::kNone;
+	unsigned field_children_ = 0;
+	bool field_first_child_text_ = false;
+};
+
+bool DiaryXMLHandler::on_start(std::string_view name, XMLAttributes attributes) {
+	bool ok = true;
+	switch (depth_) {
+	case 0:
+		// Root node must be <tiary>
+		if (name != "tiary"sv) {
+			return error();
+		}
+		break;
+	case 1:
+		ok = on_start_main_child(name, attributes);
+		break;
+	case 2:
+		if (in_entry_) {
+			ok = on_start_entry_child(name, attributes);
+		}
+		break;
+	case 3:
+		if (field_ != Field::kNone) {
+			++field_children_;
 		}
-		if (ptr->name() == "time"sv) { // <time local="...." />
+		break;
+	default:
+		break;
+	}
+	++depth_;
+	return ok;
+}
 
-			if (local_time) {
-				// More than one <time> tags.
-				return 0;
+bool DiaryXMLHandler::on_start_main_child(std::string_view name, XMLAttributes attributes) {
+	if (name == "option"sv) { // An option
+		const XMLAttribute *option_name = xml_find_attribute(attributes, "name"sv);
+		const XMLAttribute *option_value = xml_find_attribute(attributes, "value"sv);
+		if (option_name && option_value) {
+			opts_.set(std::string(option_name->value), option_value->value);
+		} else if (strictest_) {
+			// <option> without "name" or "value" - Disallowed in strict mode
+			return error();
+		}
+	} else if (entries_ && name == "entry"sv) {
+		in_entry_ = true;
+		local_time_ = 0;
+		has_title_ = has_text_ = false;
+		title_ = DiaryText();
+		text_ = DiaryText();
+		labels_.clear();
+	} else if (recent_files_ && name == "recent"sv) {
+		if (const XMLAttribute *file_name = xml_find_attribute(attributes, "file"sv)) {
+			recent_files_->emplace_back();
+			RecentFile &item = recent_files_->back();
+			item.filename = utf8_to_wstring(file_name->value);
+			if (const XMLAttribute *line_number = xml_find_attribute(attributes, "line"sv)) {
+				item.focus_entry = strtoul(line_number->value.data(), 0, 10);
+			} else {
+				// <option> without "line"
+				if (strictest_) {
+					// Disallowed in strict mode
+					return error();
+				}
+				else {
+					// Default to 0 in non-strict mode
+					item.focus_entry = 0;
+				}
 			}
+		}
+		else if (strictest_) {
+			// <option> without "file" - Disallowed in strict mode
+			return error();
+		}
+	}
+	else {
+		// Ignored for forward compatibility - even in strict mode
+	}
+	return true;
+}
 
-			auto it_local = ptr->properties.find("local");
-			if (it_local == ptr->properties.end()) {
-				return nullptr;
-			}
+bool DiaryXMLHandler::on_start_entry_child(std::string_view name, XMLAttributes attributes) {
+	if (name == "time"sv) { // <time local="...." />
 
-			if (!(local_time = parse_time(it_local->second.c_str()))) {
-				return 0;
-			}
+		if (local_time_) {
+			// More than one <time> tags.
+			return error();
+		}
 
-		} else if (ptr->name() == "label"sv) {
-			auto it_name = ptr->properties.find("name");
-			if (it_name == ptr->properties.end()) {
-				return nullptr;
-			}
-			// Convert name from UTF-8 to UCS-4
-			std::wstring wname = utf8_to_wstring(it_name->second);
+		const XMLAttribute *local = xml_find_attribute(attributes, "local"sv);
+		if (local == nullptr) {
+			return error();
+		}
+
+		if (!(local_time_ = parse_time(local->value.data()))) {
+			return error();
+		}
+
+	} else if (name == "label"sv) {
+		const XMLAttribute *label_name = xml_find_attribute(attributes, "name"sv);
+		if (label_name == nullptr) {
+			return error();
+		}
+		// Most labels are used by many entries. Only check and convert new ones
+		const DiaryLabel *label = dictionary_->find(label_name->value);
+		if (label == nullptr) {
+			std::wstring wname = utf8_to_wstring(label_name->value);
 			if (!is_legal_label_name (wname)) {
-				return 0;
+				return error();
 			}
-			labels.insert (wname);
+			label = dictionary_->intern(wname);
+		}
+		labels_.insert(label);
 
-		} else if (ptr->name() == "title"sv) {
+	} else if (name == "title"sv) {
 
-			if (title.data() != nullptr) { // More than one <title> tags
-				return 0;
-			}
+		if (has_title_) { // More than one <title> tags
+			return error();
+		}
+		field_ = Field::kTitle;
 
-			if (ptr->children == 0) { // Empty
-				title = ""sv;
-			} else if (ptr->children->type == XMLNodeType::kText) {
-				if (ptr->children->next != 0) {
-					return 0;
-				}
-				title = ptr->children->text();
-			}
+	} else if (name == "text"sv) {
 
-		} else if (ptr->name() == "text"sv) {
+		if (has_text_) { // More than one <text> tags
+			return error();
+		}
+		field_ = Field::kText;
 
-			if (text.data() != nullptr) { // More than one <text> tags
-				return 0;
-			}
+	} else {
+		// Unknown child tag within <entry>
+		return error();
+	}
+	field_children_ = 0;
+	field_first_child_text_ = false;
+	return true;
+}
 
-			if (ptr->children == 0) { // Empty
-				text = ""sv;
-			} else if (ptr->children->type == XMLNodeType::kText) {
-				if (ptr->children->next != 0) {
-					return 0;
-				}
-				text = ptr->children->text();
-			} else {
-				return 0;
-			}
+bool DiaryXMLHandler::on_text(std::string_view text) {
+	switch (depth_) {
+	case 1:
+		// Wild text directly within <tiary> - must be an error
+		// But we choose to be as tolerant as possible in non-strict mode
+		if (strictest_) {
+			return error();
+		}
+		break;
+	case 2:
+		if (in_entry_) {
+			// Wild text directly within <entry> - Never allowed
+			return error();
+		}
+		break;
+	case 3:
+		if (field_ != Field::kNone && field_children_++ == 0) {
+			field_first_child_text_ = true;
+			(field_ == Field::kTitle ? title_ : text_) = pool_->text_store().add(text);
+		}
+		break;
+	default:
+		break;
+	}
+	return true;
+}
+
+bool DiaryXMLHandler::on_end() {
+	--depth_;
+	if (depth_ == 2 && field_ != Field::kNone) {
+		return on_end_title_text();
+	} else if (depth_ == 1 && in_entry_) {
+		return on_end_entry();
+	}
+	return true;
+}
+
+bool DiaryXMLHandler::on_end_title_text() {
+	Field field = field_;
+	field_ = Field::kNone;
 
+	bool has_content;
+	if (field_children_ == 0) { // Empty
+		has_content = true;
+	} else if (field_first_child_text_) {
+		if (field_children_ != 1) {
+			return error();
 		}
-		else {
-			// Unknown child tag within <entry>
-			return 0;
+		has_content = true;
+	} else {
+		has_content = false;
+	}
+
+	if (field == Field::kTitle) {
+		// <title><tag/></title> is silently taken as if it were absent
+		has_title_ = has_content;
+		if (field_children_ == 0) {
+			title_ = DiaryText();
+		}
+	} else {
+		if (!has_content) {
+			return error();
+		}
+		has_text_ = true;
+		if (field_children_ == 0) {
+			text_ = DiaryText();
 		}
 	}
+	return true;
+}
+
+bool DiaryXMLHandler::on_end_entry() {
+	in_entry_ = false;
 
 	// Almost finished! But are we missing any required tags?
-	if (local_time == 0 || title.data() == nullptr || text.data() == nullptr) {
-		return 0;
+	if (local_time_ == 0 || !has_title_ || !has_text_) {
+		return error();
 	}
 
 	// Finally successful
-	return new DiaryEntry{
-		DateTime(local_time),
-		utf8_to_wstring(title),
-		utf8_to_wstring(text),
-		std::move(labels)
-	};
+	entries_->push_back(pool_->create(
+		DateTime(local_time_),
+		std::move(title_),
+		std::move(text_),
+		std::move(labels_)
+	));
+	return true;
+}
+
+
+std::array<unsigned char, SHA512::DIGEST_LENGTH> format_2018_password_digest(std::string_view password) {
+	SHA512 h;
+	h(password_salt2018a, sizeof(password_salt2018a));
+	h(password);
+	h(password_salt2018b, sizeof(password_salt2018b));
+	return h.result();
 }
 
+// Pieces of data passed between stages of load_pipeline
+constexpr size_t kLoadChunkSize = 256 * 1024;
+constexpr size_t kLoadQueueCapacity = 4;
 
 /**
- * Assuming we have successfully parsed the XML, analyzes the XML and extracts useful info.
- * Applicable for both ~/.tiary and diary files
+ * Decrypts (if password is not empty), decompresses and parses data.
+ *
+ * The three stages run in separate threads (parsing in the caller's),
+ * passing data in pieces through bounded queues.  So they overlap, and
+ * neither the decrypted nor the decompressed data is held as a whole.
  */
-bool general_analyze_xml (const XMLNode *root,
-		OptionGroupBase &opts,
-		DiaryEntryList *entries,
-		RecentFileList *recent_files,
-		bool strictest ///< Should be enabled for data file, and disabled for config files
-		)
-{
-	if (root->type != XMLNodeType::kTree) {
-		return false;
+LoadFileRet load_pipeline(std::string_view data, std::string_view password, DiaryXMLHandler &handler) {
+	BlockingQueue<std::string> compressed(kLoadQueueCapacity);
+	BlockingQueue<std::string> decompressed(kLoadQueueCapacity);
+
+	// Decryption is "stopped" if decompression fails and closes the queue,
+	// which doesn't count as a decryption error
+	bool decrypt_ok = true;
+	bool decrypt_stopped = false;
+	std::thread decrypt_thread;
+	if (!password.empty()) {
+		decrypt_thread = std::thread([&] {
+			decrypt_ok = evp_aes_decrypt(data, password, kLoadChunkSize, [&](std::string &&chunk) {
+				if (!compressed.push(std::move(chunk))) {
+					decrypt_stopped = true;
+					return false;
+				}
+				return true;
+			});
+			compressed.close();
+		});
 	}
-	if (root->name() != "tiary"sv) { // Root node must be <tiary>
-		return false;
+
+	bool bunzip2_ok = true;
+	std::thread bunzip2_thread([&] {
+		Bunzip2Stream bunzip2([&](std::string &&chunk) {
+			return decompressed.push(std::move(chunk));
+		});
+		if (password.empty()) {
+			for (std::string_view rest = data; bunzip2_ok && !rest.empty(); rest.remove_prefix(std::min(rest.size(), kLoadChunkSize))) {
+				bunzip2_ok = bunzip2.feed(rest.substr(0, kLoadChunkSize));
+			}
+		} else {
+			std::string chunk;
+			while (bunzip2_ok && compressed.pop(&chunk)) {
+				bunzip2_ok = bunzip2.feed(chunk);
+			}
+		}
+		bunzip2_ok = bunzip2_ok && bunzip2.finish();
+		// If we stopped early, let the decryption stage stop too
+		compressed.close();
+		decompressed.close();
+	});
+
+	std::string chunk;
+	std::string_view rest;
+	bool xml_ok = xml_scan([&](char *buffer, int len) {
+		if (rest.empty()) {
+			if (!decompressed.pop(&chunk)) {
+				return 0;
+			}
+			rest = chunk;
+		}
+		int n = std::min<size_t>(len, rest.size());
+		memcpy(buffer, rest.data(), n);
+		rest.remove_prefix(n);
+		return n;
+	}, handler);
+	// Corrupt bzip2 data may look like malformed XML before libbz2 finds a
+	// CRC error, so let decompression finish to find out the real cause
+	while (decompressed.pop(&chunk)) {
+	}
+
+	bunzip2_thread.join();
+	if (decrypt_thread.joinable()) {
+		decrypt_thread.join();
 	}
-	if (entries) {
-		entries->clear ();
+
+	// An error in an early stage usually causes errors in later stages,
+	// so check them in order
+	if (!decrypt_ok && !decrypt_stopped) {
+		return LOAD_FILE_DECRYPTION;
 	}
-	if (recent_files) {
-		recent_files->clear ();
+	if (!bunzip2_ok) {
+		return LOAD_FILE_BUNZIP2;
 	}
-	// OK. Now loop thru its children
-	for (const XMLNode *main_child = root->children; main_child; main_child = main_child->next) {
-		if (main_child->type != XMLNodeType::kTree) {
-			// Wild text directly within <tiary> - must be an error
-			// But we choose to be as tolerant as possible in non-strict mode
-			if (strictest) {
-				return false;
-			}
-			else {
-				continue;
-			}
+	if (!xml_ok) {
+		return handler.content_error() ? LOAD_FILE_CONTENT : LOAD_FILE_XML;
+	}
+	return LOAD_FILE_SUCCESS;
+}
+
+// Layout of segmented files. See the comments at the top of this file
+constexpr size_t kSegmentCountOffset = 16 + SHA512::DIGEST_LENGTH;
+constexpr size_t kSegmentTableOffset = kSegmentCountOffset + 4;
+constexpr size_t kSegmentRecordSize = 16 + sizeof(DiaryFileState::Checksum);
+
+struct SegmentRecord {
+	std::string_view ciphertext;
+	uint32_t entry_count;
+	DiaryFileState::Checksum checksum;
+};
+
+/**
+ * The checksum depends on the password, so that it doesn't tell anything
+ * about the plaintext to those who don't know the password
+ */
+DiaryFileState::Checksum xml_checksum(std::string_view xml, std::string_view password) {
+	SHA512 h;
+	h(password_salt2018b, sizeof(password_salt2018b));
+	h(password);
+	h(xml);
+	auto digest = h.result();
+	DiaryFileState::Checksum res;
+	memcpy(res.data(), digest.data(), res.size());
+	return res;
+}
+
+// Decrypts, decompresses, verifies and parses one segment
+LoadFileRet load_segment(const SegmentRecord &record, std::string_view password,
+		OptionGroupBase &options, DiaryEntryList *entries, DiaryEntryPool *pool, LabelDictionary *dictionary) {
+	std::string xml = evp_aes_decrypt(record.ciphertext, password);
+	if (xml.empty()) {
+		return LOAD_FILE_DECRYPTION;
+	}
+	xml = bunzip2(xml);
+	if (xml.empty()) {
+		return LOAD_FILE_BUNZIP2;
+	}
+	if (xml_checksum(xml, password) != record.checksum) {
+		return LOAD_FILE_CHECKSUM;
+	}
+	DiaryXMLHandler handler(options, entries, pool, dictionary, 0, true);
+	if (!xml_scan(xml, handler)) {
+		return handler.content_error() ? LOAD_FILE_CONTENT : LOAD_FILE_XML;
+	}
+	if (entries->size() != record.entry_count) {
+		return LOAD_FILE_CHECKSUM;
+	}
+	return LOAD_FILE_SUCCESS;
+}
+
+/**
+ * Loads a file in the segmented format, whose password has been verified.
+ * Segments are independent of each other, so we process them in parallel
+ */
+LoadFileRet load_segmented(std::string_view everything, std::string_view password,
+		DiaryEntryList &entries, DiaryEntryPool &pool, PerFileOptionGroup &options, DiaryFileState &state) {
+	size_t count = load_le32(everything.data() + kSegmentCountOffset);
+	if (count == 0 || (everything.size() - kSegmentTableOffset) / kSegmentRecordSize < count) {
+		return LOAD_FILE_CHECKSUM;
+	}
+	std::vector<SegmentRecord> records(count);
+	for (size_t i = 0; i < count; ++i) {
+		const char *p = everything.data() + kSegmentTableOffset + i * kSegmentRecordSize;
+		uint64_t offset = load_le64(p);
+		uint32_t size = load_le32(p + 8);
+		if (offset > everything.size() || size > everything.size() - offset) {
+			return LOAD_FILE_CHECKSUM;
 		}
+		records[i].ciphertext = everything.substr(offset, size);
+		records[i].entry_count = load_le32(p + 12);
+		memcpy(records[i].checksum.data(), p + 16, records[i].checksum.size());
+	}
 
-		if (main_child->name() == "option"sv) { // An option
-			auto it_option_name = main_child->properties.find("name");
-			auto it_option_value = main_child->properties.find("value");
-			if (it_option_name != main_child->properties.end() && it_option_value != main_child->properties.end()) {
-				opts.set(it_option_name->second, it_option_value->second);
-			} else if (strictest) {
-				// <option> without "name" or "value" - Disallowed in strict mode
-				return false;
-			}
-		} else if (entries && main_child->name() == "entry"sv) {
+	// Only the first segment has options.  Ignore any option in others
+	options.reset();
+	std::vector<DiaryEntryList> segment_entries(count);
+	std::vector<DiaryEntryPool> segment_pools(count);
+	std::vector<LoadFileRet> rets(count);
+	xml_init();
+	parallel_for(count, [&](size_t i) {
+		if (i == 0) {
+			rets[i] = load_segment(records[i], password, options, &segment_entries[i], &segment_pools[i],
+					&pool.labels());
+		} else {
+			PerFileOptionGroup ignored_options;
+			rets[i] = load_segment(records[i], password, ignored_options, &segment_entries[i], &segment_pools[i],
+					&pool.labels());
+		}
+	});
+	for (DiaryEntryPool &segment_pool: segment_pools) {
+		pool.merge(std::move(segment_pool));
+	}
+
+	LoadFileRet ret = LOAD_FILE_SUCCESS;
+	size_t total_entries = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (ret == LOAD_FILE_SUCCESS) {
+			ret = rets[i];
+		}
+		total_entries += segment_entries[i].size();
+	}
+
+	entries.reserve(total_entries);
+	for (const DiaryEntryList &list: segment_entries) {
+		entries.insert(entries.end(), list.begin(), list.end());
+	}
+	if (ret == LOAD_FILE_SUCCESS) {
+		// Remember the ciphertext, so that unchanged segments are reused on save
+		for (const SegmentRecord &record: records) {
+			state.segments.emplace(record.checksum, record.ciphertext);
+		}
+	}
+	return ret;
+}
 
-			DiaryEntry *entry = analyze_entry_xml (main_child);
-			if (entry == 0) {
+// Digest of the contents of a diary file, to which the journal file applies
+DiaryFileState::Checksum file_digest(std::string_view data, std::string_view data2 = {}) {
+	SHA512 h;
+	h(data);
+	h(data2);
+	auto digest = h.result();
+	DiaryFileState::Checksum res;
+	memcpy(res.data(), digest.data(), res.size());
+	return res;
+}
+
+std::string journal_filename(std::string_view filename) {
+	std::string res(filename);
+	res += ".journal"sv;
+	return res;
+}
+
+constexpr size_t kJournalHeaderSize = 16 + sizeof(DiaryFileState::Checksum);
+constexpr size_t kJournalRecordHeaderSize = 4 + sizeof(DiaryFileState::Checksum);
+
+/**
+ * Parses the changes in one journal record, which are then applied by apply.
+ * Nothing is changed if the record turns out to be invalid halfway.
+ *
+ * Events are forwarded to a DiaryXMLHandler, which parses entries and options
+ * for us
+ */
+class JournalXMLHandler final : public XMLScanHandler {
+public:
+	JournalXMLHandler(const PerFileOptionGroup &opts, size_t entry_count, DiaryEntryPool &pool)
+		: opts_(opts), entry_count_(entry_count), pool_(pool),
+		parser_(opts_, &new_entries_, &pool, &pool.labels(), 0, true) {}
+	~JournalXMLHandler();
+
+	bool on_start(std::string_view name, XMLAttributes attributes) override;
+	bool on_end() override;
+	bool on_text(std::string_view text) override { return parser_.on_text(text); }
+
+	/// Applies the changes.  Must be called only if the scan succeeded
+	void apply(DiaryEntryList &entries, PerFileOptionGroup &opts);
+
+private:
+	enum struct Op : uint8_t { kNone, kInsert, kReplace, kRemove, kSwap, kSort };
+
+	struct Change {
+		Op op;
+		size_t pos;
+		DiaryEntry *entry; ///< New entry of kInsert and kReplace
+	};
+
+	// Returns false if pos is missing or not less than limit
+	static bool get_pos(XMLAttributes attributes, size_t limit, size_t *pos);
+
+private:
+	PerFileOptionGroup opts_; ///< Options after the changes
+	size_t entry_count_; ///< Number of entries after the changes so far
+	DiaryEntryPool &pool_;
+	DiaryEntryList new_entries_;
+	std::vector<Change> changes_;
+	DiaryXMLHandler parser_;
+	unsigned depth_ = 0;
+	Op op_ = Op::kNone;
+	size_t pos_ = 0;
+};
+
+JournalXMLHandler::~JournalXMLHandler() {
+	// Entries of changes not applied
+	for (DiaryEntry *entry: new_entries_) {
+		pool_.destroy(entry);
+	}
+	for (const Change &change: changes_) {
+		if (change.entry) {
+			pool_.destroy(change.entry);
+		}
+	}
+}
+
+bool JournalXMLHandler::get_pos(XMLAttributes attributes, size_t limit, size_t *pos) {
+	const XMLAttribute *attr = xml_find_attribute(attributes, "pos"sv);
+	if (attr == nullptr) {
+		return false;
+	}
+	char *end;
+	*pos = strtoul(attr->value.data(), &end, 10);
+	return (end != attr->value.data() && *end == '\0' && *pos < limit);
+}
+
+bool JournalXMLHandler::on_start(std::string_view name, XMLAttributes attributes) {
+	if (depth_++ == 1) {
+		size_t pos;
+		if (name == "entry"sv) {
+			const XMLAttribute *op = xml_find_attribute(attributes, "op"sv);
+			if (op && op->value == "insert"sv && get_pos(attributes, entry_count_ + 1, &pos_)) {
+				op_ = Op::kInsert;
+			} else if (op && op->value == "replace"sv && get_pos(attributes, entry_count_, &pos_)) {
+				op_ = Op::kReplace;
+			} else {
 				return false;
 			}
-			entries->push_back (entry);
-			
-		} else if (recent_files && main_child->name() == "recent"sv) {
-			auto it_file_name = main_child->properties.find("file");
-			if (it_file_name != main_child->properties.end()) {
-				recent_files->emplace_back();
-				RecentFile &item = recent_files->back();
-				item.filename = utf8_to_wstring(it_file_name->second);
-				auto it_line_number = main_child->properties.find("line");
-				if (it_line_number != main_child->properties.end()) {
-					item.focus_entry = strtoul(it_line_number->second.c_str(), 0, 10);
-				} else {
-					// <option> without "line"
-					if (strictest) {
-						// Disallowed in strict mode
-						return false;
-					}
-					else {
-						// Default to 0 in non-strict mode
-						item.focus_entry = 0;
-					}
-				}
+		} else if (name == "remove"sv) {
+			if (!get_pos(attributes, entry_count_, &pos)) {
+				return false;
 			}
-			else if (strictest) {
-				// <option> without "file" - Disallowed in strict mode
+			changes_.push_back({Op::kRemove, pos, nullptr});
+			--entry_count_;
+		} else if (name == "swap"sv) {
+			if (entry_count_ < 2 || !get_pos(attributes, entry_count_ - 1, &pos)) {
 				return false;
 			}
-		}
-		else {
-			// Ignored for forward compatibility - even in strict mode
+			changes_.push_back({Op::kSwap, pos, nullptr});
+		} else if (name == "sort"sv) {
+			changes_.push_back({Op::kSort, 0, nullptr});
+		} else if (name == "options"sv) {
+			opts_.reset();
 		}
 	}
+	return parser_.on_start(name, attributes);
+}
 
+bool JournalXMLHandler::on_end() {
+	if (!parser_.on_end()) {
+		return false;
+	}
+	if (--depth_ == 1 && op_ != Op::kNone) {
+		// parser_ has just finished an entry
+		changes_.push_back({op_, pos_, new_entries_.back()});
+		new_entries_.pop_back();
+		if (op_ == Op::kInsert) {
+			++entry_count_;
+		}
+		op_ = Op::kNone;
+	}
 	return true;
 }
 
+void JournalXMLHandler::apply(DiaryEntryList &entries, PerFileOptionGroup &opts) {
+	for (const Change &change: changes_) {
+		switch (change.op) {
+		case Op::kInsert:
+			entries.insert(entries.begin() + change.pos, change.entry);
+			break;
+		case Op::kReplace:
+			pool_.destroy(entries[change.pos]);
+			entries[change.pos] = change.entry;
+			break;
+		case Op::kRemove:
+			pool_.destroy(entries[change.pos]);
+			entries.erase(entries.begin() + change.pos);
+			break;
+		case Op::kSwap:
+			std::swap(entries[change.pos], entries[change.pos + 1]);
+			break;
+		case Op::kSort:
+			std::stable_sort(entries.begin(), entries.end(),
+					[](const DiaryEntry *a, const DiaryEntry *b) { return a->local_time < b->local_time; });
+			break;
+		case Op::kNone:
+			break;
+		}
+	}
+	changes_.clear();
+	opts = std::move(opts_);
+}
 
-std::array<unsigned char, SHA512::DIGEST_LENGTH> format_2018_password_digest(std::string_view password) {
-	SHA512 h;
-	h(password_salt2018a, sizeof(password_salt2018a));
-	h(password);
-	h(password_salt2018b, sizeof(password_salt2018b));
-	return h.result();
+/**
+ * Applies the journal file of a diary file, if any.
+ * Returns the size of valid data in the journal file, after which the next
+ * record should be written (overwriting any damaged record)
+ */
+uint64_t replay_journal(const std::string &filename, const DiaryFileState::Checksum &digest, std::string_view password,
+		DiaryEntryList &entries, DiaryEntryPool &pool, PerFileOptionGroup &options) {
+	int fd = open(journal_filename(filename).c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return 0;
+	}
+	MappedFile everything;
+	bool ok = everything.load(fd);
+	close(fd);
+	if (!ok || everything.size() < kJournalHeaderSize ||
+			memcmp(everything.data(), journal_signature, 16) != 0 ||
+			memcmp(everything.data() + 16, digest.data(), digest.size()) != 0) {
+		// Unreadable, or left over from an older diary file
+		return 0;
+	}
+
+	size_t offset = kJournalHeaderSize;
+	while (everything.size() - offset >= kJournalRecordHeaderSize) {
+		const char *p = everything.data() + offset;
+		size_t size = load_le32(p);
+		if (size > everything.size() - offset - kJournalRecordHeaderSize) {
+			break;
+		}
+		std::string_view data(p + kJournalRecordHeaderSize, size);
+		std::string xml;
+		if (!password.empty()) {
+			xml = evp_aes_decrypt(data, password);
+			data = xml;
+		}
+		if (data.empty() || memcmp(xml_checksum(data, password).data(), p + 4, sizeof(DiaryFileState::Checksum)) != 0) {
+			break;
+		}
+		JournalXMLHandler handler(options, entries.size(), pool);
+		if (!xml_scan(data, handler)) {
+			break;
+		}
+		handler.apply(entries, options);
+		offset += kJournalRecordHeaderSize + size;
+	}
+	return offset;
 }
 
 } // Anonymous namespace
 
 LoadFileRet load_global_options (GlobalOptionGroup &options, RecentFileList &recent_files)
 {
-	FILE *fp = fopen (make_home_dirname (GLOBAL_OPTION_FILE).c_str(), "r");
-	if (fp == 0) {
+	int fd = open(make_home_dirname(GLOBAL_OPTION_FILE).c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
 		return LOAD_FILE_NOT_FOUND;
 	}
-	XMLNode *root;
-	{
-		std::string data;
-		bool ret = read_whole_file(fp, &data, 128 * 1024);
-		fclose (fp);
-		if (!ret) {
-			return LOAD_FILE_READ_ERROR;
-		}
-		root = xml_parse(data);
-	}
-	if (root == 0) {
-		return LOAD_FILE_XML;
-	}
-	bool ret = general_analyze_xml (root, options, 0, &recent_files, false);
-	xml_free (root);
+	MappedFile data;
+	bool ret = data.load(fd);
+	close(fd);
 	if (!ret) {
-		return LOAD_FILE_CONTENT;
+		return LOAD_FILE_READ_ERROR;
+	}
+	DiaryXMLHandler handler(options, 0, 0, 0, &recent_files, false);
+	if (!xml_scan(data.view(), handler)) {
+		return handler.content_error() ? LOAD_FILE_CONTENT : LOAD_FILE_XML;
 	}
 	return LOAD_FILE_SUCCESS;
 }
@@ -363,120 +943,423 @@ LoadFileRet load_file (
 		const char *filename,
 		const std::function<std::string()> &enter_password,
 		DiaryEntryList &entries,
+		DiaryEntryPool &pool,
 		PerFileOptionGroup &options,
-		std::string &password)
+		std::string &password,
+		DiaryFileState &state)
 {
-	FILE *fp = fopen (filename, "rb");
-	if (fp == 0) {
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
 		return LOAD_FILE_NOT_FOUND;
 	}
 
-	std::string everything;
-
-	// Read everything out of file
-	bool bool_ret = read_whole_file(fp, &everything);
-	fclose (fp);
+	// Map (or read) everything out of file.  The decryption and decompression
+	// stages work directly on the mapped data
+	MappedFile everything;
+	bool bool_ret = everything.load(fd);
+	close(fd);
 	if (!bool_ret) {
 		return LOAD_FILE_READ_ERROR;
 	}
 
 	password.clear ();
+	state = DiaryFileState();
+
+	std::string_view data = everything;
 
 	// Encrypted?
-	if (everything.size() >= 32 && !memcmp(&everything[0], new_format_signature_2009, 16)) {
+	bool encrypted_2018 = everything.size() >= 16 + SHA512::DIGEST_LENGTH &&
+		!memcmp(everything.data(), new_format_signature_2018, 16);
+	bool segmented = everything.size() >= kSegmentTableOffset &&
+		!memcmp(everything.data(), new_format_signature_2024, 16);
+	if (everything.size() >= 32 && !memcmp(everything.data(), new_format_signature_2009, 16)) {
 		// Obsolete encryption format (insecure, prior to 2018)
 		return LOAD_FILE_OBSOLETE;
-	} else if (everything.size() >= 16 + SHA512::DIGEST_LENGTH && !memcmp(&everything[0], new_format_signature_2018, 16)) {
+	} else if (encrypted_2018 || segmented) {
 		// Second 64 bytes: SHA(salt_2018a + password + salt_2018b)
 		password = enter_password();
 		if (password.empty ()) { // User cancelation
 			return LOAD_FILE_PASSWORD;
 		}
 
-		if (memcmp(format_2018_password_digest(password).data(), &everything[16], SHA512::DIGEST_LENGTH) != 0) { // Password incorrect
+		if (memcmp(format_2018_password_digest(password).data(), everything.data() + 16, SHA512::DIGEST_LENGTH) != 0) { // Password incorrect
 			password.clear ();
 			return LOAD_FILE_PASSWORD;
 		}
 
-		// Password correct. Decrypt now
-		everything = evp_aes_decrypt({&everything[16 + SHA512::DIGEST_LENGTH], everything.size() - 16 - SHA512::DIGEST_LENGTH}, password);
-		if (everything.empty()) {
-			return LOAD_FILE_DECRYPTION;
-		}
-		// Decompress
-		everything = bunzip2(everything);
-	} else {
-		// Not encrypted
-		everything = bunzip2 (&everything[0], everything.size ());
-		if (everything.empty ()) {
-			return LOAD_FILE_BUNZIP2;
-		}
+		// Password correct. The rest is ciphertext
+		data.remove_prefix(16 + SHA512::DIGEST_LENGTH);
+		state.format = segmented ? DiaryFileFormat::kSegmented : DiaryFileFormat::kEncrypted2018;
 	}
 
-	// Parse XML
-	XMLNode *root = xml_parse(everything.data(), everything.size());
-	if (root == 0) {
-		return LOAD_FILE_XML;
+	LoadFileRet ret;
+	if (segmented) {
+		ret = load_segmented(everything, password, entries, pool, options, state);
+	} else {
+		// Decrypt, decompress and parse XML
+		options.reset ();
+		DiaryXMLHandler handler(options, &entries, &pool, &pool.labels(), 0, true);
+		ret = load_pipeline(data, password, handler);
 	}
-	options.reset ();
-	bool_ret = general_analyze_xml (root, options, &entries, 0, true);
-	xml_free (root);
-	if (!bool_ret) {
-		return LOAD_FILE_CONTENT;
+	if (ret != LOAD_FILE_SUCCESS) {
+		// Don't return half-loaded entries
+		pool.clear(&entries);
+		state = DiaryFileState();
+		return ret;
 	}
+
+	// Apply changes saved in the journal file since the diary file was written
+	state.password = password;
+	state.filename = filename;
+	state.file_digest = file_digest(everything);
+	state.file_size = everything.size();
+	state.journal_size = replay_journal(state.filename, state.file_digest, password, entries, pool, options);
+	state.journal.reset(entries.size());
 	return LOAD_FILE_SUCCESS;
 }
 
-
 namespace {
 
-XMLNode *make_xml_tree_from_options(const OptionGroupBase &opts, const OptionGroupBase &default_options) {
-	XMLNode *root = new XMLNode(XMLNode::TreeTag(), "tiary");
-	root->children = nullptr;
-	XMLNode **tail = &root->children;
+// Entries are serialized in parallel in chunks of this size
+constexpr size_t kEntriesPerChunk = 512;
 
+// Writes the options different from default
+void write_options(XMLWriter &writer, const OptionGroupBase &opts, const OptionGroupBase &default_options) {
 	for (const auto &opt_pair: opts) {
 		// If the option is the same as default, do not save it
-
 		if (default_options.get(opt_pair.first) == opt_pair.second) {
 			continue;
 		}
+		writer.empty("option"sv, {{"name"sv, opt_pair.first}, {"value"sv, opt_pair.second}});
+	}
+}
+
+// Writes an <entry> tag
+void write_entry(XMLWriter &writer, const DiaryEntry &entry, std::initializer_list<XMLAttribute> attributes = {}) {
+	writer.start("entry"sv, attributes);
+	writer.empty("time"sv, {{"local"sv, format_time(entry.local_time)}});
+	for (const DiaryLabel *label: entry.labels.sorted()) {
+		writer.empty("label"sv, {{"name"sv, label->utf8}});
+	}
+	writer.text_element("title"sv, entry.title.utf8());
+	writer.text_element("text"sv, entry.text.utf8());
+	writer.end("entry"sv);
+}
 
-		XMLNode *newnode = new XMLNode(XMLNode::TreeTag(), "option");
-		*tail = newnode;
-		tail = &newnode->next;
-		newnode->properties.emplace("name", opt_pair.first);
-		newnode->properties.emplace("value", opt_pair.second);
+// Writes <entry> tags as children of <tiary>
+// If entry_ends is not null, the end offset of each entry in *out is appended to it
+void write_entries(std::string *out, std::span<DiaryEntry *const> entries, std::vector<size_t> *entry_ends = nullptr) {
+	// A good guess in most cases. Non-ASCII characters need more space
+	size_t estimated_size = 0;
+	for (const DiaryEntry *entry: entries) {
+		estimated_size += 128 + entry->title.utf8().size() + entry->text.utf8().size() + 32 * entry->labels.size();
 	}
+	out->reserve(out->size() + estimated_size);
 
-	return root;
+	XMLWriter writer(out, 1);
+	for (const DiaryEntry *entry: entries) {
+		write_entry(writer, *entry);
+		if (entry_ends) {
+			entry_ends->push_back(out->size());
+		}
+	}
 }
 
-} // anonymous namespace
+// Serializes entries in parallel in chunks of kEntriesPerChunk
+std::vector<std::string> write_entry_chunks(const DiaryEntryList &entries, std::vector<std::vector<size_t>> *entry_ends = nullptr) {
+	std::vector<std::string> chunks((entries.size() + kEntriesPerChunk - 1) / kEntriesPerChunk);
+	if (entry_ends) {
+		entry_ends->resize(chunks.size());
+	}
+	parallel_for(chunks.size(), [&](size_t i) {
+		size_t offset = i * kEntriesPerChunk;
+		write_entries(&chunks[i], std::span(entries).subspan(offset, std::min(kEntriesPerChunk, entries.size() - offset)),
+				entry_ends ? &(*entry_ends)[i] : nullptr);
+	});
+	return chunks;
+}
 
+// Segment boundaries are chosen by the contents of entries (like what rsync
+// does to blocks), so that inserting or removing entries only changes the
+// segments around them, and other segments can be reused
+constexpr size_t kMinSegmentSize = 32 * 1024;
+constexpr size_t kMaxSegmentSize = 512 * 1024;
+constexpr uint64_t kSegmentBoundaryMask = 63;
+
+uint64_t fnv1a(std::string_view s) {
+	uint64_t h = 0xcbf29ce484222325ull;
+	for (char c: s) {
+		h = (h ^ uint8_t(c)) * 0x100000001b3ull;
+	}
+	return h;
+}
 
-bool save_global_options (const GlobalOptionGroup &options, const RecentFileList &recent_files)
-{
-	// First create the XML tree
-	XMLNode *root = make_xml_tree_from_options (options, GlobalOptionGroup ());
+struct Segment {
+	std::string xml;
+	uint32_t entry_count = 0;
+	DiaryFileState::Checksum checksum;
+	std::string ciphertext;
+};
 
-	// Find the last child of root node <tiary>
-	XMLNode **tail = &root->children;
-	while (*tail) {
-		tail = &(*tail)->next;
+// Groups entries into segments.  The first segment has only the options
+std::vector<Segment> make_segments(const DiaryEntryList &entries, const PerFileOptionGroup &options) {
+	std::vector<Segment> segments(1);
+	{
+		XMLWriter writer(&segments[0].xml);
+		writer.declaration();
+		writer.start("tiary"sv);
+		write_options(writer, options, PerFileOptionGroup());
+		writer.end("tiary"sv);
 	}
 
-	// Loop thru recent files
-	for (const auto &rf: recent_files) {
-		XMLNode *recent_node = new XMLNode(XMLNode::TreeTag(), "recent");
-		*tail = recent_node;
-		tail = &recent_node->next;
-		recent_node->properties.emplace("file", wstring_to_utf8(rf.filename));
-		recent_node->properties.emplace("line", format_dec_narrow(rf.focus_entry));
+	std::vector<std::vector<size_t>> entry_ends;
+	std::vector<std::string> chunks = write_entry_chunks(entries, &entry_ends);
+
+	std::optional<XMLWriter> writer;
+	size_t segment_size = 0;
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		std::string_view chunk = chunks[i];
+		size_t begin = 0;
+		for (size_t end: entry_ends[i]) {
+			std::string_view entry_xml = chunk.substr(begin, end - begin);
+			begin = end;
+			if (!writer) {
+				segments.emplace_back();
+				writer.emplace(&segments.back().xml);
+				writer->declaration();
+				writer->start("tiary"sv);
+				segment_size = 0;
+			}
+			writer->fragment(entry_xml);
+			++segments.back().entry_count;
+			segment_size += entry_xml.size();
+			if (segment_size >= kMaxSegmentSize ||
+					(segment_size >= kMinSegmentSize && (fnv1a(entry_xml) & kSegmentBoundaryMask) == 0)) {
+				writer->end("tiary"sv);
+				writer.reset();
+			}
+		}
+		std::string().swap(chunks[i]);
+	}
+	if (writer) {
+		writer->end("tiary"sv);
 	}
+	return segments;
+}
 
-	std::string xml = xml_make (root);
-	xml_free (root);
+/**
+ * Writes a complete diary file, and updates state accordingly.
+ * The old journal file no longer applies, so remove it.  (Even if we fail
+ * to, it will be ignored, since the digest doesn't match.)
+ */
+bool write_diary_file(const char *filename, std::string_view data, std::string_view data2,
+		DiaryFileFormat format, std::string_view password, size_t entry_count, DiaryFileState &state) {
+	if (!safe_write_file(filename, data, data2)) {
+		return false;
+	}
+	unlink(journal_filename(filename).c_str());
+	state.format = format;
+	state.password = password;
+	state.filename = filename;
+	state.file_digest = file_digest(data, data2);
+	state.file_size = data.size() + data2.size();
+	state.journal_size = 0;
+	state.journal.reset(entry_count);
+	return true;
+}
+
+/**
+ * Saves in the segmented format.  Segments whose ciphertext is found in
+ * state are not compressed or encrypted again
+ */
+bool save_segmented(const char *filename, const DiaryEntryList &entries, const PerFileOptionGroup &options,
+		std::string_view password, DiaryFileState &state) {
+	if (state.password != password) {
+		state.segments.clear();
+	}
+
+	std::vector<Segment> segments = make_segments(entries, options);
+	std::atomic<bool> ok = true;
+	parallel_for(segments.size(), [&](size_t i) {
+		Segment &segment = segments[i];
+		segment.checksum = xml_checksum(segment.xml, password);
+		auto it = state.segments.find(segment.checksum);
+		if (it != state.segments.end()) {
+			segment.ciphertext = it->second;
+		} else {
+			segment.ciphertext = evp_aes_encrypt(bzip2(segment.xml, true), password);
+			if (segment.ciphertext.empty()) {
+				ok = false;
+			}
+		}
+		std::string().swap(segment.xml);
+	});
+	if (!ok) {
+		return false;
+	}
+
+	std::string everything;
+	size_t offset = kSegmentTableOffset + segments.size() * kSegmentRecordSize;
+	size_t total_size = offset;
+	for (const Segment &segment: segments) {
+		total_size += segment.ciphertext.size();
+	}
+	everything.reserve(total_size);
+	everything.append(new_format_signature_2024, 16);
+	auto digest = format_2018_password_digest(password);
+	everything.append(reinterpret_cast<const char *>(digest.data()), digest.size());
+	append_le32(&everything, segments.size());
+	for (const Segment &segment: segments) {
+		append_le64(&everything, offset);
+		append_le32(&everything, segment.ciphertext.size());
+		append_le32(&everything, segment.entry_count);
+		everything.append(reinterpret_cast<const char *>(segment.checksum.data()), segment.checksum.size());
+		offset += segment.ciphertext.size();
+	}
+	for (const Segment &segment: segments) {
+		everything += segment.ciphertext;
+	}
+
+	if (!write_diary_file(filename, everything, {}, DiaryFileFormat::kSegmented, password, entries.size(), state)) {
+		return false;
+	}
+
+	state.segments.clear();
+	for (Segment &segment: segments) {
+		state.segments.emplace(segment.checksum, std::move(segment.ciphertext));
+	}
+	return true;
+}
+
+// The journal file is merged into the diary file when it grows larger than
+// this, or 1/8 the size of the diary file, whichever is larger
+constexpr uint64_t kMinJournalCompactionSize = 256 * 1024;
+
+// Whether we can save by appending the changes to the journal file
+bool can_append_journal(const char *filename, const DiaryEntryList &entries, DiaryFileFormat format,
+		std::string_view password, const DiaryFileState &state) {
+	return (format == DiaryFileFormat::kSegmented &&
+			!state.filename.empty() && state.filename == filename &&
+			state.format == format && state.password == password &&
+			!state.journal.compaction_requested() &&
+			// This should always be true.  But in case we missed any change,
+			// rewriting the diary file is always the safe choice
+			state.journal.entry_count() == entries.size() &&
+			state.journal_size + state.journal.records().size() <
+				std::max(kMinJournalCompactionSize, state.file_size / 8));
+}
+
+bool append_journal(const char *filename, std::string_view password, DiaryFileState &state) {
+	if (state.journal.records().empty()) {
+		return true;
+	}
+
+	std::string xml;
+	XMLWriter writer(&xml);
+	writer.declaration();
+	writer.start("tiary"sv);
+	writer.fragment(state.journal.records());
+	writer.end("tiary"sv);
+
+	std::string data;
+	if (!password.empty()) {
+		data = evp_aes_encrypt(xml, password);
+		if (data.empty()) {
+			return false;
+		}
+	}
+	std::string_view payload = password.empty() ? std::string_view(xml) : std::string_view(data);
+
+	std::string record;
+	record.reserve(kJournalHeaderSize + kJournalRecordHeaderSize + payload.size());
+	if (state.journal_size == 0) {
+		record.append(journal_signature, 16);
+		record.append(reinterpret_cast<const char *>(state.file_digest.data()), state.file_digest.size());
+	}
+	append_le32(&record, payload.size());
+	auto checksum = xml_checksum(xml, password);
+	record.append(reinterpret_cast<const char *>(checksum.data()), checksum.size());
+	record += payload;
+
+	if (!write_file_at(journal_filename(filename).c_str(), state.journal_size, record)) {
+		return false;
+	}
+	state.journal_size += record.size();
+	state.journal.reset(state.journal.entry_count());
+	return true;
+}
+
+} // anonymous namespace
+
+
+void DiaryJournal::insert(size_t pos, const DiaryEntry &entry) {
+	XMLWriter writer(&records_, 1);
+	write_entry(writer, entry, {{"op"sv, "insert"sv}, {"pos"sv, format_dec_narrow(pos)}});
+	++entry_count_;
+}
+
+void DiaryJournal::replace(size_t pos, const DiaryEntry &entry) {
+	XMLWriter writer(&records_, 1);
+	write_entry(writer, entry, {{"op"sv, "replace"sv}, {"pos"sv, format_dec_narrow(pos)}});
+}
+
+void DiaryJournal::remove(size_t pos) {
+	XMLWriter writer(&records_, 1);
+	writer.empty("remove"sv, {{"pos"sv, format_dec_narrow(pos)}});
+	--entry_count_;
+}
+
+void DiaryJournal::swap(size_t pos) {
+	XMLWriter writer(&records_, 1);
+	writer.empty("swap"sv, {{"pos"sv, format_dec_narrow(pos)}});
+}
+
+void DiaryJournal::sort() {
+	XMLWriter writer(&records_, 1);
+	writer.empty("sort"sv, {});
+}
+
+void DiaryJournal::set_options(const PerFileOptionGroup &options) {
+	XMLWriter writer(&records_, 1);
+	writer.empty("options"sv, {});
+	write_options(writer, options, PerFileOptionGroup());
+}
+
+void DiaryJournal::reset(size_t entry_count) {
+	std::string().swap(records_);
+	entry_count_ = entry_count;
+	compaction_requested_ = false;
+}
+
+DiaryJournal DiaryJournal::take() {
+	DiaryJournal res;
+	res.records_.swap(records_);
+	res.entry_count_ = entry_count_;
+	res.compaction_requested_ = compaction_requested_;
+	compaction_requested_ = false;
+	return res;
+}
+
+void DiaryJournal::restore(DiaryJournal &&earlier) {
+	earlier.records_ += records_;
+	records_.swap(earlier.records_);
+	compaction_requested_ |= earlier.compaction_requested_;
+}
+
+
+bool save_global_options (const GlobalOptionGroup &options, const RecentFileList &recent_files)
+{
+	std::string xml;
+	XMLWriter writer(&xml);
+	writer.declaration();
+	writer.start("tiary"sv);
+	write_options(writer, options, GlobalOptionGroup());
+	for (const auto &rf: recent_files) {
+		writer.empty("recent"sv, {
+				{"file"sv, wstring_to_utf8(rf.filename)},
+				{"line"sv, format_dec_narrow(rf.focus_entry)}});
+	}
+	writer.end("tiary"sv);
 
 	// Now write to file
 	return safe_write_file(make_home_dirname(GLOBAL_OPTION_FILE).c_str(), xml);
@@ -485,52 +1368,47 @@ bool save_global_options (const GlobalOptionGroup &options, const RecentFileList
 bool save_file (const char *filename,
 		const DiaryEntryList &entries,
 		const PerFileOptionGroup &options,
-		std::string_view password) {
-	// First create the XML tree
-	XMLNode *root = make_xml_tree_from_options(options, PerFileOptionGroup());
-
-	// Find the last child of root node <tiary>
-	XMLNode **tail = &root->children;
-	while (*tail) {
-		tail = &(*tail)->next;
+		std::string_view password,
+		DiaryFileState &state) {
+	// Files in the 2018 format are kept in that format, until the user
+	// chooses to upgrade them
+	DiaryFileFormat format = password.empty() ? DiaryFileFormat::kBzip2 :
+		state.format == DiaryFileFormat::kEncrypted2018 ? DiaryFileFormat::kEncrypted2018 :
+		DiaryFileFormat::kSegmented;
+
+	if (can_append_journal(filename, entries, format, password, state)) {
+		return append_journal(filename, password, state);
 	}
 
-	// Loop thru entries
-	for (DiaryEntry *entry: entries) {
-		XMLNode *entry_node = new XMLNode(XMLNode::TreeTag(), "entry");
-		*tail = entry_node;
-		tail = &entry_node->next;
-
-		// <time local="..." />
-		XMLNode *time_node = new XMLNode(XMLNode::TreeTag(), "time");
-		XMLNode *sub_ptr = entry_node->children = time_node;
-		time_node->properties.emplace("local", format_time(entry->local_time));
-
-		// Labels
-		for (const std::wstring &label: entry->labels) {
-			XMLNode *label_node = new XMLNode(XMLNode::TreeTag(), "label");
-			sub_ptr = sub_ptr->next = label_node;
-			// Convert from UCS-4 to UTF-8
-			label_node->properties.emplace("name", wstring_to_utf8(label));
-		}
-
-		// Text
-		XMLNode *title_tag_node = new XMLNode(XMLNode::TreeTag(), "title");
-		sub_ptr = sub_ptr->next = title_tag_node;
-		XMLNode *diary_title_node = new XMLNode(XMLNode::TextTag(), wstring_to_utf8 (entry->title));
-		title_tag_node->children = diary_title_node;
+	if (format == DiaryFileFormat::kSegmented) {
+		return save_segmented(filename, entries, options, password, state);
+	}
 
-		// Text
-		XMLNode *text_tag_node = new XMLNode(XMLNode::TreeTag(), "text");
-		sub_ptr = sub_ptr->next = text_tag_node;
-		XMLNode *diary_text_node = new XMLNode(XMLNode::TextTag(), wstring_to_utf8 (entry->text));
-		text_tag_node->children = diary_text_node;
+	std::string xml;
+	XMLWriter writer(&xml);
+	writer.declaration();
+	writer.start("tiary"sv);
+	write_options(writer, options, PerFileOptionGroup());
+
+	// Entries are independent of each other. Serialize them in parallel
+	std::vector<std::string> chunks = write_entry_chunks(entries);
+	size_t total_size = xml.size() + 16;
+	for (const std::string &chunk: chunks) {
+		total_size += chunk.size();
+	}
+	xml.reserve(total_size);
+	for (std::string &chunk: chunks) {
+		writer.fragment(chunk);
+		std::string().swap(chunk);
 	}
+	writer.end("tiary"sv);
 
-	// Finished building the XML tree. Now make the XML text
 	// Make the data to everything that will finally be written to file
-	std::string everything = bzip2(xml_make(root));
-	xml_free (root);
+	// Older versions can read these formats, so don't split it into streams
+	std::string everything = bzip2_single_stream(xml);
+	std::string().swap(xml);
+
+	state.segments.clear();
 
 	// Is there a password?
 	if (!password.empty ()) {
@@ -543,13 +1421,12 @@ bool save_file (const char *filename,
 		memcpy(header + 16, format_2018_password_digest(password).data(), SHA512::DIGEST_LENGTH);
 
 		// Write to file
-		return safe_write_file(filename, {header, sizeof(header)}, everything);
+		return write_diary_file(filename, {header, sizeof(header)}, everything, format, password, entries.size(), state);
 	}
 	else {
 		// Write to file
-		return safe_write_file(filename, everything);
+		return write_diary_file(filename, everything, {}, format, password, entries.size(), state);
 	}
 }
 
-
 } // namespace tiary
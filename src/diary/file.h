@@ -16,7 +16,10 @@
 #define TIARY_DIARY_FILE_H
 
 #include "diary/config.h"
+#include <stdint.h>
+#include <array>
 #include <functional>
+#include <map>
 #include <string>
 #include <vector>
 #include <list>
@@ -24,6 +27,7 @@
 namespace tiary {
 
 struct DiaryEntry; // Defined in diary.h
+class DiaryEntryPool; // Defined in diary.h
 struct RecentFile; // Defined in diary.h
 
 enum LoadFileRet {
@@ -37,8 +41,86 @@ enum LoadFileRet {
 	, LOAD_FILE_BUNZIP2    // Decompression error
 	, LOAD_FILE_XML        // XML parsing error
 	, LOAD_FILE_CONTENT    // XML content error
+	, LOAD_FILE_CHECKSUM   // Checksum mismatch
 };
 
+enum struct DiaryFileFormat : uint8_t {
+	kBzip2,          ///< Unencrypted. Compressed XML
+	kEncrypted2018,  ///< Compressed XML, encrypted as a whole
+	kSegmented,      ///< Groups of entries compressed and encrypted separately
+};
+
+/**
+ * @brief	Changes made to entries and options since the diary file was
+ * last loaded or saved
+ *
+ * Every change must be reported here, so that a save only needs to append
+ * them to the journal file next to the diary file, instead of rewriting
+ * the whole diary file.  Positions are indexes in the complete entry list
+ * at the time of the change.
+ */
+class DiaryJournal {
+public:
+	void insert(size_t pos, const DiaryEntry &);
+	void replace(size_t pos, const DiaryEntry &);
+	void remove(size_t pos);
+	void swap(size_t pos); ///< Swaps the entries at pos and pos + 1
+	void sort(); ///< Stable sorts all entries by time
+	void set_options(const PerFileOptionGroup &);
+
+	/// Makes the next save rewrite the diary file, and discard the journal file
+	void request_compaction() { compaction_requested_ = true; }
+	bool compaction_requested() const { return compaction_requested_; }
+
+	/// XML text of the changes (children of <tiary>)
+	const std::string &records() const { return records_; }
+	/// Number of entries there should be after the changes
+	size_t entry_count() const { return entry_count_; }
+
+	/// Forgets all changes, after a load or save
+	void reset(size_t entry_count);
+
+	/// Moves the changes recorded so far to the returned object (e.g., to
+	/// save them in background), so that this one only records later changes
+	DiaryJournal take();
+	/// Puts back the changes taken by take() (e.g., if the save failed)
+	void restore(DiaryJournal &&earlier);
+
+private:
+	std::string records_;
+	size_t entry_count_ = 0;
+	bool compaction_requested_ = false;
+};
+
+/**
+ * @brief	What we remember about a diary file between loads and saves
+ */
+struct DiaryFileState {
+	/**
+	 * Format of the file as last loaded or saved.
+	 *
+	 * Encrypted files are saved in the segmented format, except that files
+	 * in kEncrypted2018 are kept in that format, which older versions can
+	 * read, until the user explicitly upgrades them.
+	 */
+	DiaryFileFormat format = DiaryFileFormat::kBzip2;
+
+	/**
+	 * Encrypted segments of the segmented file last loaded or saved, keyed by
+	 * the checksum of their XML, so that we don't have to compress and
+	 * encrypt unchanged segments again
+	 */
+	using Checksum = std::array<unsigned char, 32>;
+	std::map<Checksum, std::string> segments;
+	std::string password; ///< Password the segments and journal are encrypted with
+
+	std::string filename; ///< File last loaded or saved. Empty = none
+	Checksum file_digest{}; ///< Digest of its contents, to which the journal file applies
+	uint64_t file_size = 0;
+	uint64_t journal_size = 0; ///< Size of valid data in the journal file. 0 = no journal file
+
+	DiaryJournal journal;
+};
 
 // Read global options from ~/.tiary
 LoadFileRet load_global_options(GlobalOptionGroup &, std::vector<RecentFile> &);
@@ -59,15 +141,26 @@ LoadFileRet load_file (
 		const char *filename, ///< Filename
 		const std::function<std::string()> &foo, ///< A callback function that asks the user for password
 		std::vector <DiaryEntry *> &entries,
+		DiaryEntryPool &, ///< Where entries are allocated
 		PerFileOptionGroup &,
-		std::string &password ///< Empty = no password
+		std::string &password, ///< Empty = no password
+		DiaryFileState &
 		);
 
 
 
 bool save_global_options(const GlobalOptionGroup &, const std::vector<RecentFile> &);
 
-bool save_file(const char *filename, const std::vector<DiaryEntry *> &entries, const PerFileOptionGroup &, std::string_view password);
+/**
+ * @brief	Save tiary file
+ *
+ * If possible, only the changes recorded in state.journal are appended to
+ * the journal file (segmented format only).  Otherwise the whole file is
+ * rewritten.
+ * state is updated if successful
+ */
+bool save_file(const char *filename, const std::vector<DiaryEntry *> &entries, const PerFileOptionGroup &, std::string_view password,
+		DiaryFileState &state);
 
 
 } // namespace tiary
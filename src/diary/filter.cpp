@@ -14,18 +14,83 @@
 
 #include "diary/filter.h"
 #include "diary/diary.h"
+#include "diary/entry_table.h"
+#include "diary/label_index.h"
+#include "diary/text_index.h"
 #include "common/algorithm.h"
+#include "common/parallel.h"
 #include "common/string.h"
+#include <algorithm>
+#include <iterator>
 
 
 namespace tiary {
 
-DiaryEntryList Filter::filter (const DiaryEntryList &lst) const
+namespace {
+
+// Shorter lists are checked in the calling thread
+constexpr size_t kParallelMinEntries = 4096;
+// Number of entries a thread checks at a time
+constexpr size_t kParallelChunkSize = 1024;
+
+// Entries in lst passing the filter, in the same order
+DiaryEntryList check_all(const Filter &filter, const DiaryEntryList &lst) {
+	DiaryEntryList res;
+	if (lst.size() < kParallelMinEntries) {
+		for (DiaryEntry *entry: lst) {
+			if (filter(*entry)) {
+				res.push_back(entry);
+			}
+		}
+		return res;
+	}
+
+	std::vector<char> passed(lst.size());
+	parallel_for((lst.size() + kParallelChunkSize - 1) / kParallelChunkSize, [&](size_t chunk) {
+		size_t end = std::min(lst.size(), (chunk + 1) * kParallelChunkSize);
+		for (size_t i = chunk * kParallelChunkSize; i < end; ++i) {
+			passed[i] = filter(*lst[i]);
+		}
+	});
+	for (size_t i = 0; i < lst.size(); ++i) {
+		if (passed[i]) {
+			res.push_back(lst[i]);
+		}
+	}
+	return res;
+}
+
+} // anonymous namespace
+
+DiaryEntryList Filter::filter (const DiaryEntryList &lst, const FilterIndex &index) const
 {
 	DiaryEntryList new_lst;
-	for (DiaryEntry *entry: lst) {
-		if ((*this)(*entry)) {
-			new_lst.push_back(entry);
+	std::optional<DiaryEntryList> maybe = candidates(index);
+	// If most entries are candidates anyway, checking them all in order is faster
+	if (!maybe || maybe->size() > lst.size() / 4) {
+		return check_all(*this, lst);
+	}
+
+	// Only check the candidates, and then put those passing in list order
+	DiaryEntryList passed = check_all(*this, *maybe);
+	if (index.table) {
+		// Positions in the list are known. No need to look at the whole list
+		const EntryTable &table = *index.table;
+		if (index.time_ordered) {
+			std::sort(passed.begin(), passed.end(), [&](const DiaryEntry *a, const DiaryEntry *b) {
+						return table.time_rank(a) < table.time_rank(b);
+					});
+		} else {
+			std::sort(passed.begin(), passed.end(), [&](const DiaryEntry *a, const DiaryEntry *b) {
+						return table.find(a) < table.find(b);
+					});
+		}
+		new_lst = std::move(passed);
+	} else if (!passed.empty()) {
+		for (DiaryEntry *entry: lst) {
+			if (std::binary_search(passed.begin(), passed.end(), entry)) {
+				new_lst.push_back(entry);
+			}
 		}
 	}
 	return new_lst;
@@ -40,12 +105,45 @@ FilterByLabel::FilterByLabel(std::wstring_view label) {
 bool FilterByLabel::operator () (const DiaryEntry &entry) const
 {
 	for (auto& label: labels_) {
-		if (entry.labels.find(label) == entry.labels.end())
+		if (std::none_of(entry.labels.begin(), entry.labels.end(),
+					[&](const DiaryLabel *l) { return l->name == label; }))
 			return false;
 	}
 	return true;
 }
 
+std::optional<DiaryEntryList> FilterByLabel::candidates(const FilterIndex &index) const {
+	if (index.labels == nullptr) {
+		return std::nullopt;
+	}
+	const DiaryEntryList *shortest = nullptr;
+	std::vector<const DiaryEntryList *> lists;
+	for (auto &label: labels_) {
+		const DiaryEntryList &list = index.labels->entries(index.labels->find(label));
+		if (list.empty()) {
+			return DiaryEntryList();
+		}
+		if (shortest == nullptr || list.size() < shortest->size()) {
+			shortest = &list;
+		}
+		lists.push_back(&list);
+	}
+	if (shortest == nullptr) {
+		return std::nullopt;
+	}
+	// Intersect, starting from the shortest list
+	DiaryEntryList res = *shortest;
+	for (const DiaryEntryList *list: lists) {
+		if (list != shortest) {
+			DiaryEntryList tmp;
+			std::set_intersection(res.begin(), res.end(), list->begin(), list->end(),
+					std::back_inserter(tmp));
+			res = std::move(tmp);
+		}
+	}
+	return res;
+}
+
 std::wstring FilterByLabel::label() const {
 	std::wstring res;
 	for (auto& label: labels_) {
@@ -56,9 +154,36 @@ std::wstring FilterByLabel::label() const {
 	return res;
 }
 
+namespace {
+
+std::optional<DiaryEntryList> text_candidates(const StringMatch &matcher, const FilterIndex &index) {
+	if (index.text == nullptr || index.table == nullptr || matcher.get_use_regex()) {
+		return std::nullopt;
+	}
+	std::optional<std::vector<unsigned>> ids = index.text->candidates(matcher.get_pattern());
+	if (!ids) {
+		return std::nullopt;
+	}
+	DiaryEntryList res;
+	res.reserve(ids->size());
+	for (unsigned id: *ids) {
+		if (DiaryEntry *entry = index.table->by_id(id)) {
+			res.push_back(entry);
+		}
+	}
+	std::sort(res.begin(), res.end());
+	return res;
+}
+
+} // anonymous namespace
+
 bool FilterByText::operator () (const DiaryEntry &entry) const
 {
-	return matcher_.basic_match(entry.title) || matcher_.basic_match(entry.text);
+	return matcher_.basic_match_utf8(entry.title.utf8()) || matcher_.basic_match_utf8(entry.text.utf8());
+}
+
+std::optional<DiaryEntryList> FilterByText::candidates(const FilterIndex &index) const {
+	return text_candidates(matcher_, index);
 }
 
 FilterByText::~FilterByText ()
@@ -69,16 +194,88 @@ FilterByText::~FilterByText ()
 
 bool FilterByTitle::operator () (const DiaryEntry &entry) const
 {
-	return matcher_.basic_match(entry.title);
+	return matcher_.basic_match_utf8(entry.title.utf8());
+}
+
+std::optional<DiaryEntryList> FilterByTitle::candidates(const FilterIndex &index) const {
+	// Entries whose text contains the pattern are candidates, too.
+	// It's still much better than checking all entries
+	return text_candidates(matcher_, index);
 }
 
 FilterByTitle::~FilterByTitle ()
 {
 }
 
+bool FilterByDateRange::operator () (const DiaryEntry &entry) const
+{
+	uint64_t v = entry.local_time.get_value();
+	return (v >= begin_ && v < end_);
+}
+
+std::optional<DiaryEntryList> FilterByDateRange::candidates(const FilterIndex &index) const {
+	if (index.table == nullptr) {
+		return std::nullopt;
+	}
+	DiaryEntryList res = index.table->time_range(begin_, end_);
+	std::sort(res.begin(), res.end());
+	return res;
+}
+
+bool FilterByWeekday::operator () (const DiaryEntry &entry) const
+{
+	return mask_ & (1u << Date(entry.local_time).weekday());
+}
+
+bool FilterByTimeOfDay::operator () (const DiaryEntry &entry) const
+{
+	uint32_t v = Time(entry.local_time).get_value();
+	if (begin_ <= end_) {
+		return (v >= begin_ && v < end_);
+	} else {
+		return (v >= begin_ || v < end_);
+	}
+}
+
 
 
 
+std::optional<DiaryEntryList> FilterGroup::candidates(const FilterIndex &index) const {
+	std::optional<DiaryEntryList> res;
+	if (relation_ == AND) {
+		// Any filter with candidates narrows down the result
+		for (const auto &filter_ptr : filters_) {
+			std::optional<DiaryEntryList> sub = filter_ptr->candidates(index);
+			if (!sub) {
+				continue;
+			}
+			if (!res) {
+				res = std::move(sub);
+			} else {
+				DiaryEntryList tmp;
+				std::set_intersection(res->begin(), res->end(), sub->begin(), sub->end(),
+						std::back_inserter(tmp));
+				*res = std::move(tmp);
+			}
+		}
+	}
+	else {
+		// Only if every filter has candidates
+		res.emplace();
+		for (const auto &filter_ptr : filters_) {
+			std::optional<DiaryEntryList> sub = filter_ptr->candidates(index);
+			if (!sub) {
+				return std::nullopt;
+			}
+			DiaryEntryList tmp;
+			std::set_union(res->begin(), res->end(), sub->begin(), sub->end(),
+					std::back_inserter(tmp));
+			*res = std::move(tmp);
+		}
+	}
+	return res;
+}
+
 bool FilterGroup::operator () (const DiaryEntry &entry) const
 {
 	if (relation_ == AND) {
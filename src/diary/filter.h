@@ -16,27 +16,60 @@
 #define TIARY_DIARY_FILTER_H
 
 #include "common/string_match.h"
+#include <stdint.h>
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
 namespace tiary {
 
 struct DiaryEntry;
+class EntryTable;
+class LabelIndex;
+class TextIndex;
+
+/**
+ * @brief	Indexes of the entries being filtered, where available
+ *
+ * With them, filters may find the entries that can possibly pass
+ * without looking at every entry.
+ */
+struct FilterIndex {
+	const LabelIndex *labels = nullptr;
+	/// If not null, the list filtered must be the entries of the table,
+	/// in the same order, or in time order if time_ordered
+	const EntryTable *table = nullptr;
+	bool time_ordered = false;
+	const TextIndex *text = nullptr; ///< Only used with table
+};
 
 class Filter {
 public:
 	/**
 	 * @brief	Whether the given entry should be displayed
 	 * @result	Returns @c true if the entry should be displayed
+	 *
+	 * May be called from several threads at once (see filter).
 	 */
 	virtual bool operator () (const DiaryEntry &) const = 0;
 	virtual ~Filter() = default;
 
 	/**
 	 * @brief	Filter the whole entry list
+	 * @param	index	Indexes covering all entries in the list.
+	 * Label and date filters then only need to look at entries carrying
+	 * the labels or in the time range
+	 *
+	 * Long lists are checked in several threads.
 	 */
-	std::vector <DiaryEntry *> filter (const std::vector <DiaryEntry *> &) const;
+	std::vector <DiaryEntry *> filter (const std::vector <DiaryEntry *> &, const FilterIndex &index = FilterIndex()) const;
+
+	/**
+	 * @brief	Entries that may pass the filter, found with the index
+	 * @result	Sorted by address. std::nullopt if any entry may pass
+	 */
+	virtual std::optional<std::vector<DiaryEntry *>> candidates(const FilterIndex &) const { return std::nullopt; }
 };
 
 /**
@@ -50,6 +83,7 @@ public:
 	const std::vector<std::wstring>& labels() const { return labels_; }
 	std::wstring label() const;
 	bool operator()(const DiaryEntry &) const override;
+	std::optional<std::vector<DiaryEntry *>> candidates(const FilterIndex &) const override;
 	~FilterByLabel() = default;
 
 private:
@@ -65,6 +99,7 @@ private:
 class FilterByText final : public Filter {
 public:
 	bool operator () (const DiaryEntry &) const;
+	std::optional<std::vector<DiaryEntry *>> candidates(const FilterIndex &) const override;
 
 	FilterByText(const std::wstring &pattern, bool use_regex = false) : matcher_(pattern, use_regex) {}
 	~FilterByText ();
@@ -85,6 +120,7 @@ private:
 class FilterByTitle final : public Filter {
 public:
 	bool operator () (const DiaryEntry &) const;
+	std::optional<std::vector<DiaryEntry *>> candidates(const FilterIndex &) const override;
 
 	FilterByTitle(const std::wstring &pattern, bool use_regex = false) : matcher_(pattern, use_regex) {}
 	~FilterByTitle ();
@@ -97,6 +133,62 @@ private:
 	StringMatch matcher_;
 };
 
+/**
+ * @brief	Filter by date
+ *
+ * Displays only entries in a range of time
+ */
+class FilterByDateRange final : public Filter {
+public:
+	/// [begin, end), in DateTime values
+	FilterByDateRange(uint64_t begin, uint64_t end) : begin_(begin), end_(end) {}
+
+	uint64_t begin() const { return begin_; }
+	uint64_t end() const { return end_; }
+
+	bool operator () (const DiaryEntry &) const override;
+	std::optional<std::vector<DiaryEntry *>> candidates(const FilterIndex &) const override;
+
+private:
+	uint64_t begin_;
+	uint64_t end_;
+};
+
+/**
+ * @brief	Filter by day of week
+ */
+class FilterByWeekday final : public Filter {
+public:
+	/// Bit i of mask set = Displays entries on weekday i (0 = Sunday)
+	explicit FilterByWeekday(unsigned mask) : mask_(mask) {}
+
+	unsigned mask() const { return mask_; }
+
+	bool operator () (const DiaryEntry &) const override;
+
+private:
+	unsigned mask_;
+};
+
+/**
+ * @brief	Filter by time of day
+ *
+ * Displays only entries whose time is in [begin, end), in seconds since
+ * midnight.  If begin > end, the range wraps around midnight.
+ */
+class FilterByTimeOfDay final : public Filter {
+public:
+	FilterByTimeOfDay(uint32_t begin, uint32_t end) : begin_(begin), end_(end) {}
+
+	uint32_t begin() const { return begin_; }
+	uint32_t end() const { return end_; }
+
+	bool operator () (const DiaryEntry &) const override;
+
+private:
+	uint32_t begin_;
+	uint32_t end_;
+};
 
 
 /**
@@ -110,6 +202,7 @@ public:
 	enum Relation { AND, OR };
 
 	bool operator () (const DiaryEntry &) const;
+	std::optional<std::vector<DiaryEntry *>> candidates(const FilterIndex &) const override;
 
 	Relation relation() const { return relation_; }
 	void relation(Relation relation) { relation_ = relation; }
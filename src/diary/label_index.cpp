@@ -0,0 +1,131 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+
+#include "diary/label_index.h"
+#include <algorithm>
+#include <iterator>
+
+namespace tiary {
+
+void LabelIndex::rebuild(const DiaryEntryList &entries) {
+	clear();
+	for (DiaryEntry *entry: entries) {
+		for (const DiaryLabel *label: entry->labels) {
+			postings(label).push_back(entry);
+		}
+	}
+	for (auto &list: postings_) {
+		std::sort(list.begin(), list.end());
+	}
+}
+
+void LabelIndex::clear() {
+	postings_.clear();
+	labels_.clear();
+}
+
+void LabelIndex::add(DiaryEntry *entry) {
+	for (const DiaryLabel *label: entry->labels) {
+		std::vector<DiaryEntry *> &list = postings(label);
+		list.insert(std::upper_bound(list.begin(), list.end(), entry), entry);
+	}
+}
+
+void LabelIndex::remove(DiaryEntry *entry) {
+	for (const DiaryLabel *label: entry->labels) {
+		std::vector<DiaryEntry *> &list = postings(label);
+		auto it = std::lower_bound(list.begin(), list.end(), entry);
+		if (it != list.end() && *it == entry) {
+			list.erase(it);
+		}
+	}
+}
+
+void LabelIndex::replace(DiaryEntry *old_entry, DiaryEntry *new_entry) {
+	if (old_entry->labels != new_entry->labels) {
+		remove(old_entry);
+		add(new_entry);
+		return;
+	}
+	for (const DiaryLabel *label: old_entry->labels) {
+		std::vector<DiaryEntry *> &list = postings(label);
+		auto it = std::lower_bound(list.begin(), list.end(), old_entry);
+		if (it != list.end() && *it == old_entry) {
+			list.erase(it);
+		}
+		list.insert(std::upper_bound(list.begin(), list.end(), new_entry), new_entry);
+	}
+}
+
+const std::vector<DiaryEntry *> &LabelIndex::entries(const DiaryLabel *label) const {
+	static const std::vector<DiaryEntry *> empty;
+	if (label == nullptr || label->id >= postings_.size()) {
+		return empty;
+	}
+	return postings_[label->id];
+}
+
+const DiaryLabel *LabelIndex::find(std::wstring_view name) const {
+	// There are usually only a few hundred labels
+	for (size_t id = 0; id < postings_.size(); ++id) {
+		if (!postings_[id].empty() && labels_[id]->name == name) {
+			return labels_[id];
+		}
+	}
+	return nullptr;
+}
+
+WStringLocaleOrderedSet LabelIndex::names() const {
+	WStringLocaleOrderedSet res;
+	for (size_t id = 0; id < postings_.size(); ++id) {
+		if (!postings_[id].empty()) {
+			res.insert_with_key(labels_[id]->collation_key, labels_[id]->name);
+		}
+	}
+	return res;
+}
+
+std::vector<DiaryEntry *> LabelIndex::relabel(const DiaryLabel *from, const DiaryLabel *to) {
+	if (from == nullptr || from == to || from->id >= postings_.size()) {
+		return {};
+	}
+	std::vector<DiaryEntry *> modified = std::move(postings_[from->id]);
+	postings_[from->id].clear();
+	for (DiaryEntry *entry: modified) {
+		entry->labels.erase(from);
+	}
+	if (to) {
+		std::vector<DiaryEntry *> &list = postings(to);
+		std::vector<DiaryEntry *> merged;
+		merged.reserve(list.size() + modified.size());
+		for (DiaryEntry *entry: modified) {
+			entry->labels.insert(to);
+		}
+		std::set_union(list.begin(), list.end(), modified.begin(), modified.end(),
+				std::back_inserter(merged));
+		list = std::move(merged);
+	}
+	return modified;
+}
+
+std::vector<DiaryEntry *> &LabelIndex::postings(const DiaryLabel *label) {
+	if (label->id >= postings_.size()) {
+		postings_.resize(label->id + 1);
+		labels_.resize(label->id + 1);
+	}
+	labels_[label->id] = label;
+	return postings_[label->id];
+}
+
+} // namespace tiary
@@ -0,0 +1,75 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+
+#ifndef TIARY_DIARY_LABEL_INDEX_H
+#define TIARY_DIARY_LABEL_INDEX_H
+
+#include "diary/diary.h"
+#include <stddef.h>
+#include <string_view>
+#include <vector>
+
+/**
+ * @file	diary/label_index.h
+ * @author	chys <admin@chys.info>
+ * @brief	Maps labels to the entries carrying them
+ */
+
+namespace tiary {
+
+/**
+ * @brief	Postings lists of labels
+ *
+ * For every label, the entries carrying it, sorted by address.
+ * The index must be told about every entry added, removed or relabeled.
+ */
+class LabelIndex {
+public:
+	void rebuild(const DiaryEntryList &);
+	void clear();
+
+	void add(DiaryEntry *);
+	/// Must be called before the entry is destroyed or its labels change
+	void remove(DiaryEntry *);
+	/// The same as remove(old_entry) and add(new_entry), but faster if they
+	/// have the same labels (e.g., new_entry is a copy of old_entry)
+	void replace(DiaryEntry *old_entry, DiaryEntry *new_entry);
+
+	/// Entries carrying the label, sorted by address
+	const std::vector<DiaryEntry *> &entries(const DiaryLabel *) const;
+	size_t count(const DiaryLabel *label) const { return entries(label).size(); }
+	/// Returns nullptr if no entry carries the label
+	const DiaryLabel *find(std::wstring_view name) const;
+
+	/// Names of labels carried by at least one entry
+	WStringLocaleOrderedSet names() const;
+
+	/**
+	 * @brief	Replaces a label with another in all entries carrying it
+	 * @param	to	nullptr = Removes the label
+	 * @result	The entries modified, sorted by address
+	 */
+	std::vector<DiaryEntry *> relabel(const DiaryLabel *from, const DiaryLabel *to);
+
+private:
+	std::vector<DiaryEntry *> &postings(const DiaryLabel *);
+
+private:
+	std::vector<std::vector<DiaryEntry *>> postings_; // Indexed by DiaryLabel::id
+	std::vector<const DiaryLabel *> labels_; // Indexed by DiaryLabel::id
+};
+
+} // namespace tiary
+
+#endif // include guard
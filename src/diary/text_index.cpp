@@ -0,0 +1,215 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+
+#include "diary/text_index.h"
+#include "common/string.h"
+#include "common/unicode.h"
+#include <wctype.h>
+#include <algorithm>
+#include <iterator>
+
+namespace tiary {
+
+namespace {
+
+enum CharClass { OTHER, WORD, CJK };
+
+CharClass char_class(char32_t c) {
+	if (ucs_iscjk(c)) {
+		return CJK;
+	}
+	if (ucs_isalnum(c)) {
+		return WORD;
+	}
+	return OTHER;
+}
+
+// Lower-cases c the same way as CaseInsensitiveFinder does: ASCII letters
+// by the C locale rule, whatever the current locale says (e.g., Turkish
+// lower-cases 'I' to a dotless i); others by towlower
+char32_t fold_case(char32_t c) {
+	if (c < 0x80) {
+		return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+	}
+	return towlower(c);
+}
+
+// Calls f(cls, run, chars, at_begin, at_end) for every run of WORD or CJK
+// characters in s, lower-cased by fold_case.
+// at_begin and at_end tell whether the run is at the beginning or end of s
+template <typename F>
+void for_each_run(std::string_view s, F &&f) {
+	std::string run;
+	CharClass run_class = OTHER;
+	size_t chars = 0;
+	bool run_at_begin = false;
+	for (size_t i = 0; i < s.length(); ) {
+		size_t start = i;
+		// Classify after folding, as some symbols are lower-cased to letters
+		// (e.g., U+212A KELVIN SIGN to 'k')
+		char32_t c = fold_case(utf8_next(s, &i));
+		CharClass cls = char_class(c);
+		if (cls != run_class) {
+			if (run_class != OTHER) {
+				f(run_class, std::string_view(run), chars, run_at_begin, false);
+			}
+			run.clear();
+			chars = 0;
+			run_class = cls;
+			run_at_begin = (start == 0);
+		}
+		if (cls != OTHER) {
+			char buf[4];
+			run.append(buf, wchar_to_utf8(buf, c));
+			++chars;
+		}
+	}
+	if (run_class != OTHER) {
+		f(run_class, std::string_view(run), chars, run_at_begin, true);
+	}
+}
+
+// Calls f(token) for every pair of adjacent characters in a run of CJK
+// characters, or the only character
+template <typename F>
+void for_each_cjk_token(std::string_view run, size_t chars, F &&f) {
+	if (chars < 2) {
+		f(run);
+		return;
+	}
+	size_t a = 0;
+	size_t b = 0;
+	utf8_next(run, &b);
+	while (b < run.length()) {
+		size_t c = b;
+		utf8_next(run, &c);
+		f(run.substr(a, c - a));
+		a = b;
+		b = c;
+	}
+}
+
+void collect_tokens(std::string_view s, std::vector<std::string> *tokens) {
+	for_each_run(s, [tokens](CharClass cls, std::string_view run, size_t chars, bool, bool) {
+		if (cls == WORD) {
+			tokens->emplace_back(run);
+		} else {
+			for_each_cjk_token(run, chars, [tokens](std::string_view token) {
+				tokens->emplace_back(token);
+			});
+		}
+	});
+}
+
+std::vector<std::string> entry_tokens(std::string_view title, std::string_view text) {
+	std::vector<std::string> tokens;
+	collect_tokens(title, &tokens);
+	collect_tokens(text, &tokens);
+	std::sort(tokens.begin(), tokens.end());
+	tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+	return tokens;
+}
+
+} // anonymous namespace
+
+void TextIndex::add(unsigned id, std::string_view title, std::string_view text) {
+	for (std::string &token: entry_tokens(title, text)) {
+		std::vector<unsigned> &list = postings_[std::move(token)];
+		if (list.empty() || list.back() < id) {
+			list.push_back(id);
+		} else {
+			auto it = std::lower_bound(list.begin(), list.end(), id);
+			if (*it != id) {
+				list.insert(it, id);
+			}
+		}
+	}
+}
+
+void TextIndex::remove(unsigned id, std::string_view title, std::string_view text) {
+	for (const std::string &token: entry_tokens(title, text)) {
+		auto map_it = postings_.find(token);
+		if (map_it == postings_.end()) {
+			continue;
+		}
+		std::vector<unsigned> &list = map_it->second;
+		auto it = std::lower_bound(list.begin(), list.end(), id);
+		if (it != list.end() && *it == id) {
+			list.erase(it);
+		}
+		if (list.empty()) {
+			postings_.erase(map_it);
+		}
+	}
+}
+
+std::optional<std::vector<unsigned>> TextIndex::candidates(std::wstring_view pattern) const {
+	std::optional<std::vector<unsigned>> res;
+
+	auto narrow = [&res](const std::vector<unsigned> &ids) {
+		if (!res) {
+			res = ids;
+		} else {
+			std::vector<unsigned> tmp;
+			std::set_intersection(res->begin(), res->end(), ids.begin(), ids.end(),
+					std::back_inserter(tmp));
+			*res = std::move(tmp);
+		}
+	};
+	auto exact = [this](std::string_view token) -> const std::vector<unsigned> & {
+		static const std::vector<unsigned> empty;
+		auto it = postings_.find(std::string(token));
+		return (it == postings_.end()) ? empty : it->second;
+	};
+	// Entries containing any token satisfying pred
+	auto matching = [this](auto &&pred) {
+		std::vector<unsigned> ids;
+		for (const auto &[token, list]: postings_) {
+			if (pred(std::string_view(token))) {
+				ids.insert(ids.end(), list.begin(), list.end());
+			}
+		}
+		std::sort(ids.begin(), ids.end());
+		ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+		return ids;
+	};
+
+	for_each_run(wstring_to_utf8(pattern),
+			[&](CharClass cls, std::string_view run, size_t chars, bool at_begin, bool at_end) {
+		if (res && res->empty()) {
+			return;
+		}
+		if (cls == WORD) {
+			// A word cut by the pattern boundary may be part of a longer word
+			if (!at_begin && !at_end) {
+				narrow(exact(run));
+			} else if (at_begin && at_end) {
+				narrow(matching([run](std::string_view token) { return token.find(run) != token.npos; }));
+			} else if (at_begin) {
+				narrow(matching([run](std::string_view token) { return token.ends_with(run); }));
+			} else {
+				narrow(matching([run](std::string_view token) { return token.starts_with(run); }));
+			}
+		} else if (chars >= 2) {
+			for_each_cjk_token(run, chars, [&](std::string_view token) {
+				narrow(exact(token));
+			});
+		} else {
+			narrow(matching([run](std::string_view token) { return token.find(run) != token.npos; }));
+		}
+	});
+	return res;
+}
+
+} // namespace tiary
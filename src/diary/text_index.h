@@ -0,0 +1,65 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+
+#ifndef TIARY_DIARY_TEXT_INDEX_H
+#define TIARY_DIARY_TEXT_INDEX_H
+
+#include <stddef.h>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @file	diary/text_index.h
+ * @author	chys <admin@chys.info>
+ * @brief	Maps words in titles and texts to the entries containing them
+ */
+
+namespace tiary {
+
+/**
+ * @brief	Inverted index of the titles and texts of entries
+ *
+ * Texts are split into tokens: lower-cased words of letters and digits,
+ * and pairs of adjacent CJK characters (or single ones standing alone).
+ * Every token maps to the IDs (DiaryEntry::id) of the entries containing it.
+ *
+ * The index must be told about every entry added or removed, and every
+ * title or text changed.  It is not thread-safe.
+ */
+class TextIndex {
+public:
+	void add(unsigned id, std::string_view title, std::string_view text);
+	/// title and text must be the same as they were added
+	void remove(unsigned id, std::string_view title, std::string_view text);
+	void clear() { postings_.clear(); }
+
+	/**
+	 * @brief	Entries that may contain a string, ignoring case
+	 * @result	IDs, sorted. std::nullopt if any entry may contain it
+	 *
+	 * Every entry whose title or text contains the string, as
+	 * StringMatch would find it, is included.
+	 */
+	std::optional<std::vector<unsigned>> candidates(std::wstring_view) const;
+
+private:
+	std::unordered_map<std::string, std::vector<unsigned>> postings_;
+};
+
+} // namespace tiary
+
+#endif // include guard
@@ -23,9 +23,12 @@
 #include "ui/dialog_input.h"
 #include "ui/dialog_message.h"
 #include "diary/diary.h"
+#include "diary/label_index.h"
 #include "common/format.h"
 #include "common/containers.h"
 #include "common/string.h"
+#include <algorithm>
+#include <iterator>
 
 /**
  * @file	main/dialog_all_labels.cpp
@@ -51,14 +54,15 @@ class WindowAllLabels final : public virtual Window, public FixedWindow, private
 	Layout layout_main;
 	Layout layout_right;
 
-	DiaryEntryList &entries;
+	LabelIndex &index;
+	LabelDictionary &dictionary;
 
 	WStringLocaleOrderedSet all_labels;
 
-	bool modified;
+	DiaryEntryList modified; // Sorted by address
 
 public:
-	WindowAllLabels (DiaryEntryList &);
+	WindowAllLabels (LabelIndex &, LabelDictionary &);
 	~WindowAllLabels ();
 
 	void redraw ();
@@ -67,13 +71,14 @@ public:
 	void slot_delete ();
 	void slot_ok ();
 
-	bool get_modified () const { return modified; }
+	DiaryEntryList &get_modified () { return modified; }
 
 private:
+	void add_modified (const DiaryEntryList &);
 	void refresh_list (const std::wstring &select_hint = std::wstring ());
 };
 
-WindowAllLabels::WindowAllLabels (DiaryEntryList &entries_)
+WindowAllLabels::WindowAllLabels (LabelIndex &index_, LabelDictionary &dictionary_)
 	: Window(0, L"All labels"sv)
 	, FixedWindow ()
 	, ButtonDefault ()
@@ -83,13 +88,11 @@ WindowAllLabels::WindowAllLabels (DiaryEntryList &entries_)
 	, btn_ok(*this, L"&OK"sv)
 	, layout_main (HORIZONTAL)
 	, layout_right (VERTICAL)
-	, entries (entries_)
-	, all_labels ()
-	, modified (false)
+	, index (index_)
+	, dictionary (dictionary_)
+	, all_labels (index_.names ())
+	, modified ()
 {
-	for (DiaryEntryList::const_iterator it = entries.begin (); it != entries.end (); ++it) {
-		all_labels.insert ((*it)->labels.begin (), (*it)->labels.end ());
-	}
 	refresh_list ();
 
 	layout_right.add({
@@ -162,18 +165,10 @@ void WindowAllLabels::slot_rename ()
 		if (dialog_message(format(warning_template, old_name, new_name),
 					L"Rename label"sv, msg_buttons) == MESSAGE_YES) {
 
+			const DiaryLabel *new_label = dictionary.intern (new_name);
+			add_modified (index.relabel (index.find (old_name), new_label));
 			all_labels.erase (old_name);
 			all_labels.insert (new_name);
-
-			for (DiaryEntryList::iterator it = entries.begin (); it != entries.end (); ++it) {
-				DiaryEntry::LabelList &labels = (*it)->labels;
-				DiaryEntry::LabelList::iterator jt = labels.find (old_name);
-				if (jt != labels.end ()) {
-					labels.erase (jt);
-					labels.insert (new_name);
-				}
-			}
-			modified = true;
 			refresh_list (new_name);
 			touch_windows (); // Reflect changes in MainWin
 		}
@@ -187,11 +182,8 @@ void WindowAllLabels::slot_delete ()
 		const std::wstring &old_name = lst_labels.get_items () [k];
 		if (dialog_message(format(L"Are you sure you want to delete label \"%a\"?\nThis operation cannot be undone!"sv,
 					old_name), L"Delete label"sv, MESSAGE_YES|MESSAGE_NO) == MESSAGE_YES) {
+			add_modified (index.relabel (index.find (old_name), nullptr));
 			all_labels.erase (old_name);
-			for (DiaryEntryList::iterator it = entries.begin (); it != entries.end (); ++it) {
-				(*it)->labels.erase (old_name);
-			}
-			modified = true;
 			refresh_list ();
 			touch_windows (); // Reflect changes in MainWin
 		}
@@ -203,6 +195,14 @@ void WindowAllLabels::slot_ok ()
 	Window::request_close ();
 }
 
+void WindowAllLabels::add_modified (const DiaryEntryList &entries)
+{
+	DiaryEntryList merged;
+	std::set_union (modified.begin (), modified.end (), entries.begin (), entries.end (),
+			std::back_inserter (merged));
+	modified = std::move (merged);
+}
+
 void WindowAllLabels::refresh_list (const std::wstring &select_hint)
 {
 	size_t new_select;
@@ -219,11 +219,11 @@ void WindowAllLabels::refresh_list (const std::wstring &select_hint)
 
 } // anonymous namespace
 
-bool edit_all_labels (DiaryEntryList &entries)
+DiaryEntryList edit_all_labels (LabelIndex &index, LabelDictionary &dictionary)
 {
-	WindowAllLabels win (entries);
+	WindowAllLabels win (index, dictionary);
 	win.event_loop ();
-	return win.get_modified ();
+	return std::move (win.get_modified ());
 }
 
 } // namespace tiary
@@ -15,20 +15,22 @@
 #ifndef TIARY_MAIN_DIALOG_ALL_LABELS_H
 #define TIARY_MAIN_DIALOG_ALL_LABELS_H
 
-#include "common/containers.h"
 #include <vector>
 
 namespace tiary {
 
 
 struct DiaryEntry;
+class LabelDictionary;
+class LabelIndex;
 
 /**
  * @brief	Display a window to allow the user to edit labels and apply to all entries
- * @param	entries	The list of all entries
- * @result	If anything is changed
+ * @param	index	Labels of all entries
+ * @param	dictionary	Where renamed labels are interned
+ * @result	Entries modified, sorted by address
  */
-bool edit_all_labels (std::vector<DiaryEntry *> &entries);
+std::vector<DiaryEntry *> edit_all_labels (LabelIndex &index, LabelDictionary &dictionary);
 
 } // namespace tiary
 
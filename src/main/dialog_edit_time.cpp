@@ -161,6 +161,81 @@ void WindowTime::slot_ok ()
 	request_close ();
 }
 
+class WindowDate final : public FixedWindow, private ButtonDefault {
+
+	DateSelect date_select;
+	Button btn_today;
+	Button btn_ok;
+
+	Layout layout_main;
+	Layout layout_buttons;
+
+	bool canceled;
+
+public:
+	explicit WindowDate (Date);
+	~WindowDate ();
+
+	bool get_canceled () const { return canceled; }
+	Date get_result () const { return date_select.get_date (); }
+
+private:
+	void slot_today ();
+	void slot_ok ();
+};
+
+WindowDate::WindowDate (Date date)
+	: Window ()
+	, FixedWindow ()
+	, date_select (*this)
+	, btn_today(*this, L"&Today"sv)
+	, btn_ok(*this, L"&OK"sv)
+	, layout_main (VERTICAL)
+	, layout_buttons (HORIZONTAL)
+	, canceled (true)
+{
+	date_select.set_date (date);
+
+	ChainControlsHorizontal{&date_select.year, &date_select.month, &date_select.day,
+		&btn_today, &btn_ok};
+
+	set_default_button (btn_ok);
+
+	FixedWindow::resize({33, 13});
+
+	layout_buttons.add({
+			{btn_today, 10, 10},
+			{2, 2},
+			{btn_ok, 10, 10},
+		});
+	layout_main.add({
+			{date_select, 7, 7},
+			{1, 1},
+			{layout_buttons, 3, 3},
+		});
+
+	layout_main.move_resize({2, 1}, {29, 11});
+
+	btn_today.sig_clicked.connect (this, &WindowDate::slot_today);
+	btn_ok.sig_clicked.connect (this, &WindowDate::slot_ok);
+	register_hotkey (ESCAPE, Signal (this, &Window::request_close));
+}
+
+WindowDate::~WindowDate ()
+{
+}
+
+void WindowDate::slot_today ()
+{
+	date_select.set_date (DateTime (DateTime::LOCAL), false);
+}
+
+void WindowDate::slot_ok ()
+{
+	canceled = false;
+	request_close ();
+}
+
 } // anonymous namespace
 
 bool edit_entry_time (DiaryEntry &ent)
@@ -175,5 +250,16 @@ bool edit_entry_time (DiaryEntry &ent)
 	return (old != ent.local_time);
 }
 
+bool select_date (Date &date)
+{
+	WindowDate win (date);
+	win.event_loop ();
+	if (win.get_canceled ()) {
+		return false;
+	}
+	date = win.get_result ();
+	return true;
+}
+
 
 } // namespace tiary
@@ -27,6 +27,12 @@ struct DiaryEntry;
  */
 bool edit_entry_time (DiaryEntry &);
 
+/**
+ * @brief	Let the user pick a date
+ * @result	false if canceled
+ */
+bool select_date (Date &);
+
 
 } // namespace tiary
 
@@ -21,6 +21,7 @@
 
 #include "main/dialog_filter.h"
 #include "diary/diary.h"
+#include "diary/label_index.h"
 #include "diary/filter.h"
 #include "ui/droplist.h"
 #include "ui/label.h"
@@ -34,8 +35,10 @@
 #include "ui/dialog_select.h"
 #include "ui/layout.h"
 #include "ui/chain.h"
+#include "common/datetime.h"
 #include "common/format.h"
 #include "common/string.h"
+#include <iterator>
 
 namespace tiary {
 
@@ -43,8 +46,87 @@ namespace {
 
 using namespace ui;
 
+const wchar_t hour_names [][3] = {
+	L"00", L"01", L"02", L"03", L"04", L"05", L"06", L"07", L"08", L"09",
+	L"10", L"11", L"12", L"13", L"14", L"15", L"16", L"17", L"18", L"19",
+	L"20", L"21", L"22", L"23", L"24",
+};
+
+const struct {
+	std::wstring_view name;
+	unsigned mask; // See FilterByWeekday
+} weekday_choices[] = {
+	{L"Any day"sv,   0x7f},
+	{L"Weekdays"sv,  0x3e},
+	{L"Weekends"sv,  0x41},
+	{L"Sunday"sv,    0x01},
+	{L"Monday"sv,    0x02},
+	{L"Tuesday"sv,   0x04},
+	{L"Wednesday"sv, 0x08},
+	{L"Thursday"sv,  0x10},
+	{L"Friday"sv,    0x20},
+	{L"Saturday"sv,  0x40},
+};
+
+std::vector<std::wstring> weekday_names ()
+{
+	std::vector<std::wstring> res;
+	for (const auto &choice : weekday_choices) {
+		res.emplace_back (choice.name);
+	}
+	return res;
+}
+
+// Parses "YYYY", "YYYY-MM" or "YYYY-MM-DD" ('/' may be used instead of '-').
+// Returns the first day covered and the day after the last one,
+// or false if invalid
+bool parse_dates (std::wstring_view s, uint32_t *first, uint32_t *end)
+{
+	unsigned parts[3] = {};
+	unsigned n = 0;
+	bool digit = false;
+	for (wchar_t c : strip (s)) {
+		if (c >= L'0' && c <= L'9') {
+			if (parts[n] >= 100000) {
+				return false;
+			}
+			parts[n] = parts[n] * 10 + (c - L'0');
+			digit = true;
+		} else if ((c == L'-' || c == L'/') && digit && n < 2) {
+			++n;
+			digit = false;
+		} else {
+			return false;
+		}
+	}
+	if (!digit) {
+		return false;
+	}
+	unsigned y = parts[0];
+	unsigned m_first = 1;
+	unsigned m_last = 12;
+	if (n >= 1) {
+		m_first = m_last = parts[1];
+	}
+	if (m_last < 1 || m_last > 12) {
+		return false;
+	}
+	unsigned d_first = 1;
+	unsigned d_last = days_of_month (y, m_last);
+	if (n >= 2) {
+		d_first = d_last = parts[2];
+	}
+	*first = make_date_strict ({y, m_first, d_first, 0});
+	uint32_t last = make_date_strict ({y, m_last, d_last, 0});
+	if (*first == INVALID_DATE || last == INVALID_DATE) {
+		return false;
+	}
+	*end = last + 1;
+	return true;
+}
+
 class DialogFilter final : public FixedWindow, private ButtonDefault {
-	const DiaryEntry::LabelList &all_labels;
+	const WStringLocaleOrderedSet &all_labels;
 	FilterGroup &result;
 
 	Label lbl_label;
@@ -68,6 +150,22 @@ class DialogFilter final : public FixedWindow, private ButtonDefault {
 	Layout layout_text_regex;
 #endif
 
+	Label lbl_dates;
+	TextBox txt_date_from;
+	Label lbl_dates_to;
+	TextBox txt_date_to;
+	Layout layout_dates;
+
+	Label lbl_weekday;
+	DropList drp_weekday;
+	Layout layout_weekday;
+
+	Label lbl_hours;
+	DropList drp_hour_from;
+	Label lbl_hours_to;
+	DropList drp_hour_to;
+	Layout layout_hours;
+
 	Button btn_ok;
 	Button btn_cancel;
 	Layout layout_buttons;
@@ -78,13 +176,13 @@ class DialogFilter final : public FixedWindow, private ButtonDefault {
 	void slot_choose_label ();
 
 public:
-	DialogFilter (const DiaryEntry::LabelList &, FilterGroup &);
+	DialogFilter (const WStringLocaleOrderedSet &, FilterGroup &);
 	~DialogFilter ();
 
 	void redraw ();
 };
 
-DialogFilter::DialogFilter (const DiaryEntry::LabelList &all_labels_, FilterGroup &result_)
+DialogFilter::DialogFilter (const WStringLocaleOrderedSet &all_labels_, FilterGroup &result_)
 	: Window(0, L"Filtering"sv)
 	, FixedWindow ()
 	, ButtonDefault ()
@@ -108,6 +206,19 @@ DialogFilter::DialogFilter (const DiaryEntry::LabelList &all_labels_, FilterGrou
 	, chk_text_regex(*this, L"Regular e&xpression"sv, false)
 	, layout_text_regex (HORIZONTAL)
 #endif
+	, lbl_dates(*this, L"Date&s:"sv)
+	, txt_date_from (*this)
+	, lbl_dates_to(*this, L"-"sv)
+	, txt_date_to (*this)
+	, layout_dates (HORIZONTAL)
+	, lbl_weekday(*this, L"&Weekday:"sv)
+	, drp_weekday (*this, weekday_names (), 0)
+	, layout_weekday (HORIZONTAL)
+	, lbl_hours(*this, L"Ho&urs:"sv)
+	, drp_hour_from (*this, std::vector<std::wstring>(hour_names, hour_names+24), 0)
+	, lbl_hours_to(*this, L"-"sv)
+	, drp_hour_to (*this, std::vector<std::wstring>(hour_names+1, hour_names+25), 23)
+	, layout_hours (HORIZONTAL)
 	, btn_ok(*this, L"&OK"sv)
 	, btn_cancel(*this, L"Cancel"sv)
 	, layout_buttons (HORIZONTAL)
@@ -131,6 +242,27 @@ DialogFilter::DialogFilter (const DiaryEntry::LabelList &all_labels_, FilterGrou
 			chk_text_regex.checkbox.set_status (filter_text->get_use_regex ());
 #endif
 		}
+		else if (FilterByDateRange *filter_dates = dynamic_cast<FilterByDateRange *>(filter)) {
+			if (filter_dates->begin () != 0) {
+				std::wstring date = format_datetime (filter_dates->begin (), L"%Y-%m-%d"sv);
+				txt_date_from.set_text (date, false, date.length ());
+			}
+			if (filter_dates->end () != UINT64_MAX) {
+				std::wstring date = format_datetime (filter_dates->end () - 1, L"%Y-%m-%d"sv);
+				txt_date_to.set_text (date, false, date.length ());
+			}
+		}
+		else if (FilterByWeekday *filter_weekday = dynamic_cast<FilterByWeekday *>(filter)) {
+			for (size_t i = 0; i < std::size (weekday_choices); ++i) {
+				if (weekday_choices[i].mask == filter_weekday->mask ()) {
+					drp_weekday.set_select (i, false);
+				}
+			}
+		}
+		else if (FilterByTimeOfDay *filter_hours = dynamic_cast<FilterByTimeOfDay *>(filter)) {
+			drp_hour_from.set_select (filter_hours->begin () / 3600, false);
+			drp_hour_to.set_select ((filter_hours->end () + SECONDS_PER_DAY - 1) % SECONDS_PER_DAY / 3600, false);
+		}
 	}
 
 	// Setting up layouts
@@ -163,6 +295,25 @@ DialogFilter::DialogFilter (const DiaryEntry::LabelList &all_labels_, FilterGrou
 			{chk_text_regex, 3, Layout::UNLIMITED},
 		});
 #endif
+	layout_dates.add({
+			{lbl_dates, 10, 10},
+			{1, 1},
+			{txt_date_from, 1, Layout::UNLIMITED},
+			{lbl_dates_to, 3, 3},
+			{txt_date_to, 1, Layout::UNLIMITED},
+		});
+	layout_weekday.add({
+			{lbl_weekday, 10, 10},
+			{1, 1},
+			{drp_weekday, 11, 11},
+		});
+	layout_hours.add({
+			{lbl_hours, 10, 10},
+			{1, 1},
+			{drp_hour_from, 2, 2},
+			{lbl_hours_to, 3, 3},
+			{drp_hour_to, 2, 2},
+		});
 	layout_buttons.add({
 			{btn_ok, 10, 10},
 			{1, 1},
@@ -181,6 +332,10 @@ DialogFilter::DialogFilter (const DiaryEntry::LabelList &all_labels_, FilterGrou
 #ifdef TIARY_USE_RE2
 			{layout_text_regex, 1, 1},
 #endif
+			{1, 1},
+			{layout_dates, 1, 1},
+			{layout_weekday, 1, 1},
+			{layout_hours, 1, 1},
 			{1, 1},
 			{layout_buttons, 3, 3},
 		});
@@ -196,12 +351,21 @@ DialogFilter::DialogFilter (const DiaryEntry::LabelList &all_labels_, FilterGrou
 #ifdef TIARY_USE_RE2
 		&chk_text_regex.checkbox,
 #endif
+		&txt_date_from,
+		&drp_weekday,
+		&drp_hour_from,
 		&btn_ok};
 	ChainControlsHorizontal{&txt_label, &btn_label};
+	ChainControlsHorizontal{&txt_date_from, &txt_date_to};
+	ChainControlsHorizontal{&drp_hour_from, &drp_hour_to};
 	ChainControlsHorizontal{&btn_ok, &btn_cancel};
 
 	btn_label.ctrl_up = txt_label.ctrl_up;
 	btn_label.ctrl_down = txt_label.ctrl_down;
+	txt_date_to.ctrl_up = txt_date_from.ctrl_up;
+	txt_date_to.ctrl_down = txt_date_from.ctrl_down;
+	drp_hour_to.ctrl_up = drp_hour_from.ctrl_up;
+	drp_hour_to.ctrl_down = drp_hour_from.ctrl_down;
 	btn_cancel.ctrl_up = btn_ok.ctrl_up;
 	btn_cancel.ctrl_down = btn_ok.ctrl_down;
 
@@ -219,7 +383,7 @@ DialogFilter::~DialogFilter ()
 
 void DialogFilter::redraw ()
 {
-	Size size = Size{40, 13} & get_screen_size ();
+	Size size = Size{40, 17} & get_screen_size ();
 	FixedWindow::resize (size);
 	layout_main.move_resize({2, 1}, size - Size{4, 2});
 	Window::redraw ();
@@ -266,6 +430,50 @@ void DialogFilter::slot_ok ()
 		new_filter.add(filter);
 	}
 
+	if (!txt_date_from.get_text ().empty () || !txt_date_to.get_text ().empty ()) {
+		uint32_t first = 0;
+		uint32_t end = 0;
+		uint64_t begin_time = 0;
+		uint64_t end_time = UINT64_MAX;
+		if (!txt_date_from.get_text ().empty ()) {
+			if (!parse_dates (txt_date_from.get_text (), &first, &end)) {
+				dialog_message(format(L"Invalid date: \"%a\""sv, txt_date_from.get_text()));
+				set_focus_ptr (&txt_date_from);
+				return;
+			}
+			begin_time = make_datetime (first, 0);
+		}
+		if (!txt_date_to.get_text ().empty ()) {
+			if (!parse_dates (txt_date_to.get_text (), &first, &end)) {
+				dialog_message(format(L"Invalid date: \"%a\""sv, txt_date_to.get_text()));
+				set_focus_ptr (&txt_date_to);
+				return;
+			}
+			end_time = make_datetime (end, 0);
+		}
+		if (begin_time >= end_time) {
+			dialog_message(L"The first date is after the last one."sv);
+			set_focus_ptr (&txt_date_from);
+			return;
+		}
+		new_filter.add(new FilterByDateRange(begin_time, end_time));
+	}
+	if (weekday_choices[drp_weekday.get_select ()].mask != 0x7f) {
+		new_filter.add(new FilterByWeekday(weekday_choices[drp_weekday.get_select ()].mask));
+	}
+	if (drp_hour_from.get_select () != 0 || drp_hour_to.get_select () != 23) {
+		uint32_t begin = drp_hour_from.get_select () * 3600;
+		uint32_t end = (drp_hour_to.get_select () + 1) * 3600 % SECONDS_PER_DAY;
+		// Ranges may wrap around midnight (e.g., 22-02), but "05-05" would
+		// match nothing
+		if (begin == end) {
+			dialog_message(L"The time range is empty."sv);
+			set_focus_ptr (&drp_hour_to);
+			return;
+		}
+		new_filter.add(new FilterByTimeOfDay(begin, end));
+	}
+
 	new_filter.relation(FilterGroup::AND);
 
 	result = std::move(new_filter);
@@ -285,13 +493,9 @@ void DialogFilter::slot_choose_label ()
 
 } // anonoymous namespace
 
-void dialog_filter (const DiaryEntryList &entries, FilterGroup &filter)
+void dialog_filter (const LabelIndex &index, FilterGroup &filter)
 {
-	DiaryEntry::LabelList all_labels;
-	for (DiaryEntryList::const_iterator it = entries.begin (); it != entries.end (); ++it) {
-		all_labels.insert ((*it)->labels.begin (), (*it)->labels.end ());
-	}
-	DialogFilter (all_labels, filter).event_loop ();
+	DialogFilter (index.names (), filter).event_loop ();
 }
 
 
@@ -15,14 +15,12 @@
 #ifndef TIARY_MAIN_DIALOG_FILTER_H
 #define TIARY_MAIN_DIALOG_FILTER_H
 
-#include <vector>
-
 namespace tiary {
 
 struct FilterGroup;
-struct DiaryEntry;
+class LabelIndex;
 
-void dialog_filter (const std::vector <DiaryEntry *> &, FilterGroup &);
+void dialog_filter (const LabelIndex &, FilterGroup &);
 
 } // namespace tiary
 
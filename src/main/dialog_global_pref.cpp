@@ -61,6 +61,13 @@ class WindowGlobalOptions : public FixedWindow, private ButtonDefault
 	DropList drp_expand_lines;
 	Layout layout_expand_lines;
 
+	// GLOBAL_OPTION_AUTOSAVE_IDLE, GLOBAL_OPTION_AUTOSAVE_EDITS
+	Label lbl_autosave_idle;
+	DropList drp_autosave_idle;
+	Label lbl_autosave_edits;
+	DropList drp_autosave_edits;
+	Layout layout_autosave;
+
 	// GLOBAL_OPTION_EDITOR
 	Label lbl_editor;
 	TextBox txt_editor;
@@ -99,6 +106,22 @@ public:
 };
 
 const wchar_t expand_lines_array[][2] = { L"1", L"2", L"3", L"4", L"5", L"6", L"7", L"8" };
+
+const wchar_t autosave_idle_array[][7] = { L"Off", L"10 sec", L"30 sec", L"1 min", L"5 min" };
+const unsigned autosave_idle_values[] = { 0, 10, 30, 60, 300 };
+const wchar_t autosave_edits_array[][4] = { L"Off", L"10", L"20", L"50", L"100" };
+const unsigned autosave_edits_values[] = { 0, 10, 20, 50, 100 };
+
+// Index of the largest choice not greater than value (but not "Off" unless value is 0)
+template <size_t N>
+size_t autosave_choice(const unsigned (&values)[N], unsigned value) {
+	size_t i = N - 1;
+	while (i > 1 && values[i] > value) {
+		--i;
+	}
+	return (value == 0) ? 0 : i;
+}
+
 WindowGlobalOptions::WindowGlobalOptions (GlobalOptionGroup &options_, const std::wstring &current_filename_)
 	: Window(0, L"Preferences"sv)
 	, FixedWindow ()
@@ -115,6 +138,11 @@ WindowGlobalOptions::WindowGlobalOptions (GlobalOptionGroup &options_, const std
 	, drp_expand_lines(*this, std::vector<std::wstring>(std::begin(expand_lines_array), std::end(expand_lines_array)),
 			options_.get_num(GLOBAL_OPTION_EXPAND_LINES)-1)
 	, layout_expand_lines (HORIZONTAL)
+	, lbl_autosave_idle(*this, L"&Autosave when idle:"sv)
+	, drp_autosave_idle(*this, std::vector<std::wstring>(std::begin(autosave_idle_array), std::end(autosave_idle_array)), 0)
+	, lbl_autosave_edits(*this, L"or after e&dits:"sv)
+	, drp_autosave_edits(*this, std::vector<std::wstring>(std::begin(autosave_edits_array), std::end(autosave_edits_array)), 0)
+	, layout_autosave (HORIZONTAL)
 	, lbl_editor(*this, L"&Editor:"sv)
 	, txt_editor (*this)
 	, layout_editor (HORIZONTAL)
@@ -131,7 +159,7 @@ WindowGlobalOptions::WindowGlobalOptions (GlobalOptionGroup &options_, const std
 	, layout_buttons (HORIZONTAL)
 	, layout_main (VERTICAL)
 {
-	FixedWindow::resize(get_screen_size() & Size{80, 18});
+	FixedWindow::resize(get_screen_size() & Size{80, 20});
 
 	// Set up layouts
 
@@ -156,6 +184,17 @@ WindowGlobalOptions::WindowGlobalOptions (GlobalOptionGroup &options_, const std
 			{0, Layout::UNLIMITED},
 		});
 
+	layout_autosave.add({
+			{lbl_autosave_idle, 20, 20},
+			{1, 1},
+			{drp_autosave_idle, 6, 6},
+			{3, 3},
+			{lbl_autosave_edits, 16, 16},
+			{1, 1},
+			{drp_autosave_edits, 3, 3},
+			{0, Layout::UNLIMITED},
+		});
+
 	layout_editor.add({
 			{lbl_editor, 20, 20},
 			{1, 1},
@@ -190,6 +229,8 @@ WindowGlobalOptions::WindowGlobalOptions (GlobalOptionGroup &options_, const std
 			{1, 1},
 			{layout_expand_lines, 1, 1},
 			{1, 1},
+			{layout_autosave, 1, 1},
+			{1, 1},
 			{layout_editor, 1, 1},
 			{1, 1},
 			{layout_datetime_format, 1, 1},
@@ -209,11 +250,15 @@ WindowGlobalOptions::WindowGlobalOptions (GlobalOptionGroup &options_, const std
 	ChainControlsVerticalNC{
 		&btn_default_file,
 		&drp_expand_lines,
+		&drp_autosave_idle,
 		&txt_editor,
 		&txt_datetime_format,
 		&txt_longtime_format,
 		&btn_ok};
+	ChainControlsHorizontal{&drp_autosave_idle, &drp_autosave_edits};
 	btn_default_file_current.ctrl_down = btn_default_file.ctrl_down;
+	drp_autosave_edits.ctrl_up = drp_autosave_idle.ctrl_up;
+	drp_autosave_edits.ctrl_down = drp_autosave_idle.ctrl_down;
 	btn_reset.ctrl_up = btn_cancel.ctrl_up = btn_help.ctrl_up = btn_ok.ctrl_up;
 
 
@@ -246,6 +291,8 @@ void WindowGlobalOptions::copy_options_to_controls (const GlobalOptionGroup &grp
 {
 	lbl_default_file_name.set_text (grp.get_wstring (GLOBAL_OPTION_DEFAULT_FILE), UIString::NO_HOTKEY);
 	drp_expand_lines.set_select (grp.get_num (GLOBAL_OPTION_EXPAND_LINES) - 1, false);
+	drp_autosave_idle.set_select(autosave_choice(autosave_idle_values, grp.get_num(GLOBAL_OPTION_AUTOSAVE_IDLE)), false);
+	drp_autosave_edits.set_select(autosave_choice(autosave_edits_values, grp.get_num(GLOBAL_OPTION_AUTOSAVE_EDITS)), false);
 	txt_editor.set_text (grp.get_wstring (GLOBAL_OPTION_EDITOR), false);
 	txt_datetime_format.set_text (grp.get_wstring (GLOBAL_OPTION_DATETIME_FORMAT), false);
 	txt_longtime_format.set_text (grp.get_wstring (GLOBAL_OPTION_LONGTIME_FORMAT), false);
@@ -273,6 +320,8 @@ void WindowGlobalOptions::slot_ok ()
 {
 	options.set (GLOBAL_OPTION_DEFAULT_FILE, lbl_default_file_name.get_text ());
 	options.set (GLOBAL_OPTION_EXPAND_LINES, unsigned (drp_expand_lines.get_select ())+1);
+	options.set(GLOBAL_OPTION_AUTOSAVE_IDLE, autosave_idle_values[drp_autosave_idle.get_select()]);
+	options.set(GLOBAL_OPTION_AUTOSAVE_EDITS, autosave_edits_values[drp_autosave_edits.get_select()]);
 	options.set (GLOBAL_OPTION_EDITOR, txt_editor.get_text ());
 	options.set (GLOBAL_OPTION_DATETIME_FORMAT, txt_datetime_format.get_text ());
 	options.set (GLOBAL_OPTION_LONGTIME_FORMAT, txt_longtime_format.get_text ());
@@ -294,6 +343,10 @@ Default file: This file is automatically loaded, unless you explicitly open anot
 \n\
 Expand lines: The number of lines the selected diary entry should use on screen.\n\
 \n\
+Autosave: Unsaved changes are written to a recovery file next to the diary file\n\
+    after you stop typing for a while, or after many modifications, whichever\n\
+    comes first.  The diary file itself is only written when you save it.\n\
+\n\
 Editor: The editor used to edit diary entries.\n\
 \n\
     You can specify multiple editors, delimited by pipe signs(|).\n\
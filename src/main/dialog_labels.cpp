@@ -14,6 +14,7 @@
 
 #include "main/dialog_labels.h"
 #include "diary/diary.h"
+#include "diary/label_index.h"
 #include "ui/window.h"
 #include "ui/layout.h"
 #include "ui/label.h"
@@ -164,15 +165,19 @@ void WindowLabels::slot_ok ()
 
 } // anonymous namespace
 
-bool edit_labels (WStringLocaleOrderedSet &labels, const std::vector<DiaryEntry *> &entries)
+bool edit_labels (DiaryEntry::LabelList &labels, const LabelIndex &index, LabelDictionary &dictionary)
 {
-	WStringLocaleOrderedSet old_labels = labels;
-	WStringLocaleOrderedSet all_labels; // The union of all label lists
-	for (std::vector<DiaryEntry *>::const_iterator it = entries.begin (); it != entries.end (); ++it) {
-		all_labels.insert ((*it)->labels.begin (), (*it)->labels.end ());
+	WStringLocaleOrderedSet names = labels.names ();
+	WindowLabels (names, index.names ()).event_loop ();
+	DiaryEntry::LabelList new_labels;
+	for (const std::wstring &name : names) {
+		new_labels.insert (dictionary.intern (name));
 	}
-	WindowLabels (labels, all_labels).event_loop ();
-	return (labels != old_labels);
+	if (new_labels == labels) {
+		return false;
+	}
+	labels = std::move (new_labels);
+	return true;
 }
 
 } // namespace tiary
@@ -15,21 +15,21 @@
 #ifndef TIARY_MAIN_DIALOG_LABELS_H
 #define TIARY_MAIN_DIALOG_LABELS_H
 
-#include "common/containers.h"
-#include <vector>
+#include "diary/diary.h"
 
 namespace tiary {
 
+class LabelIndex;
 
-struct DiaryEntry;
 
 /**
  * @brief	Display a window to allow the user to edit labels
  * @param	labels	The set of labels to edit
- * @param	entries	The list of all entries
+ * @param	index	Labels of all entries
+ * @param	dictionary	Where new labels are interned
  * @result	If anything is changed
  */
-bool edit_labels (WStringLocaleOrderedSet &labels, const std::vector<DiaryEntry *> &entries);
+bool edit_labels (DiaryEntry::LabelList &labels, const LabelIndex &index, LabelDictionary &dictionary);
 
 } // namespace tiary
 
@@ -48,20 +48,21 @@ const unsigned view_line_width = 78;
 void write_for_view(MultiLineRichText *mrt,
 		const DiaryEntry &ent, const std::wstring &longtime_format) {
 	mrt->append(PALETTE_ID_SHOW_BOLD, view_line_width, L'=');
-	mrt->append(PALETTE_ID_SHOW_BOLD, ent.title);
+	mrt->append(PALETTE_ID_SHOW_BOLD, ent.title.wide());
 	mrt->append(PALETTE_ID_SHOW_BOLD, view_line_width, L'=');
 	mrt->append(PALETTE_ID_SHOW_NORMAL, ent.local_time.format (longtime_format));
 	if (!ent.labels.empty ()) {
+		WStringLocaleOrderedSet names = ent.labels.names ();
 		mrt->append(PALETTE_ID_SHOW_NORMAL,
-				L"Labels: "sv, join(ent.labels.begin(), ent.labels.end(), L", "sv));
+				L"Labels: "sv, join(names.begin(), names.end(), L", "sv));
 	}
 	mrt->append(PALETTE_ID_SHOW_NORMAL);
 
 	// Text
 	size_t base_offset = mrt->text.length ();
-	mrt->text += ent.text;
+	mrt->text += ent.text.wide();
 	PaletteID palette = PALETTE_ID_SHOW_NORMAL;
-	for (const auto &item: split_line (edit_line_width, ent.text)) {
+	for (const auto &item: split_line (edit_line_width, ent.text.wide())) {
 		size_t begin = base_offset + item.begin;
 		// If a line begins with a space, it's considered the first line of a qutoed paragraph
 		if (item.len && (mrt->text[begin] == L' ')) {
@@ -177,7 +178,7 @@ bool edit_entry (DiaryEntry &ent, const char *editor)
 
 	// There is no universal method to notify the editor of the encoding;
 	// So the best way is to use LC_CTYPE
-	if (!write_for_edit (fd, ent.title, ent.text)) {
+	if (!write_for_edit (fd, ent.title.wide(), ent.text.wide())) {
 		close (fd);
 		unlink (temp_file.c_str ());
 		return error_false(L"Failed to write to temporary file :( Why?"sv);
@@ -222,18 +223,21 @@ bool edit_entry (DiaryEntry &ent, const char *editor)
 		return error_false(L"Failed to read temporary file :( Why?"sv);
 	}
 
-	reformat_content(&ent.title, &ent.text, raw);
+	std::wstring title, text;
+	reformat_content(&title, &text, raw);
+	ent.title = std::move(title);
+	ent.text = std::move(text);
 	return true;
 }
 
 void view_entry (DiaryEntry &ent, const std::wstring &longtime_format)
 {
 	MultiLineRichText mrt;
-	mrt.text.reserve(ent.text.length() + 512);
-	mrt.lines.reserve(ent.text.length() / 32);
+	mrt.text.reserve(ent.text.wide().length() + 512);
+	mrt.lines.reserve(ent.text.wide().length() / 32);
 	write_for_view(&mrt, ent, longtime_format);
 	ui::dialog_richtext (
-			ent.title,
+			ent.title.wide(),
 			std::move(mrt),
 			Size{view_line_width + 3, 0});
 }
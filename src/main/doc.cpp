@@ -54,6 +54,8 @@ void show_doc() {
 		{ui::PALETTE_ID_SHOW_NORMAL, L"    M                    Move the selected entry down"sv},
 		{ui::PALETTE_ID_SHOW_NORMAL, L"    s                    Display statistics info"sv},
 		{ui::PALETTE_ID_SHOW_NORMAL, L"    S                    Sort all entries by date and time"sv},
+		{ui::PALETTE_ID_SHOW_NORMAL, L"    o O                  View entries by time, without reordering them"sv},
+		{ui::PALETTE_ID_SHOW_NORMAL, L"    c C                  Jump to a date"sv},
 		{ui::PALETTE_ID_SHOW_NORMAL, L"    / CTRL+F             Search forward"sv},
 		{ui::PALETTE_ID_SHOW_NORMAL, L"    ?                    Search backward"sv},
 		{ui::PALETTE_ID_SHOW_NORMAL, L"    n F3                 Search next"sv},
@@ -31,6 +31,21 @@
 
 namespace tiary {
 
+namespace {
+
+// Decodes UTF-8 into dst, replacing nonprintable characters with spaces.
+// Returns the end of the decoded string
+wchar_t *decode_printable (wchar_t *dst, std::string_view s)
+{
+	for (size_t i = 0; i < s.length (); ) {
+		char32_t c = utf8_next (s, &i);
+		*dst++ = iswprint (c) ? c : L' ';
+	}
+	return dst;
+}
+
+} // anonymous namespace
+
 MainCtrl::MainCtrl (MainWin &win)
 	: ui::Control (win)
 	, scroll_(1 /* To be set later */, false)
@@ -102,11 +117,7 @@ void MainCtrl::redraw ()
 
 	std::wstring date_format = w().global_options.get_wstring (GLOBAL_OPTION_DATETIME_FORMAT);
 
-	// Build a map to get entry ID from pointer
-	std::map <const DiaryEntry *, unsigned> id_map;
-	for (size_t i=0; i<w().entries.size (); ++i) {
-		id_map.insert (std::make_pair (w().entries[i], i+1));
-	}
+	const EntryTable &table = w().entries;
 	// Is there a filter?
 	const DiaryEntryList &ent_lst = w().get_current_list ();
 
@@ -121,40 +132,46 @@ void MainCtrl::redraw ()
 			clear(pos, ui::Size{get_size().x, expand_lines});
 		}
 		const DiaryEntry &entry = *ent_lst[i+info.first];
+		size_t k = table.find (&entry);
 
 		// Entry ID
-		pos = put(pos, format(L"%04a  "sv, id_map[&entry]));
+		pos = put(pos, format(L"%04a  "sv, unsigned (k + 1)));
 
 		// Date
 		choose_palette (i == info.focus_pos ? ui::PALETTE_ID_ENTRY_DATE_SELECT : ui::PALETTE_ID_ENTRY_DATE);
-		pos = put(pos, entry.local_time.format(date_format));
+		pos = put(pos, format_datetime (table.time (k), date_format));
 		pos.x++;
 
 		// Title
 		SplitStringLine split_info;
-		const std::wstring &title = entry.title;
+		std::string_view title = entry.title.utf8 ();
 		choose_palette (i == info.focus_pos ? ui::PALETTE_ID_ENTRY_TITLE_SELECT : ui::PALETTE_ID_ENTRY_TITLE);
-		split_line(&split_info, maxS (0, get_size().x-pos.x), title, 0, SPLIT_NEWLINE_AS_SPACE|SPLIT_CUT_WORD);
+		unsigned title_wid = maxS (0, get_size().x-pos.x);
+		if (table.title_width (k) <= title_wid) {
+			// The whole title fits
+			split_info.begin = 0;
+			split_info.len = title.length ();
+		} else {
+			split_line(&split_info, title_wid, title, 0, SPLIT_NEWLINE_AS_SPACE|SPLIT_CUT_WORD);
+		}
 		pos = put (pos, disp_buffer,
-				std::replace_copy_if (
-						&title[split_info.begin], &title[split_info.begin+split_info.len],
-						disp_buffer, [](auto x) { return !iswprint(x); }, L' ') - disp_buffer);
+				decode_printable (disp_buffer, title.substr (split_info.begin, split_info.len)) - disp_buffer);
 		pos.x++;
 
 		// Labels
-		const DiaryEntry::LabelList &labels = entry.labels;
+		std::vector<const DiaryLabel *> labels = entry.labels.sorted ();
 		choose_palette (i == info.focus_pos ? ui::PALETTE_ID_ENTRY_LABELS_SELECT : ui::PALETTE_ID_ENTRY_LABELS);
 		int left_wid = get_size().x - pos.x;
-		for (DiaryEntry::LabelList::const_iterator it=labels.begin(); it!=labels.end(); ) {
+		for (auto it=labels.begin(); it!=labels.end(); ) {
 			if (left_wid < 3) {
 				break;
 			}
-			unsigned labelwid = ucs_width (*it);
+			unsigned labelwid = ucs_width ((*it)->name);
 			if (labelwid + 2 > unsigned (left_wid)) {
 				pos = put (pos, L"...", 3);
 				break;
 			}
-			pos = put (pos, *it);
+			pos = put (pos, (*it)->name);
 			if (++it != labels.end ()) {
 				pos = put (pos, L',');
 			}
@@ -162,7 +179,7 @@ void MainCtrl::redraw ()
 		pos.x++;
 
 		choose_palette (i == info.focus_pos ? ui::PALETTE_ID_ENTRY_TEXT_SELECT : ui::PALETTE_ID_ENTRY_TEXT);
-		const std::wstring &text = entry.text;
+		std::string_view text = entry.text.utf8 ();
 		size_t offset = 0;
 		if (i == info.focus_pos && expand_lines >= 2) {
 			// Current entry
@@ -172,9 +189,7 @@ void MainCtrl::redraw ()
 				pos = ui::Size{0, pos.y + 1};
 				offset = split_line(&split_info, get_size().x, text, offset,
 						SPLIT_NEWLINE_AS_SPACE);
-				wchar_t *bufend = std::replace_copy_if (
-						&text[split_info.begin], &text[split_info.begin+split_info.len],
-						disp_buffer, [](auto x) { return !iswprint(x); }, L' ');
+				wchar_t *bufend = decode_printable (disp_buffer, text.substr (split_info.begin, split_info.len));
 				pos = put (pos, disp_buffer, bufend-disp_buffer);
 			}
 		} else {
@@ -182,9 +197,7 @@ void MainCtrl::redraw ()
 			// [Date] [Title] [Labels] [...]
 			offset = split_line(&split_info, maxS (0, get_size().x - pos.x), text, offset,
 					SPLIT_NEWLINE_AS_SPACE|SPLIT_CUT_WORD);
-			wchar_t *bufend = std::replace_copy_if (
-					&text[split_info.begin], &text[split_info.begin+split_info.len],
-					disp_buffer, [](auto x) { return !iswprint(x); }, L' ');
+			wchar_t *bufend = decode_printable (disp_buffer, text.substr (split_info.begin, split_info.len));
 			pos = put (pos, disp_buffer, bufend-disp_buffer);
 		}
 		pos = ui::Size{0, pos.y + 1};
@@ -232,6 +245,8 @@ void MainCtrl::touch ()
 {
 	scroll_.modify_number(w().get_current_list().size());
 	w().saved = false;
+	++w().edit_serial_;
+	w().schedule_autosave ();
 	MainCtrl::redraw ();
 }
 
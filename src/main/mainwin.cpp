@@ -32,6 +32,7 @@
 #include "common/datetime.h"
 #include "common/algorithm.h"
 #include "common/dir.h"
+#include "common/parallel.h"
 #include "main/doc.h"
 #include "main/dialog_filter.h"
 #include "main/dialog_global_pref.h"
@@ -42,7 +43,11 @@
 #include "main/dialog_view_edit.h"
 #include "main/dialog_open_recent.h"
 #include "main/stat.h"
+#include <atomic>
+#include <chrono>
 #include <limits>
+#include <thread>
+#include <sys/stat.h>
 #include <unistd.h>
 
 namespace tiary {
@@ -54,6 +59,7 @@ MainWin::MainWin(std::wstring_view initial_filename)
 	, menu_bar (*this)
 	, context_menu ()
 	, saved (true)
+	, autosave_timer_ ([this] { ui::post_task ([this] { autosave (); }); })
 	, filter_()
 	, main_ctrl (*this)
 	, hotkey_hint (*this)
@@ -76,7 +82,9 @@ MainWin::MainWin(std::wstring_view initial_filename)
 	Signal action_open_recent_file (this, &MainWin::open_recent_file);
 	Signal action_save (this, &MainWin::default_save);
 	Signal action_save_as (this, &MainWin::save_as);
+	Action action_compact (Signal (this, &MainWin::compact_file), Condition (this, &MainWin::query_journal_exists));
 	Signal action_password (this, &MainWin::edit_password);
+	Action action_upgrade_format (Signal (this, &MainWin::upgrade_file_format), Condition (this, &MainWin::query_upgradable_file_format));
 	Action action_statistics (Signal (this, &MainWin::display_statistics), q_nonempty_all);
 	Signal action_quit (this, &MainWin::quit);
 	Action action_append (Signal (this, &MainWin::append), q_normal);
@@ -91,6 +99,8 @@ MainWin::MainWin(std::wstring_view initial_filename)
 	Action action_sort_all (Signal (this, &MainWin::sort_all), q_normal_nonempty);
 	Action action_filter (Signal (this, &MainWin::edit_filter), q_nonempty);
 	Action action_clear_filter (Signal (this, &MainWin::clear_filter), q_filtered);
+	Action action_view_by_time (Signal (this, &MainWin::toggle_view_by_time), q_nonempty_all);
+	Action action_goto_date (Signal (this, &MainWin::goto_date), q_nonempty);
 	Action action_search (Signal (this, &MainWin::search, false), q_nonempty);
 	Action action_search_backward (Signal (this, &MainWin::search, true), q_nonempty);
 	Action action_search_next (Signal (this, &MainWin::search_continue, false), q_search_continue);
@@ -115,8 +125,10 @@ MainWin::MainWin(std::wstring_view initial_filename)
 		()
 		(L"&Save           w Ctrl+S"sv, action_save)
 		(L"Save &as...     W"sv,        action_save_as)
+		(L"&Compact file"sv,            action_compact)
 		()
 		(L"&Password...    p"sv,        action_password)
+		(L"&Upgrade file format..."sv,  action_upgrade_format)
 		()
 		(L"S&tatistics     s"sv,        action_statistics)
 		()
@@ -140,7 +152,10 @@ MainWin::MainWin(std::wstring_view initial_filename)
 		;
 	menu_bar.add(L"&View"sv)
 		(L"&Filter...        CtrL+G"sv, action_filter)
-		(L"&Clear filter     LEFT"sv,   action_clear_filter)
+		(L"&Normal view      LEFT"sv,   action_clear_filter)
+		()
+		(L"By &time          o"sv,      action_view_by_time)
+		(L"&Go to date...    c"sv,      action_goto_date)
 		;
 	menu_bar.add(L"&Search"sv)
 		(L"&Find...        / Ctrl+F"sv, action_search)
@@ -165,6 +180,8 @@ MainWin::MainWin(std::wstring_view initial_filename)
 	main_ctrl.register_hotkey (L'A',         action_append);
 	main_ctrl.register_hotkey (ui::INSERT,   action_append);
 	main_ctrl.register_hotkey (L'b',         action_pageup);
+	main_ctrl.register_hotkey (L'c',         action_goto_date);
+	main_ctrl.register_hotkey (L'C',         action_goto_date);
 	main_ctrl.register_hotkey (ui::PAGEUP,   action_pageup);
 	main_ctrl.register_hotkey (L'd',         action_delete);
 	main_ctrl.register_hotkey (L'D',         action_delete);
@@ -193,6 +210,8 @@ MainWin::MainWin(std::wstring_view initial_filename)
 	main_ctrl.register_hotkey (L'm',         action_move_up);
 	main_ctrl.register_hotkey (L'M',         action_move_down);
 	main_ctrl.register_hotkey (L'n',         action_search_next);
+	main_ctrl.register_hotkey (L'o',         action_view_by_time);
+	main_ctrl.register_hotkey (L'O',         action_view_by_time);
 	main_ctrl.register_hotkey (ui::F3,       action_search_next);
 	main_ctrl.register_hotkey (L'N',         action_search_previous);
 	main_ctrl.register_hotkey (L'p',         action_password);
@@ -224,7 +243,7 @@ MainWin::MainWin(std::wstring_view initial_filename)
 
 	hotkey_hint
 		(8000, L"Esc"sv,     L"Menu"sv,             std::move(action_menu))
-		(7000, L"LEFT"sv,    L"Clear filter"sv,     std::move(action_clear_filter))
+		(7000, L"LEFT"sv,    L"Normal view"sv,      std::move(action_clear_filter))
 		(1000, L"a"sv,       L"New entry"sv,        std::move(action_append))
 		(1000, L"e"sv,       L"Edit"sv,             std::move(action_edit))
 		(1000, L"d"sv,       L"Delete"sv,           std::move(action_delete))
@@ -266,11 +285,46 @@ MainWin::MainWin(std::wstring_view initial_filename)
 	}
 }
 
+struct MainWin::SaveJob {
+	unsigned serial;
+	std::wstring filename;
+	// Snapshot
+	std::vector<DiaryEntry *> entries;
+	PerFileOptionGroup options;
+	std::string password;
+	DiaryFileState state;
+	unsigned edit_serial;
+	bool autosave; ///< Writing the recovery file, not the diary file
+
+	bool ok = false;
+	std::thread thread;
+};
+
+struct MainWin::TextIndexJob {
+	unsigned serial;
+	struct Item {
+		unsigned id;
+		DiaryText title;
+		DiaryText text;
+	};
+	std::vector<Item> snapshot; ///< Sorted by ID
+	std::vector<unsigned> stale; ///< IDs of entries changed since the snapshot
+	TextIndex index;
+	std::atomic<bool> canceled{false};
+	std::thread thread;
+};
+
 MainWin::~MainWin ()
 {
-	for (DiaryEntry *entry: entries) {
-		delete entry;
+	cancel_text_index_job ();
+	if (save_job_) {
+		save_job_->thread.join ();
+	}
+	for (DiaryEntry *entry: retired_entries_) {
+		entry_pool_.destroy (entry);
 	}
+	DiaryEntryList lst = entries.take ();
+	entry_pool_.clear (&lst);
 }
 
 void MainWin::redraw ()
@@ -286,15 +340,24 @@ void MainWin::redraw ()
 
 void MainWin::on_ready ()
 {
+	// Dialogs are all closed now
+	start_pending_save ();
+
 	// Update the status string on the right-hand side of the menubar
 	// [+] [Filtering] [Filename]
 	std::wstring status;
 	if (!saved) {
 		status = L"+ "sv;
 	}
+	if (save_job_) {
+		status += save_job_->autosave ? L"[Autosaving] "sv : L"[Saving] "sv;
+	}
 	if (filter_) {
 		status += L"[Filter] "sv;
 	}
+	if (view_by_time_) {
+		status += L"[By time] "sv;
+	}
 	if (current_filename_.empty ()) {
 		status += L"<New file>"sv;
 	} else {
@@ -306,8 +369,15 @@ void MainWin::on_ready ()
 
 void MainWin::updated_filter ()
 {
-	if (filter_) {
-		filtered_entries_.emplace(filter_->filter(entries));
+	const TextIndex *text_index = text_index_ready_ ? &text_index_ : nullptr;
+	if (filter_ && view_by_time_) {
+		filtered_entries_.emplace(filter_->filter(entries.time_ordered (), {&label_index_, &entries, true, text_index}));
+		main_ctrl.modify_number(filtered_entries_->size ());
+	} else if (filter_) {
+		filtered_entries_.emplace(filter_->filter(entries.list (), {&label_index_, &entries, false, text_index}));
+		main_ctrl.modify_number(filtered_entries_->size ());
+	} else if (view_by_time_) {
+		filtered_entries_.emplace(entries.time_ordered ());
 		main_ctrl.modify_number(filtered_entries_->size ());
 	} else {
 		filtered_entries_.reset ();
@@ -318,9 +388,9 @@ void MainWin::updated_filter ()
 
 bool MainWin::unavailable_filtered ()
 {
-	if (filter_) {
+	if (!query_normal_mode ()) {
 		ui::dialog_message (
-				L"This operation cannot be done in filtered mode.\n"
+				L"This operation cannot be done in filtered mode or when viewing by time.\n"
 				L"Pressed LEFT to return to normal mode."sv);
 		return false;
 	}
@@ -344,14 +414,20 @@ void MainWin::load(std::wstring_view filename) {
 				ui::INPUT_PASSWORD));
 	};
 
+	DiaryEntryList loaded_entries;
 	LoadFileRet load_ret = load_file (wstring_to_mbs (full_filename).c_str (),
 				enter_password,
-				entries,
+				loaded_entries,
+				entry_pool_,
 				per_file_options,
-				password_);
+				password_,
+				file_state_);
+	entries.assign (std::move (loaded_entries));
 	switch (load_ret) {
 		case LOAD_FILE_SUCCESS:
 			current_filename_ = full_filename;
+			label_index_.rebuild (entries.list ());
+			start_text_index_job ();
 			main_ctrl.touch ();
 			saved = true;
 			{
@@ -360,6 +436,7 @@ void MainWin::load(std::wstring_view filename) {
 					main_ctrl.set_focus (it->focus_entry);
 				}
 			}
+			load_recovery ();
 			return;
 
 		case LOAD_FILE_OBSOLETE:
@@ -377,6 +454,7 @@ void MainWin::load(std::wstring_view filename) {
 			break;
 		case LOAD_FILE_BUNZIP2:
 		case LOAD_FILE_XML:
+		case LOAD_FILE_CHECKSUM:
 			error_info = format(L"File format error: %a"sv, nice_filename);
 			break;
 		case LOAD_FILE_DECRYPTION:
@@ -399,15 +477,106 @@ void MainWin::load(std::wstring_view filename) {
 }
 
 void MainWin::save(std::wstring_view filename) {
-	std::wstring_view fmt;
-	if (save_file(wstring_to_mbs(filename).c_str(), entries, per_file_options, password_)) {
-		current_filename_ = filename;
-		saved = true;
-		fmt = L"Successfully saved \"%a\"."sv;
+	if (save_job_) {
+		// Save again when it finishes.  Multiple requests are merged into one
+		pending_save_.emplace(filename);
+		return;
+	}
+
+	auto job = std::make_unique<SaveJob>();
+	job->serial = ++save_serial_;
+	job->filename = filename;
+	job->entries = entries.list ();
+	job->options = per_file_options;
+	job->password = password_;
+	job->edit_serial = edit_serial_;
+	job->autosave = false;
+
+	// The save gets the cached segments and the changes so far, and
+	// we go on recording later changes
+	std::map<DiaryFileState::Checksum, std::string> segments;
+	segments.swap(file_state_.segments);
+	DiaryJournal changes = file_state_.journal.take();
+	job->state = file_state_;
+	job->state.segments.swap(segments);
+	job->state.journal = std::move(changes);
+	start_save_job (std::move (job));
+}
+
+void MainWin::start_save_job (std::unique_ptr<SaveJob> job)
+{
+	SaveJob *p = job.get();
+	job->thread = std::thread([this, p, mbs_filename = wstring_to_mbs(p->filename)] {
+		p->ok = save_file(mbs_filename.c_str(), p->entries, p->options, p->password, p->state);
+		ui::post_task([this, serial = p->serial] {
+			if (save_job_ && save_job_->serial == serial) {
+				finish_save ();
+			}
+		});
+	});
+	save_job_ = std::move(job);
+}
+
+void MainWin::finish_save ()
+{
+	std::unique_ptr<SaveJob> job = std::move(save_job_);
+	job->thread.join ();
+
+	// Nobody else is using them now
+	for (DiaryEntry *entry: retired_entries_) {
+		entry_pool_.destroy (entry);
+	}
+	retired_entries_.clear ();
+
+	if (job->autosave) {
+		// Failures are silently ignored. We'll try again after more changes
+		autosave_state_ = std::move(job->state);
+		if (job->ok) {
+			autosave_filename_ = std::move(job->filename);
+		}
+	} else if (job->ok) {
+		DiaryJournal changes = std::move(file_state_.journal);
+		file_state_ = std::move(job->state);
+		file_state_.journal = std::move(changes);
+		// Modifications made during the save are not saved yet
+		if (edit_serial_ == job->edit_serial) {
+			saved = true;
+			discard_recovery ();
+		}
+		if (current_filename_ != job->filename) {
+			current_filename_ = std::move(job->filename);
+			update_recent_files ();
+		}
 	} else {
-		fmt = L"Cannot save file \"%a\"."sv;
+		file_state_.segments = std::move(job->state.segments);
+		file_state_.journal.restore(std::move(job->state.journal));
+		ui::dialog_message(format(L"Cannot save file \"%a\"."sv, job->filename));
+	}
+
+	start_pending_save ();
+}
+
+void MainWin::start_pending_save ()
+{
+	// A dialog above us may hold an entry it is modifying
+	if (save_job_ || get_top_window ()) {
+		return;
+	}
+	if (pending_save_) {
+		std::wstring filename = std::move(*pending_save_);
+		pending_save_.reset ();
+		save(filename);
+	} else if (autosave_pending_) {
+		autosave_pending_ = false;
+		autosave ();
+	}
+}
+
+void MainWin::wait_save ()
+{
+	while (save_job_) {
+		finish_save ();
 	}
-	ui::dialog_message(format(fmt, filename));
 }
 
 void MainWin::default_save ()
@@ -436,30 +605,23 @@ void MainWin::append ()
 {
 	if (!unavailable_filtered ())
 		return;
-	DiaryEntry *ent = new DiaryEntry{
+	DiaryEntry *ent = entry_pool_.create (
 		DateTime(DateTime::LOCAL, time(nullptr)),
 		std::wstring(L"Your title goes here."sv),
 		std::wstring(L"Your contents go here."sv),
-		{}
-	};
+		DiaryEntry::LabelList()
+	);
 	if (edit_entry (*ent, global_options.get (GLOBAL_OPTION_EDITOR).c_str())
 			&& (!ent->title.empty () || !ent->text.empty ())) {
 		entries.push_back (ent);
+		label_index_.add (ent);
+		text_changed (ent->id, {}, {}, ent);
+		file_state_.journal.insert (entries.size () - 1, *ent);
 		main_ctrl.touch ();
 		main_ctrl.set_focus (std::numeric_limits<int>::max ());
 	}
 	else {
-		delete ent;
-	}
-}
-
-DiaryEntryList &MainWin::get_current_list ()
-{
-	if (filtered_entries_) {
-		return *filtered_entries_;
-	}
-	else {
-		return entries;
+		entry_pool_.destroy (ent);
 	}
 }
 
@@ -469,13 +631,13 @@ const DiaryEntryList &MainWin::get_current_list () const
 		return *filtered_entries_;
 	}
 	else {
-		return entries;
+		return entries.list ();
 	}
 }
 
 DiaryEntry *MainWin::get_current ()
 {
-	DiaryEntryList &lst = get_current_list ();
+	const DiaryEntryList &lst = get_current_list ();
 	if (lst.empty ()) {
 		return 0;
 	}
@@ -484,15 +646,39 @@ DiaryEntry *MainWin::get_current ()
 	}
 }
 
+void MainWin::focus_entry (const DiaryEntry *ent)
+{
+	const DiaryEntryList &lst = get_current_list ();
+	size_t k;
+	if (!filtered_entries_) {
+		k = entries.find (ent);
+	} else if (!filter_) {
+		k = entries.time_rank (ent);
+	} else {
+		k = std::find (lst.begin (), lst.end (), ent) - lst.begin ();
+	}
+	if (k < lst.size ()) {
+		main_ctrl.set_focus (k);
+	}
+}
+
 void MainWin::edit_current ()
 {
 	if (DiaryEntry *ent = get_current ()) {
+		ent = writable_entry (ent);
 		DateTime edit_time = DateTime (DateTime::LOCAL);
+		DiaryText old_title = ent->title.share ();
+		DiaryText old_text = ent->text.share ();
 		if (edit_entry (*ent, global_options.get (GLOBAL_OPTION_EDITOR).c_str())) {
 			if (per_file_options.get_bool (PERFILE_OPTION_MODTIME)) {
 				ent->local_time = edit_time;
 			}
+			text_changed (ent->id, old_title.utf8 (), old_text.utf8 (), ent);
+			journal_replace (ent);
 			updated_filter ();
+			if (view_by_time_) {
+				focus_entry (ent);
+			}
 			main_ctrl.touch ();
 		}
 	}
@@ -501,7 +687,13 @@ void MainWin::edit_current ()
 void MainWin::edit_labels_current ()
 {
 	if (DiaryEntry *ent = get_current ()) {
-		if (edit_labels (ent->labels, entries)) {
+		DiaryEntry::LabelList labels = ent->labels;
+		if (edit_labels (labels, label_index_, entry_pool_.labels ())) {
+			ent = writable_entry (ent);
+			label_index_.remove (ent);
+			ent->labels = std::move (labels);
+			label_index_.add (ent);
+			journal_replace (ent);
 			updated_filter ();
 			main_ctrl.touch ();
 		}
@@ -511,7 +703,14 @@ void MainWin::edit_labels_current ()
 void MainWin::edit_time_current ()
 {
 	if (DiaryEntry *ent = get_current ()) {
+		ent = writable_entry (ent);
 		if (edit_entry_time (*ent)) {
+			journal_replace (ent);
+			// The new time may move the entry, or put it in or out of the filter
+			if (filter_ || view_by_time_) {
+				updated_filter ();
+				focus_entry (ent);
+			}
 			main_ctrl.touch ();
 		}
 	}
@@ -530,8 +729,11 @@ void MainWin::remove_current ()
 	if (ui::dialog_message (
 				L"Are you sure to remove the currently selected entry?"sv,
 				ui::MESSAGE_YES|ui::MESSAGE_NO|ui::MESSAGE_DEFAULT_NO) == ui::MESSAGE_YES) {
-		delete entries[k];
-		entries.erase (entries.begin () + k);
+		label_index_.remove (entries[k]);
+		text_changed (entries[k]->id, entries[k]->title.utf8 (), entries[k]->text.utf8 (), nullptr);
+		retire_entry (entries[k]);
+		entries.erase (k);
+		file_state_.journal.remove (k);
 		main_ctrl.touch ();
 	}
 }
@@ -548,7 +750,8 @@ void MainWin::move_up_current ()
 	if (k == 0) {
 		return;
 	}
-	std::swap (entries[k-1], entries[k]);
+	entries.swap (k-1);
+	file_state_.journal.swap (k-1);
 	main_ctrl.touch ();
 	main_ctrl.set_focus (k-1);
 }
@@ -565,22 +768,12 @@ void MainWin::move_down_current ()
 	if (k+1 >= entries.size ()) {
 		return;
 	}
-	std::swap (entries[k+1], entries[k]);
+	entries.swap (k);
+	file_state_.journal.swap (k);
 	main_ctrl.touch ();
 	main_ctrl.set_focus (k+1);
 }
 
-namespace {
-
-struct CompareEntry {
-	bool operator () (const DiaryEntry *a, const DiaryEntry *b) const
-	{
-		return (a->local_time < b->local_time);
-	}
-};
-
-} // anonymous namespace
-
 void MainWin::sort_all ()
 {
 	if (!unavailable_filtered ()) {
@@ -588,7 +781,8 @@ void MainWin::sort_all ()
 	}
 	if (ui::dialog_message(L"Are you sure you want to sort all entries by time? This operation cannot be undone."sv,
 				ui::MESSAGE_YES|ui::MESSAGE_NO|ui::MESSAGE_DEFAULT_NO) == ui::MESSAGE_YES) {
-		std::stable_sort (entries.begin (), entries.end (), CompareEntry ());
+		entries.stable_sort_by_time ();
+		file_state_.journal.sort ();
 		main_ctrl.touch ();
 	}
 }
@@ -602,7 +796,7 @@ void MainWin::view_current ()
 
 void MainWin::view_all ()
 {
-	DiaryEntryList &lst = get_current_list ();
+	const DiaryEntryList &lst = get_current_list ();
 	if (!lst.empty ()) {
 		view_all_entries (lst, global_options.get_wstring (GLOBAL_OPTION_LONGTIME_FORMAT));
 	}
@@ -618,6 +812,7 @@ void MainWin::view_all ()
  */
 bool MainWin::check_save ()
 {
+	wait_save ();
 	update_recent_files ();
 	if (saved) {
 		return true;
@@ -629,8 +824,10 @@ bool MainWin::check_save ()
 				ui::MESSAGE_YES|ui::MESSAGE_NO|ui::MESSAGE_CANCEL)) {
 		case ui::MESSAGE_YES:
 			default_save ();
+			wait_save ();
 			return saved;
 		case ui::MESSAGE_NO:
+			discard_recovery ();
 			return true;
 		case ui::MESSAGE_CANCEL:
 		default:
@@ -670,6 +867,267 @@ void MainWin::update_recent_files ()
 	}
 }
 
+void MainWin::compact_file ()
+{
+	// Merge the journal file into the diary file
+	file_state_.journal.request_compaction ();
+	save (current_filename_);
+}
+
+void MainWin::schedule_autosave ()
+{
+	unsigned idle = global_options.get_num (GLOBAL_OPTION_AUTOSAVE_IDLE);
+	unsigned edits = global_options.get_num (GLOBAL_OPTION_AUTOSAVE_EDITS);
+	if (edits && edit_serial_ - autosave_serial_ >= edits) {
+		autosave_timer_.schedule (DelayedCall::Clock::duration::zero ());
+	} else if (idle) {
+		// Every modification postpones it, so a burst of them only makes one autosave
+		autosave_timer_.schedule (std::chrono::seconds (idle));
+	} else {
+		autosave_timer_.cancel ();
+	}
+}
+
+void MainWin::autosave ()
+{
+	std::wstring filename = recovery_filename ();
+	if (saved || edit_serial_ == autosave_serial_ || filename.empty ()) {
+		return;
+	}
+	if (save_job_ || get_top_window ()) {
+		// Retried by finish_save or on_ready
+		autosave_pending_ = true;
+		return;
+	}
+	if (autosave_filename_ != filename) {
+		// The diary has been saved under another name
+		if (!autosave_filename_.empty ()) {
+			unlink (wstring_to_mbs (autosave_filename_).c_str ());
+			autosave_filename_.clear ();
+		}
+		autosave_state_ = DiaryFileState ();
+	}
+	autosave_serial_ = edit_serial_;
+
+	auto job = std::make_unique<SaveJob>();
+	job->serial = ++save_serial_;
+	job->filename = std::move (filename);
+	job->entries = entries.list ();
+	job->options = per_file_options;
+	job->password = password_;
+	job->edit_serial = edit_serial_;
+	job->autosave = true;
+	// The recovery file is always written as a whole, reusing the
+	// segments that have not changed since the last autosave
+	job->state = std::move (autosave_state_);
+	job->state.journal.request_compaction ();
+	start_save_job (std::move (job));
+	redraw ();
+}
+
+std::wstring MainWin::recovery_filename () const
+{
+	if (current_filename_.empty ()) {
+		return std::wstring ();
+	}
+	return current_filename_ + L".recovery";
+}
+
+void MainWin::discard_recovery ()
+{
+	autosave_timer_.cancel ();
+	if (!autosave_filename_.empty ()) {
+		unlink (wstring_to_mbs (autosave_filename_).c_str ());
+		autosave_filename_.clear ();
+	}
+	autosave_state_ = DiaryFileState ();
+	autosave_serial_ = edit_serial_;
+	autosave_pending_ = false;
+}
+
+void MainWin::load_recovery ()
+{
+	std::wstring filename = recovery_filename ();
+	std::string mbs_filename = wstring_to_mbs (filename);
+	struct stat recovery_st;
+	if (stat (mbs_filename.c_str (), &recovery_st) != 0) {
+		return;
+	}
+
+	// A recovery file older than the diary file (or its journal file) is
+	// left over from changes that have been saved since
+	std::string mbs_diary = wstring_to_mbs (current_filename_);
+	struct stat st;
+	if ((stat (mbs_diary.c_str (), &st) == 0 && st.st_mtime > recovery_st.st_mtime) ||
+			(stat ((mbs_diary + ".journal").c_str (), &st) == 0 && st.st_mtime > recovery_st.st_mtime)) {
+		unlink (mbs_filename.c_str ());
+		return;
+	}
+
+	if (ui::dialog_message (
+				format (L"Unsaved changes to \"%a\" were found in an autosaved recovery file.\n"
+					L"Do you want to recover them?"sv, get_nice_pathname (current_filename_)),
+				ui::MESSAGE_YES|ui::MESSAGE_NO) != ui::MESSAGE_YES) {
+		unlink (mbs_filename.c_str ());
+		return;
+	}
+
+	// The recovery file is usually encrypted with the same password.
+	// If it isn't (e.g., the password was changed since), ask the user
+	std::wstring nice_filename = get_nice_pathname (filename);
+	bool use_current_password = !password_.empty ();
+	auto enter_password = [this, &nice_filename, &use_current_password]() -> std::string {
+		if (use_current_password) {
+			return password_;
+		}
+		return wstring_to_utf8(ui::dialog_input2(
+				L"Enter password"sv,
+				format(L"File \"%a\" is password protected. Please enter the password:"sv, nice_filename),
+				std::wstring(),
+				35,
+				ui::INPUT_PASSWORD));
+	};
+
+	std::vector<DiaryEntry *> recovered_entries;
+	DiaryEntryPool recovered_pool;
+	PerFileOptionGroup recovered_options;
+	std::string password;
+	DiaryFileState state;
+	LoadFileRet ret = load_file (mbs_filename.c_str (), enter_password, recovered_entries, recovered_pool,
+			recovered_options, password, state);
+	if (ret == LOAD_FILE_PASSWORD && use_current_password) {
+		use_current_password = false;
+		ret = load_file (mbs_filename.c_str (), enter_password, recovered_entries, recovered_pool,
+				recovered_options, password, state);
+	}
+	if (ret != LOAD_FILE_SUCCESS) {
+		ui::dialog_message (format (L"Cannot load recovery file \"%a\"."sv, nice_filename));
+		return;
+	}
+
+	cancel_text_index_job ();
+	DiaryEntryList old_entries = entries.take ();
+	entry_pool_.clear (&old_entries);
+	entries.assign (std::move (recovered_entries));
+	entry_pool_ = std::move (recovered_pool);
+	label_index_.rebuild (entries.list ());
+	start_text_index_job ();
+	per_file_options = std::move (recovered_options);
+	password_ = std::move (password);
+	// Entries are replaced as a whole. The next save rewrites the diary file
+	file_state_.journal.reset (entries.size ());
+	file_state_.journal.request_compaction ();
+	autosave_filename_ = std::move (filename);
+	main_ctrl.touch ();
+	autosave_serial_ = edit_serial_;
+}
+
+void MainWin::start_text_index_job ()
+{
+	cancel_text_index_job ();
+
+	auto job = std::make_unique<TextIndexJob>();
+	job->serial = ++text_index_serial_;
+	job->snapshot.reserve (entries.size ());
+	for (const DiaryEntry *ent: entries) {
+		job->snapshot.push_back ({ent->id, ent->title.share (), ent->text.share ()});
+	}
+
+	TextIndexJob *p = job.get ();
+	job->thread = std::thread ([this, p] {
+		std::sort (p->snapshot.begin (), p->snapshot.end (),
+				[](const TextIndexJob::Item &a, const TextIndexJob::Item &b) { return a.id < b.id; });
+		for (const TextIndexJob::Item &item: p->snapshot) {
+			if (p->canceled.load (std::memory_order_relaxed)) {
+				return;
+			}
+			p->index.add (item.id, item.title.utf8 (), item.text.utf8 ());
+		}
+		ui::post_task ([this, serial = p->serial] {
+			if (text_index_job_ && text_index_job_->serial == serial) {
+				finish_text_index_job ();
+			}
+		});
+	});
+	text_index_job_ = std::move (job);
+}
+
+void MainWin::finish_text_index_job ()
+{
+	std::unique_ptr<TextIndexJob> job = std::move (text_index_job_);
+	job->thread.join ();
+
+	text_index_ = std::move (job->index);
+	std::sort (job->stale.begin (), job->stale.end ());
+	job->stale.erase (std::unique (job->stale.begin (), job->stale.end ()), job->stale.end ());
+	for (unsigned id: job->stale) {
+		auto it = std::lower_bound (job->snapshot.begin (), job->snapshot.end (), id,
+				[](const TextIndexJob::Item &item, unsigned id) { return item.id < id; });
+		if (it != job->snapshot.end () && it->id == id) {
+			text_index_.remove (id, it->title.utf8 (), it->text.utf8 ());
+		}
+		if (const DiaryEntry *ent = entries.by_id (id)) {
+			text_index_.add (id, ent->title.utf8 (), ent->text.utf8 ());
+		}
+	}
+	text_index_ready_ = true;
+}
+
+void MainWin::cancel_text_index_job ()
+{
+	if (text_index_job_) {
+		text_index_job_->canceled = true;
+		text_index_job_->thread.join ();
+		text_index_job_.reset ();
+	}
+	text_index_.clear ();
+	text_index_ready_ = false;
+}
+
+void MainWin::text_changed (unsigned id, std::string_view old_title, std::string_view old_text, const DiaryEntry *entry)
+{
+	if (text_index_job_) {
+		text_index_job_->stale.push_back (id);
+	} else if (text_index_ready_) {
+		text_index_.remove (id, old_title, old_text);
+		if (entry) {
+			text_index_.add (id, entry->title.utf8 (), entry->text.utf8 ());
+		}
+	}
+}
+
+void MainWin::journal_replace (const DiaryEntry *ent)
+{
+	size_t pos = entries.find (ent);
+	entries.update (pos);
+	file_state_.journal.replace (pos, *ent);
+}
+
+DiaryEntry *MainWin::writable_entry (DiaryEntry *ent)
+{
+	if (!save_job_) {
+		return ent;
+	}
+	// The entry may be in the snapshot being saved. Modify a copy instead
+	DiaryEntry *copy = entry_pool_.create (*ent);
+	entries.set (entries.find (ent), copy);
+	label_index_.replace (ent, copy);
+	if (filtered_entries_) {
+		std::replace (filtered_entries_->begin (), filtered_entries_->end (), ent, copy);
+	}
+	retired_entries_.push_back (ent);
+	return copy;
+}
+
+void MainWin::retire_entry (DiaryEntry *ent)
+{
+	if (save_job_) {
+		retired_entries_.push_back (ent);
+	} else {
+		entry_pool_.destroy (ent);
+	}
+}
+
 void MainWin::new_file ()
 {
 	if (check_save ()) {
@@ -719,7 +1177,7 @@ void MainWin::edit_filter ()
 	if (!filter_) {
 		filter_.reset(new FilterGroup);
 	}
-	dialog_filter(entries, *filter_);
+	dialog_filter(label_index_, *filter_);
 	if (filter_->empty ()) {
 		filter_.reset ();
 	}
@@ -728,9 +1186,56 @@ void MainWin::edit_filter ()
 
 void MainWin::clear_filter ()
 {
-	if (filter_) {
+	if (filter_ || view_by_time_) {
+		const DiaryEntry *ent = get_current ();
 		filter_.reset();
+		view_by_time_ = false;
 		updated_filter ();
+		if (ent) {
+			focus_entry (ent);
+		}
+	}
+}
+
+void MainWin::toggle_view_by_time ()
+{
+	const DiaryEntry *ent = get_current ();
+	view_by_time_ = !view_by_time_;
+	updated_filter ();
+	if (ent) {
+		focus_entry (ent);
+	}
+}
+
+void MainWin::goto_date ()
+{
+	const DiaryEntryList &lst = get_current_list ();
+	if (lst.empty ()) {
+		return;
+	}
+	Date date = get_current ()->local_time;
+	if (!select_date (date)) {
+		return;
+	}
+	// Go to the first entry on or after the date, or the last one if there's none
+	uint64_t t = DateTime (date, Time ()).get_value ();
+	if (!filter_) {
+		size_t rank = std::min (entries.time_lower_bound (t), entries.size () - 1);
+		focus_entry (entries.by_time (rank));
+	} else if (view_by_time_) {
+		auto it = std::partition_point (lst.begin (), lst.end (),
+				[t](const DiaryEntry *ent) { return ent->local_time.get_value () < t; });
+		main_ctrl.set_focus (std::min<size_t> (it - lst.begin (), lst.size () - 1));
+	} else {
+		size_t k = 0;
+		for (size_t i = 1; i < lst.size (); ++i) {
+			uint64_t v = lst[i]->local_time.get_value ();
+			uint64_t best = lst[k]->local_time.get_value ();
+			if (best < t ? v > best : (v >= t && v < best)) {
+				k = i;
+			}
+		}
+		main_ctrl.set_focus (k);
 	}
 }
 
@@ -756,7 +1261,7 @@ void MainWin::search_continue (bool bkwd)
 
 void MainWin::do_search (bool bkwd, bool include_current_entry)
 {
-	DiaryEntryList &entry_list = get_current_list ();
+	const DiaryEntryList &entry_list = get_current_list ();
 	unsigned num_ents = entry_list.size ();
 	if (num_ents == 0) {
 		return;
@@ -769,9 +1274,52 @@ void MainWin::do_search (bool bkwd, bool include_current_entry)
 	if (!include_current_entry) {
 		k += inc;
 	}
-	for (; k < num_ents; k += inc) {
-		if (last_search.basic_match (entry_list[k]->title) || last_search.basic_match (entry_list[k]->text)) {
-			main_ctrl.set_focus (k);
+	auto match = [this, &entry_list] (size_t k) {
+		return last_search.basic_match_utf8 (entry_list[k]->title.utf8 ()) || last_search.basic_match_utf8 (entry_list[k]->text.utf8 ());
+	};
+
+	// With the text index, only entries containing the words of the pattern are verified
+	std::optional<std::vector<unsigned>> ids;
+	if (text_index_ready_ && !last_search.get_matcher ().get_use_regex ()) {
+		ids = text_index_.candidates (last_search.get_matcher ().get_pattern ());
+	}
+	// Entries are tried in the order of the search, in several threads;
+	// the earliest match wins
+	if (k < num_ents && ids && !filter_) {
+		std::vector<size_t> positions;
+		positions.reserve (ids->size ());
+		for (unsigned id: *ids) {
+			if (const DiaryEntry *ent = entries.by_id (id)) {
+				positions.push_back (view_by_time_ ? entries.time_rank (ent) : entries.find (ent));
+			}
+		}
+		std::sort (positions.begin (), positions.end ());
+		if (inc > 0) {
+			size_t from = std::lower_bound (positions.begin (), positions.end (), k) - positions.begin ();
+			size_t i = parallel_find_first (positions.size () - from, [&] (size_t i) { return match (positions[from + i]); });
+			if (from + i < positions.size ()) {
+				main_ctrl.set_focus (positions[from + i]);
+				return;
+			}
+		} else {
+			size_t to = std::upper_bound (positions.begin (), positions.end (), k) - positions.begin ();
+			size_t i = parallel_find_first (to, [&] (size_t i) { return match (positions[to - 1 - i]); });
+			if (i < to) {
+				main_ctrl.set_focus (positions[to - 1 - i]);
+				return;
+			}
+		}
+	} else if (k < num_ents) {
+		size_t count = (inc > 0) ? num_ents - k : k + 1;
+		size_t i = parallel_find_first (count, [&] (size_t i) {
+			size_t pos = k + ptrdiff_t (i) * inc;
+			if (ids && !std::binary_search (ids->begin (), ids->end (), entry_list[pos]->id)) {
+				return false;
+			}
+			return match (pos);
+		});
+		if (i < count) {
+			main_ctrl.set_focus (k + ptrdiff_t (i) * inc);
 			return;
 		}
 	}
@@ -781,13 +1329,24 @@ void MainWin::do_search (bool bkwd, bool include_current_entry)
 
 void MainWin::reset_file ()
 {
+	wait_save ();
+	autosave_timer_.cancel ();
+	autosave_filename_.clear ();
+	autosave_state_ = DiaryFileState ();
+	autosave_serial_ = edit_serial_;
+	autosave_pending_ = false;
 	per_file_options.reset ();
 	current_filename_.clear ();
 	password_.clear();
-	for (DiaryEntry *entry: entries) {
-		delete entry;
-	}
-	entries.clear ();
+	file_state_ = DiaryFileState();
+	cancel_text_index_job ();
+	filter_.reset ();
+	view_by_time_ = false;
+	filtered_entries_.reset ();
+	label_index_.clear ();
+	stat_cache_.clear ();
+	DiaryEntryList lst = entries.take ();
+	entry_pool_.clear (&lst);
 }
 
 void MainWin::edit_password ()
@@ -835,9 +1394,42 @@ void MainWin::edit_password ()
 	}
 }
 
+void MainWin::upgrade_file_format ()
+{
+	// The save in progress may change file_state_
+	wait_save ();
+	if (ui::dialog_message(L"This file is in an old encrypted format. "
+				L"Convert it to the new format, which loads and saves faster?\n"
+				L"Tiary versions before 2024 cannot open files in the new format."sv,
+				ui::MESSAGE_YES|ui::MESSAGE_NO) == ui::MESSAGE_YES) {
+		file_state_.format = DiaryFileFormat::kSegmented;
+		file_state_.journal.request_compaction ();
+		main_ctrl.touch ();
+		ui::dialog_message(L"The file will be converted when it's saved."sv);
+	}
+}
+
 void MainWin::edit_all_labels ()
 {
-	if (tiary::edit_all_labels (entries)) {
+	if (save_job_) {
+		// Any entry may be modified
+		for (size_t i = 0; i < entries.size (); ++i) {
+			retired_entries_.push_back (entries[i]);
+			entries.set (i, entry_pool_.create (*entries[i]));
+		}
+		label_index_.rebuild (entries.list ());
+		updated_filter ();
+	}
+
+	std::vector<DiaryEntry *> modified = tiary::edit_all_labels (label_index_, entry_pool_.labels ());
+	if (!modified.empty ()) {
+		for (size_t i = 0; i < entries.size (); ++i) {
+			if (std::binary_search (modified.begin (), modified.end (), entries[i])) {
+				entries.update (i);
+				file_state_.journal.replace (i, *entries[i]);
+			}
+		}
+		updated_filter ();
 		main_ctrl.touch ();
 	}
 }
@@ -852,6 +1444,7 @@ void MainWin::edit_global_options ()
 void MainWin::edit_perfile_options ()
 {
 	if (tiary::edit_perfile_options (per_file_options)) {
+		file_state_.journal.set_options (per_file_options);
 		main_ctrl.touch ();
 	}
 }
@@ -859,7 +1452,8 @@ void MainWin::edit_perfile_options ()
 void MainWin::display_statistics ()
 {
 	if (!entries.empty ()) {
-		tiary::display_statistics(entries, filtered_entries_ ? &*filtered_entries_ : nullptr, get_current());
+		tiary::display_statistics(entries, filtered_entries_ ? &*filtered_entries_ : nullptr, get_current(),
+				entry_pool_.memory_usage(), &stat_cache_);
 	}
 }
 
@@ -872,12 +1466,12 @@ void MainWin::quit ()
 
 bool MainWin::query_normal_mode () const
 {
-	return !filter_;
+	return !filter_ && !view_by_time_;
 }
 
 bool MainWin::query_filter_mode () const
 {
-	return static_cast<bool>(filter_);
+	return filter_ || view_by_time_;
 }
 
 bool MainWin::query_nonempty_filtered () const
@@ -905,4 +1499,14 @@ bool MainWin::query_search_continuable () const
 	return (query_nonempty_filtered() && !last_search.get_matcher().get_pattern().empty());
 }
 
+bool MainWin::query_journal_exists () const
+{
+	return (file_state_.journal_size != 0);
+}
+
+bool MainWin::query_upgradable_file_format () const
+{
+	return (!password_.empty() && file_state_.format == DiaryFileFormat::kEncrypted2018);
+}
+
 } // namespace tiary
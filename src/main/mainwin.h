@@ -27,7 +27,13 @@
 #include "ui/search_info.h"
 #include "diary/config.h"
 #include "diary/diary.h"
+#include "diary/entry_table.h"
+#include "diary/file.h"
+#include "diary/label_index.h"
+#include "diary/text_index.h"
 #include "main/mainctrl.h"
+#include "main/stat.h"
+#include "common/delayed_call.h"
 #include <memory>
 #include <optional>
 #include <string>
@@ -62,12 +68,55 @@ private:
 
 	std::wstring current_filename_; ///< Currently working filename. Empty = none
 	std::string password_; ///< Password. Empty = none
-	std::vector<DiaryEntry *> entries; ///< Diary entries
+	DiaryFileState file_state_; ///< Format etc. of the file last loaded or saved
+	EntryTable entries; ///< Diary entries
+	DiaryEntryPool entry_pool_; ///< Where entries are allocated
+	LabelIndex label_index_; ///< Must be updated whenever entries or their labels change
+	StatCache stat_cache_;
+	TextIndex text_index_; ///< Valid only if text_index_ready_. See text_changed
+	bool text_index_ready_ = false;
 	RecentFileList recent_files; ///< Recent files
 	bool saved; ///< Whether all modifications have been saved
+	unsigned edit_serial_ = 0; ///< Increased by every modification
+
+	/**
+	 * Files are saved in a background thread, from a snapshot of entries
+	 * and options.  Entries in the snapshot must not be modified or deleted
+	 * until the save finishes; see writable_entry and retire_entry.
+	 *
+	 * Posted tasks also run in the event loops of dialogs, which may be
+	 * modifying an entry in place.  Saves not directly requested by the
+	 * user are therefore started only when no dialog is open.
+	 */
+	struct SaveJob;
+	std::unique_ptr<SaveJob> save_job_; ///< The save in progress
+	unsigned save_serial_ = 0;
+	std::optional<std::wstring> pending_save_; ///< Another save requested while save_job_ is in progress
+	std::vector<DiaryEntry *> retired_entries_; ///< Entries to delete when save_job_ finishes
+
+	/**
+	 * Unsaved changes are periodically written to a recovery file next to
+	 * the diary file (autosave).  The diary file itself is never written
+	 * unless the user asks to.
+	 */
+	DelayedCall autosave_timer_; ///< Posts autosave to the UI thread
+	std::wstring autosave_filename_; ///< The recovery file we have written. Empty = none
+	DiaryFileState autosave_state_; ///< Cached segments of the recovery file
+	unsigned autosave_serial_ = 0; ///< edit_serial_ of the last autosave
+	bool autosave_pending_ = false; ///< Autosave when save_job_ finishes or the dialogs are closed
+
+	/**
+	 * The text index is built in a background thread after a file is
+	 * loaded, from a snapshot of titles and texts.  Entries changed in the
+	 * meantime are indexed again when it finishes.
+	 */
+	struct TextIndexJob;
+	std::unique_ptr<TextIndexJob> text_index_job_;
+	unsigned text_index_serial_ = 0;
 
 	std::unique_ptr<FilterGroup> filter_; ///< Current filter
-	std::optional<std::vector<DiaryEntry*>> filtered_entries_; ///< filter_.filter(entries)
+	bool view_by_time_ = false; ///< Display entries in time order, without reordering them
+	std::optional<std::vector<DiaryEntry*>> filtered_entries_; ///< Entries displayed, if filter_ or view_by_time_
 	void updated_filter (); ///< Must be called every time filter is modified
 	bool unavailable_filtered (); ///< Display an error message "Unavaiable in filtering mode"
 
@@ -83,13 +132,35 @@ private:
 	void load(std::wstring_view filename);
 	// If successful, set current_filename_
 	void save(std::wstring_view filename);
+	void start_save_job (std::unique_ptr<SaveJob>);
+	void finish_save (); ///< Called when save_job_ finishes
+	void start_pending_save (); ///< Starts pending_save_ or the pending autosave, if possible
+	void wait_save (); ///< Waits until all saves finish
 	void default_save ();
 	void save_as ();
+	void compact_file ();
+
+	void schedule_autosave (); ///< Called after every modification
+	void autosave ();
+	std::wstring recovery_filename () const; ///< Empty if there's no diary file
+	void discard_recovery (); ///< Removes the recovery file, if any
+	void load_recovery (); ///< Asks the user whether to restore from the recovery file
+
+	void start_text_index_job (); ///< Builds text_index_ for all entries
+	void finish_text_index_job (); ///< Called when text_index_job_ finishes
+	void cancel_text_index_job (); ///< Also invalidates text_index_
+	/**
+	 * @brief	Must be called when an entry is added or removed, or its title or text changes
+	 * @param	old_title,old_text	Empty for new entries
+	 * @param	entry	nullptr for removed entries
+	 */
+	void text_changed (unsigned id, std::string_view old_title, std::string_view old_text, const DiaryEntry *entry);
 
 	void new_file ();
 	void open_file ();
 	void open_recent_file ();
 	void edit_password ();
+	void upgrade_file_format ();
 	void edit_all_labels ();
 	void edit_global_options ();
 	void edit_perfile_options ();
@@ -97,12 +168,14 @@ private:
 	void quit ();
 
 	void edit_filter ();
-	void clear_filter ();
+	void clear_filter (); ///< Also leaves view_by_time_
+	void toggle_view_by_time ();
+	void goto_date ();
 
 	void append ();
-	std::vector <DiaryEntry *> &get_current_list ();
 	const std::vector <DiaryEntry *> &get_current_list () const;
 	DiaryEntry *get_current ();
+	void focus_entry (const DiaryEntry *); ///< Moves the focus to an entry displayed
 	void edit_current ();
 	void edit_labels_current ();
 	void edit_time_current ();
@@ -118,6 +191,9 @@ private:
 	void do_search (bool /**< false = previous */, bool include_current_entry);
 
 	void reset_file ();
+	void journal_replace (const DiaryEntry *); ///< Records that an entry is modified
+	DiaryEntry *writable_entry (DiaryEntry *); ///< Call before modifying an entry
+	void retire_entry (DiaryEntry *); ///< Call instead of deleting an entry
 
 	/**
 	 * @result	true: The caller should continue to the next operation;
@@ -137,6 +213,8 @@ private:
 	bool query_allow_up () const;
 	bool query_allow_down () const;
 	bool query_search_continuable () const;
+	bool query_journal_exists () const;
+	bool query_upgradable_file_format () const;
 };
 
 
@@ -14,6 +14,7 @@
 
 #include "main/stat.h"
 #include "diary/diary.h"
+#include "diary/entry_table.h"
 #include "ui/dialog_richtext.h"
 #include "ui/paletteid.h"
 #include "common/algorithm.h"
@@ -29,25 +30,19 @@ namespace tiary {
 
 namespace {
 
-struct Stat
-{
-	unsigned bytes;      // Number of bytes when represented in UTF-8
-	unsigned characters; // Number of characters (including newlines and spaces)
-	unsigned char_graph; // Number of characters (excluding newlines and spaces)
-	unsigned words;      // Number of non-CJK words
-	unsigned cjks;       // Number of CJK characters
-	unsigned paragraphs; // Number of paragraphs (excluding title)
-};
+typedef TextStat Stat;
 
 // The result is _added_ to ret
-void stat_string(Stat *ret, const std::wstring &text) {
-	ret->characters += text.length();
+void stat_string(Stat *ret, std::string_view text) {
+	ret->bytes += text.length();
 
 	bool last_alpha = false;
-	wchar_t lastc = L'\n';
-	for (wchar_t c : text) {
+	char32_t lastc = U'\n';
+	for (size_t i = 0; i < text.length(); ) {
+		char32_t c = utf8_next(text, &i);
+		++ret->characters;
 
-		if (c != L'\n' && lastc == L'\n') {
+		if (c != U'\n' && lastc == U'\n') {
 			++ret->paragraphs;
 		}
 		lastc = c;
@@ -65,16 +60,26 @@ void stat_string(Stat *ret, const std::wstring &text) {
 			++ret->words;
 		}
 		last_alpha = this_alpha;
-		ret->bytes += utf8_len_by_wchar (c);
 	}
 }
 
+Stat stat_entry(const DiaryEntry &entry) {
+	Stat ret = {};
+	stat_string (&ret, entry.title.utf8 ());
+	ret.paragraphs = 0;
+	stat_string (&ret, entry.text.utf8 ());
+	return ret;
+}
+
 // The result is _added_ to ret
-void stat_entry(Stat *ret, const DiaryEntry &entry) {
-	unsigned old_paragraphs = ret->paragraphs;
-	stat_string (ret, entry.title);
-	ret->paragraphs = old_paragraphs;
-	stat_string (ret, entry.text);
+void stat_entry(Stat *ret, const DiaryEntry &entry, StatCache *cache) {
+	Stat s = cache->get(entry, [](const DiaryEntry &entry) { return stat_entry(entry); });
+	ret->bytes += s.bytes;
+	ret->characters += s.characters;
+	ret->char_graph += s.char_graph;
+	ret->words += s.words;
+	ret->cjks += s.cjks;
+	ret->paragraphs += s.paragraphs;
 }
 
 struct TimeSpan
@@ -84,12 +89,11 @@ struct TimeSpan
 };
 
 // Returns the minimum and maximum time
-TimeSpan get_span (const DiaryEntryList &lst)
+TimeSpan get_span (const std::vector<uint64_t> &times)
 {
 	uint64_t min = uint64_t(0) - 1;
 	uint64_t max = 0;
-	for (const DiaryEntry *entry : lst) {
-		uint64_t v = entry->local_time.get_value();
+	for (uint64_t v : times) {
 		if (v < min) {
 			min = v;
 		}
@@ -133,9 +137,11 @@ void append_average_stat(ui::MultiLineRichText *mrt, const Stat &info, unsigned
 
 } // anonymous namespace
 
-void display_statistics (const DiaryEntryList &all_entries,
+void display_statistics (const EntryTable &all_entries,
 		const DiaryEntryList *filtered_entries,
-		const DiaryEntry *current_entry)
+		const DiaryEntry *current_entry,
+		size_t memory_usage,
+		StatCache *cache)
 {
 	ui::MultiLineRichText mrt;
 	mrt.text.reserve(4096); // Just a rough guess
@@ -143,7 +149,7 @@ void display_statistics (const DiaryEntryList &all_entries,
 
 	Stat info = {};
 	if (current_entry) {
-		stat_entry(&info, *current_entry);
+		stat_entry(&info, *current_entry, cache);
 		mrt.append(ui::PALETTE_ID_SHOW_BOLD, L"Current entry"sv);
 		append_stat(&mrt, info);
 		mrt.append(ui::PALETTE_ID_SHOW_NORMAL);
@@ -153,7 +159,7 @@ void display_statistics (const DiaryEntryList &all_entries,
 	if (filtered_entries) {
 		for (const DiaryEntry *entry : *filtered_entries) {
 			if (entry != current_entry) {
-				stat_entry(&info, *entry);
+				stat_entry(&info, *entry, cache);
 			}
 		}
 		mrt.append(ui::PALETTE_ID_SHOW_BOLD,
@@ -164,14 +170,18 @@ void display_statistics (const DiaryEntryList &all_entries,
 
 	// Add the remaining entries
 	{
-		std::set<const DiaryEntry*> visited_set;
+		std::vector<bool> visited(all_entries.size());
 		if (filtered_entries) {
-			visited_set.insert(filtered_entries->begin(), filtered_entries->end());
+			for (const DiaryEntry *entry : *filtered_entries) {
+				visited[all_entries.find(entry)] = true;
+			}
 		}
-		visited_set.insert(current_entry);
-		for (const DiaryEntry *entry : all_entries) {
-			if (visited_set.find(entry) == visited_set.end()) {
-				stat_entry(&info, *entry);
+		if (current_entry) {
+			visited[all_entries.find(current_entry)] = true;
+		}
+		for (size_t i = 0; i < all_entries.size(); ++i) {
+			if (!visited[i]) {
+				stat_entry(&info, *all_entries[i], cache);
 			}
 		}
 	}
@@ -181,7 +191,7 @@ void display_statistics (const DiaryEntryList &all_entries,
 	append_stat(&mrt, info);
 	mrt.append(ui::PALETTE_ID_SHOW_NORMAL);
 
-	TimeSpan span = get_span (all_entries);
+	TimeSpan span = get_span (all_entries.times ());
 	unsigned days = extract_date_from_datetime (span.max) - extract_date_from_datetime (span.min) + 1;
 	mrt.append(ui::PALETTE_ID_SHOW_NORMAL,
 			format(L"Date span           %8a days (%b - %c)"sv,
@@ -196,11 +206,10 @@ void display_statistics (const DiaryEntryList &all_entries,
 	unsigned n_distinct_labels;
 	// Count the number of distinct labels
 	{
-		std::unordered_set<std::wstring_view> all_labels;
+		std::unordered_set<const DiaryLabel *> all_labels;
 		for (const DiaryEntry *entry : all_entries) {
 			n_labels += entry->labels.size ();
-			for (const auto &s: entry->labels)
-				all_labels.insert(s);
+			all_labels.insert(entry->labels.begin(), entry->labels.end());
 		}
 		n_distinct_labels = all_labels.size ();
 	}
@@ -208,6 +217,8 @@ void display_statistics (const DiaryEntryList &all_entries,
 			L"Labels              "sv, format_dec(n_distinct_labels, 8));
 	mrt.append(ui::PALETTE_ID_SHOW_NORMAL,
 			L"Labels per entry    "sv, format_double(double(n_labels) / all_entries.size(), 8, 4));
+	mrt.append(ui::PALETTE_ID_SHOW_NORMAL,
+			L"Memory (KiB)        "sv, format_dec(unsigned((memory_usage + 1023) / 1024), 8));
 
 	mrt.append(ui::PALETTE_ID_SHOW_NORMAL);
 
@@ -14,15 +14,33 @@
 #ifndef TIARY_MAIN_STAT_H
 #define TIARY_MAIN_STAT_H
 
+#include "diary/entry_cache.h"
+#include <stddef.h>
 #include <vector>
 
 namespace tiary {
 
 struct DiaryEntry;
-
-void display_statistics (const std::vector <DiaryEntry*> &all_entries,
+class EntryTable;
+
+struct TextStat
+{
+	unsigned bytes;      // Number of bytes when represented in UTF-8
+	unsigned characters; // Number of characters (including newlines and spaces)
+	unsigned char_graph; // Number of characters (excluding newlines and spaces)
+	unsigned words;      // Number of non-CJK words
+	unsigned cjks;       // Number of CJK characters
+	unsigned paragraphs; // Number of paragraphs (excluding title)
+};
+
+/// Statistics of every entry, kept between calls to display_statistics
+typedef EntryCache<TextStat> StatCache;
+
+void display_statistics (const EntryTable &all_entries,
 		const std::vector <DiaryEntry*> *filtered_entries,
-		const DiaryEntry *current_entry);
+		const DiaryEntry *current_entry,
+		size_t memory_usage, ///< Bytes allocated for the entries of the file
+		StatCache *);
 
 } // namespace tiary
 
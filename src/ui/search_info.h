@@ -40,6 +40,7 @@ public:
 
 	explicit operator bool() const { return static_cast<bool>(matcher_); }
 	bool basic_match(std::wstring_view s) const { return matcher_.basic_match(s); }
+	bool basic_match_utf8(std::string_view s) const { return matcher_.basic_match_utf8(s); }
 	std::vector<std::pair<size_t, size_t>> match(std::wstring_view s) const { return matcher_.match(s); }
 	const StringMatch &get_matcher() const { return matcher_; }
 
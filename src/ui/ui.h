@@ -23,6 +23,8 @@
  * For details on the UI system, see namespace @c tiary::ui
  */
 
+#include <functional>
+
 /**
  * @defgroup uisystem The UI system
  * @brief Introduces the use of the UI system
@@ -129,6 +131,15 @@ Size get_screen_size ();
 unsigned get_screen_width ();
 unsigned get_screen_height ();
 
+/**
+ * @brief	Runs a function in the thread running the event loops
+ *
+ * This can be called from any thread, e.g. to report the result of some
+ * work done in the background.  The function is called as soon as possible
+ * from the event loop of whichever Window is running.
+ */
+void post_task (std::function<void ()>);
+
 
 /*
  * List of special keys. All have type wchar_t
@@ -205,6 +216,7 @@ const wchar_t ALT_BASE  = 0x70000200;
  */
 const wchar_t WINCH		= 0x70000400;
 const wchar_t MOUSE		= 0x70000401; ///< Mouse event
+const wchar_t TASK		= 0x70000402; ///< Functions passed to post_task are waiting
 
 
 // The following constants are for outputing borders
@@ -20,10 +20,14 @@
 #include "ui/terminal_emulator.h"
 #include "ui/control.h"
 #include "ui/paletteid.h"
+#include <mutex>
 #include <vector>
 #include <string.h>
 #include <assert.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
 
 
 namespace tiary {
@@ -199,17 +203,95 @@ void commit_to_screen() {
 }
 
 
+// Functions passed to post_task
+std::mutex posted_tasks_mutex;
+std::vector<std::function<void ()>> posted_tasks;
+// post_task writes to this pipe to wake up wait_input.
+// Created by the event loop thread before it first waits
+int wake_pipe[2] = {-1, -1};
+
+bool create_wake_pipe ()
+{
+	if (pipe (wake_pipe) != 0) {
+		wake_pipe[0] = wake_pipe[1] = -1;
+		return false;
+	}
+	for (int fd: wake_pipe) {
+		fcntl (fd, F_SETFD, FD_CLOEXEC);
+		fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+	}
+	return true;
+}
+
+/*
+ * Waits for a key, like get_wch, but returns ERR with *pc = TASK
+ * if there are posted tasks
+ */
+int wait_input (wint_t *pc)
+{
+	for (;;) {
+		{
+			std::lock_guard<std::mutex> lock (posted_tasks_mutex);
+			if (!posted_tasks.empty ()) {
+				*pc = TASK;
+				return ERR;
+			}
+			if (wake_pipe[0] < 0 && !create_wake_pipe ()) {
+				break;
+			}
+		}
+
+		// ncurses may have buffered some input already, in which case
+		// stdin is not readable. So always try it first
+		nodelay (stdscr, TRUE);
+		int getret = get_wch (pc);
+		nodelay (stdscr, FALSE);
+		if (getret != ERR) {
+			return getret;
+		}
+
+		struct pollfd fds[2] = {
+			{ STDIN_FILENO, POLLIN, 0 },
+			{ wake_pipe[0], POLLIN, 0 },
+		};
+		if (poll (fds, 2, -1) > 0 && (fds[1].revents & POLLIN)) {
+			char buffer[64];
+			while (read (wake_pipe[0], buffer, sizeof buffer) > 0) {
+			}
+		}
+		// Signals (e.g., SIGWINCH) also interrupt poll, which ncurses
+		// reports as keys in the next round
+	}
+	return get_wch (pc);
+}
+
+void run_posted_tasks ()
+{
+	std::vector<std::function<void ()>> tasks;
+	{
+		std::lock_guard<std::mutex> lock (posted_tasks_mutex);
+		tasks.swap (posted_tasks);
+	}
+	for (auto &task: tasks) {
+		task ();
+	}
+}
+
 /*
  * Does not handle Alt + Letter
  */
 wchar_t get_input_base (MouseEvent *pmouse_event, bool block)
 {
 	wint_t c;
-	if (!block) {
+	int getret;
+	if (block) {
+		getret = wait_input (&c);
+		if (getret == ERR && c == TASK) {
+			return TASK;
+		}
+	} else {
 		nodelay (stdscr, TRUE);
-	}
-	int getret = get_wch (&c);
-	if (!block) {
+		getret = get_wch (&c);
 		nodelay (stdscr, FALSE);
 	}
 	switch (getret) {
@@ -476,6 +558,9 @@ void Window::event_loop ()
 				win->on_winch ();
 			}
 		}
+		else if (c == TASK) {
+			run_posted_tasks ();
+		}
 		else if (c == MOUSE) {
 			// Is the position within this window?
 			MouseEvent mouse_event_relative = mouse_event.rebase(get_pos());
@@ -723,6 +808,18 @@ void Window::touch_windows ()
 	}
 }
 
+void post_task (std::function<void ()> task)
+{
+	std::lock_guard<std::mutex> lock (posted_tasks_mutex);
+	posted_tasks.push_back (std::move (task));
+	if (wake_pipe[1] >= 0) {
+		char c = 0;
+		if (write (wake_pipe[1], &c, 1) < 0) {
+			// Pipe full. The event loop will wake up anyway
+		}
+	}
+}
+
 wchar_t Window::get (MouseEvent *pmouse_event)
 {
 	return get_input (pmouse_event);
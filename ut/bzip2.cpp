@@ -0,0 +1,112 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include "common/bzip2.h"
+#include "common/string.h"
+#include <string.h>
+
+namespace tiary {
+
+namespace {
+
+std::string make_data(size_t len) {
+	std::string data;
+	data.reserve(len);
+	uint32_t x = 12345;
+	while (data.size() < len) {
+		x = x * 1103515245 + 12345;
+		data += char('a' + (x >> 16) % 7);
+		if (x % 13 == 0) {
+			data += "\n<entry>"sv;
+		}
+	}
+	data.resize(len);
+	return data;
+}
+
+} // namespace
+
+TEST(Bzip2, Small) {
+	EXPECT_EQ("", bunzip2(bzip2(""sv)));
+	EXPECT_EQ("Hello world", bunzip2(bzip2("Hello world"sv)));
+	EXPECT_EQ("", bunzip2("not bzip2 data"sv));
+}
+
+TEST(Bzip2, MultiStream) {
+	std::string data = make_data(3000000);
+	std::string compressed = bzip2(data);
+	ASSERT_FALSE(compressed.empty());
+	// More than one stream
+	EXPECT_NE(compressed.npos, compressed.find("BZh9"sv, 1));
+	EXPECT_EQ(data, bunzip2(compressed));
+
+	// Truncated
+	EXPECT_EQ("", bunzip2(std::string_view(compressed).substr(0, compressed.size() - 1)));
+}
+
+TEST(Bzip2, Concatenated) {
+	std::string a = make_data(1000);
+	std::string b = make_data(2000);
+	EXPECT_EQ(a + b, bunzip2(bzip2(a) + bzip2(b)));
+}
+
+TEST(Bzip2, SizeTrailer) {
+	for (size_t len: {0, 1000, 3000000}) {
+		std::string data = make_data(len);
+		std::string compressed = bzip2(data, true);
+		EXPECT_TRUE(compressed.ends_with("TiaryBzT"sv));
+		EXPECT_EQ(data, bunzip2(compressed));
+	}
+}
+
+TEST(Bzip2, BadSizeTrailer) {
+	std::string data = make_data(2000000);
+	std::string compressed = bzip2(data, true);
+	// Trailer: (compressed size, uncompressed size) x 3, count, magic
+	size_t trailer = compressed.size() - 8 - 4 - 3 * 8;
+
+	// Sizes we can't have written are not trusted.  Fall back to decompress
+	// sequentially, without the trailer
+	for (uint32_t size: {0u, 1000u, 900001u, 0x7fffffffu, 0xffffffffu}) {
+		std::string bad = compressed;
+		memcpy(&bad[trailer + 4], &size, 4);
+		EXPECT_EQ(data, bunzip2(bad)) << size;
+		bad = compressed;
+		memcpy(&bad[trailer + 16 + 4], &size, 4);
+		EXPECT_EQ(data, bunzip2(bad)) << size;
+	}
+}
+
+TEST(Bzip2, TrailingGarbage) {
+	// Data after the last stream that is not a size trailer is ignored
+	for (size_t len: {1000, 3000000}) {
+		std::string data = make_data(len);
+		std::string compressed = bzip2(data);
+		EXPECT_EQ(data, bunzip2(compressed + std::string(100, '\0'))) << len;
+		EXPECT_EQ(data, bunzip2(compressed + "garbage"s)) << len;
+		EXPECT_EQ(data, bunzip2(bzip2(data, true) + "TiaryBzT"s)) << len;
+	}
+	// But not if there's no stream at all
+	EXPECT_EQ("", bunzip2(std::string(100, '\0')));
+}
+
+TEST(Bzip2, SingleStream) {
+	std::string data = make_data(3000000);
+	std::string compressed = bzip2_single_stream(data);
+	ASSERT_FALSE(compressed.empty());
+	EXPECT_EQ(compressed.npos, compressed.find("BZh9"sv, 1));
+	EXPECT_EQ(data, bunzip2(compressed));
+}
+
+} // namespace tiary
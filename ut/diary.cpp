@@ -0,0 +1,39 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include "diary/diary.h"
+#include "common/string.h"
+
+namespace tiary {
+
+TEST(DiaryTextStore, Add) {
+	DiaryTextStore store;
+	std::vector<DiaryText> texts;
+	std::vector<std::string> expected;
+	// Short texts share blocks; long ones are allocated separately
+	for (size_t len: {0, 1, 100, 60000, 65536, 65537, 100000, 300000, 10}) {
+		auto source = std::make_unique<std::string>(len, char('a' + len % 26));
+		texts.push_back(store.add(*source));
+		expected.push_back(*source);
+		// The store must not refer to the source
+		source->assign(len, '?');
+		source.reset();
+	}
+	for (size_t i = 0; i < texts.size(); ++i) {
+		EXPECT_EQ(expected[i], texts[i].utf8()) << i;
+	}
+	EXPECT_LE(65537u + 100000u + 300000u, store.memory_usage());
+}
+
+} // namespace tiary
@@ -0,0 +1,100 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "diary/config.h"
+#include "diary/diary.h"
+#include "diary/file.h"
+#include "common/string.h"
+
+namespace tiary {
+
+namespace {
+
+class FileTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		char dir[] = "/tmp/tiary-file-XXXXXX";
+		ASSERT_NE(nullptr, mkdtemp(dir));
+		dir_ = dir;
+		filename_ = dir_ + "/diary";
+	}
+
+	void TearDown() override {
+		pool_.clear(&entries_);
+		unlink(filename_.c_str());
+		unlink((filename_ + ".journal").c_str());
+		rmdir(dir_.c_str());
+	}
+
+	void add(std::wstring title, std::wstring text) {
+		entries_.push_back(pool_.create(DiaryEntry{DateTime(DateTime::UTC, entries_.size() * 86400),
+					std::move(title), std::move(text)}));
+	}
+
+	// Saves in the given format, loads the file back, and compares
+	void round_trip(std::string_view password, DiaryFileFormat format) {
+		DiaryFileState state;
+		state.format = format;
+		ASSERT_TRUE(save_file(filename_.c_str(), entries_, options_, password, state));
+		EXPECT_EQ(format, state.format);
+
+		DiaryEntryList entries;
+		DiaryEntryPool pool;
+		PerFileOptionGroup options;
+		std::string loaded_password;
+		DiaryFileState loaded_state;
+		ASSERT_EQ(LOAD_FILE_SUCCESS, load_file(filename_.c_str(), [&] { return std::string(password); },
+					entries, pool, options, loaded_password, loaded_state));
+		EXPECT_EQ(format, loaded_state.format);
+		ASSERT_EQ(entries_.size(), entries.size());
+		for (size_t i = 0; i < entries.size(); ++i) {
+			EXPECT_EQ(entries_[i]->local_time, entries[i]->local_time) << i;
+			EXPECT_EQ(entries_[i]->title.utf8(), entries[i]->title.utf8()) << i;
+			EXPECT_EQ(entries_[i]->text.utf8(), entries[i]->text.utf8()) << i;
+		}
+		pool.clear(&entries);
+	}
+
+	std::string dir_;
+	std::string filename_;
+	DiaryEntryPool pool_;
+	DiaryEntryList entries_;
+	PerFileOptionGroup options_;
+};
+
+} // namespace
+
+TEST_F(FileTest, LargeEntries) {
+	// Texts longer than 64 KiB are stored separately when loaded
+	add(L"Short", L"Text");
+	add(L"ASCII", std::wstring(70000, L'x'));
+	add(L"CJK", std::wstring(60000, L'中'));
+	add(L"Short again", L"Text & <more>");
+	round_trip(""sv, DiaryFileFormat::kBzip2);
+	round_trip("password"sv, DiaryFileFormat::kEncrypted2018);
+	round_trip("password"sv, DiaryFileFormat::kSegmented);
+}
+
+TEST_F(FileTest, HugeEntry) {
+	// The segment is larger than a bzip2 block, so it's compressed in streams
+	add(L"Short", L"Text");
+	add(L"Huge", std::wstring(1000000, L'y') + std::wstring(100000, L'中'));
+	add(L"Short again", L"Text");
+	round_trip("password"sv, DiaryFileFormat::kSegmented);
+	round_trip(""sv, DiaryFileFormat::kBzip2);
+}
+
+} // namespace tiary
@@ -0,0 +1,159 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "diary/config.h"
+#include "diary/diary.h"
+#include "diary/file.h"
+#include "common/string.h"
+
+namespace tiary {
+
+namespace {
+
+class JournalTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		char dir[] = "/tmp/tiary-journal-XXXXXX";
+		ASSERT_NE(nullptr, mkdtemp(dir));
+		dir_ = dir;
+		filename_ = dir_ + "/diary";
+
+		// A diary file with entries A, B, C, and then two records
+		// in the journal file: replacing B with B2, and inserting Z at 0
+		for (std::wstring title: {L"A", L"B", L"C"}) {
+			entries_.push_back(pool_.create(DiaryEntry{DateTime(DateTime::UTC, 0), title}));
+		}
+		ASSERT_TRUE(save_file(filename_.c_str(), entries_, options_, kPassword, state_));
+
+		DiaryEntry *entry = pool_.create(*entries_[1]);
+		entry->title = L"B2";
+		pool_.destroy(entries_[1]);
+		entries_[1] = entry;
+		state_.journal.replace(1, *entry);
+		ASSERT_TRUE(save_file(filename_.c_str(), entries_, options_, kPassword, state_));
+		ASSERT_NE(0u, state_.journal_size);
+		first_record_end_ = state_.journal_size;
+
+		entry = pool_.create(DiaryEntry{DateTime(DateTime::UTC, 0), std::wstring(L"Z")});
+		entries_.insert(entries_.begin(), entry);
+		state_.journal.insert(0, *entry);
+		ASSERT_TRUE(save_file(filename_.c_str(), entries_, options_, kPassword, state_));
+		ASSERT_LT(first_record_end_, state_.journal_size);
+	}
+
+	void TearDown() override {
+		pool_.clear(&entries_);
+		unlink(filename_.c_str());
+		unlink((filename_ + ".journal").c_str());
+		rmdir(dir_.c_str());
+	}
+
+	// Titles of the entries loaded
+	std::string load(uint64_t *journal_size = nullptr) {
+		DiaryEntryList entries;
+		DiaryEntryPool pool;
+		PerFileOptionGroup options;
+		std::string password;
+		DiaryFileState state;
+		if (load_file(filename_.c_str(), [] { return std::string(kPassword); },
+					entries, pool, options, password, state) != LOAD_FILE_SUCCESS) {
+			return "error";
+		}
+		std::string res;
+		for (const DiaryEntry *entry: entries) {
+			res += entry->title.utf8();
+		}
+		if (journal_size) {
+			*journal_size = state.journal_size;
+		}
+		loaded_modtime_ = options.get_bool(PERFILE_OPTION_MODTIME);
+		pool.clear(&entries);
+		return res;
+	}
+
+	std::string journal_filename() const { return filename_ + ".journal"; }
+
+	off_t journal_file_size() const {
+		struct stat st;
+		return stat(journal_filename().c_str(), &st) == 0 ? st.st_size : -1;
+	}
+
+	static constexpr std::string_view kPassword = "password"sv;
+
+	std::string dir_;
+	std::string filename_;
+	DiaryEntryPool pool_;
+	DiaryEntryList entries_;
+	PerFileOptionGroup options_;
+	DiaryFileState state_;
+	uint64_t first_record_end_ = 0;
+	bool loaded_modtime_ = false;
+};
+
+} // namespace
+
+TEST_F(JournalTest, Replay) {
+	uint64_t journal_size;
+	EXPECT_EQ("ZAB2C"sv, load(&journal_size));
+	EXPECT_EQ(journal_file_size(), off_t(journal_size));
+}
+
+TEST_F(JournalTest, TruncatedRecord) {
+	ASSERT_EQ(0, truncate(journal_filename().c_str(), journal_file_size() - 1));
+	uint64_t journal_size;
+	EXPECT_EQ("AB2C"sv, load(&journal_size));
+	// The next save overwrites the damaged record
+	EXPECT_EQ(first_record_end_, journal_size);
+
+	// Not even the size of the second record is complete
+	ASSERT_EQ(0, truncate(journal_filename().c_str(), first_record_end_ + 2));
+	EXPECT_EQ("AB2C"sv, load(&journal_size));
+	EXPECT_EQ(first_record_end_, journal_size);
+}
+
+TEST_F(JournalTest, ChecksumMismatch) {
+	FILE *fp = fopen(journal_filename().c_str(), "r+b");
+	ASSERT_NE(nullptr, fp);
+	// A byte of the checksum of the second record
+	fseek(fp, first_record_end_ + 4, SEEK_SET);
+	int c = fgetc(fp);
+	fseek(fp, first_record_end_ + 4, SEEK_SET);
+	fputc(c ^ 1, fp);
+	fclose(fp);
+	uint64_t journal_size;
+	EXPECT_EQ("AB2C"sv, load(&journal_size));
+	EXPECT_EQ(first_record_end_, journal_size);
+}
+
+TEST_F(JournalTest, InvalidRecord) {
+	// A record that is intact, but can't be applied as a whole.
+	// None of its changes may be applied
+	options_.set(PERFILE_OPTION_MODTIME, "1");
+	state_.journal.set_options(options_);
+	state_.journal.insert(0, *entries_[0]);
+	state_.journal.remove(100);
+	uint64_t journal_size = state_.journal_size;
+	ASSERT_TRUE(save_file(filename_.c_str(), entries_, options_, kPassword, state_));
+	ASSERT_LT(journal_size, state_.journal_size);
+
+	uint64_t loaded_journal_size;
+	EXPECT_EQ("ZAB2C"sv, load(&loaded_journal_size));
+	EXPECT_FALSE(loaded_modtime_);
+	EXPECT_EQ(journal_size, loaded_journal_size);
+}
+
+} // namespace tiary
@@ -0,0 +1,56 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include "common/re.h"
+#include "common/string.h"
+
+#ifdef TIARY_USE_RE2
+
+namespace tiary {
+
+namespace {
+
+using Matches = std::vector<std::pair<size_t, size_t>>;
+
+} // namespace
+
+TEST(Re, Match) {
+	EXPECT_EQ((Matches{{0, 2}, {3, 2}}), Re(L"ab"sv).match(L"abxab"sv));
+	// Offsets and lengths are in characters, not bytes
+	EXPECT_EQ((Matches{{1, 2}, {4, 2}}), Re(L"ab"sv).match(L"中ab文ab"sv));
+	EXPECT_EQ((Matches{{0, 2}, {3, 1}}), Re(L"文+"sv).match(L"文文a文"sv));
+	EXPECT_EQ((Matches{{2, 3}, {8, 1}}), Re(L"[中文é]+"sv).match(L"ab中文éxyàé"sv));
+	EXPECT_EQ(Matches{}, Re(L"z"sv).match(L"中文"sv));
+}
+
+TEST(Re, EmptyMatch) {
+	// Empty matches are skipped.  They used to be found at the same place forever
+	EXPECT_EQ((Matches{{1, 2}, {4, 1}}), Re(L"x*"sv).match(L"axxbx"sv));
+	EXPECT_EQ((Matches{{1, 1}}), Re(L"x*"sv).match(L"中x中"sv));
+	EXPECT_EQ(Matches{}, Re(L"x*"sv).match(L""sv));
+	EXPECT_EQ(Matches{}, Re(L"^"sv).match(L"abc"sv));
+	EXPECT_EQ(Matches{}, Re(L"$"sv).match(L"中文"sv));
+	EXPECT_EQ(Matches{}, Re(L""sv).match(L"abc"sv));
+}
+
+TEST(Re, BasicMatch) {
+	EXPECT_TRUE(Re(L"文.b"sv).basic_match(L"x文ab"sv));
+	EXPECT_TRUE(Re(L"文.b"sv).basic_match_utf8("x文ab"sv));
+	EXPECT_FALSE(Re(L"^ab"sv).basic_match(L"中ab"sv));
+	EXPECT_FALSE(Re(L"("sv));
+}
+
+} // namespace tiary
+
+#endif // TIARY_USE_RE2
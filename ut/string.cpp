@@ -23,6 +23,7 @@ namespace tiary {
 TEST(StrLowerTest, StrLower) {
 	setlocale(LC_ALL, "zh_CN.UTF-8");
 	EXPECT_EQ(strlower(L"AbCäÄÈÑÕ"sv), L"abcääèñõ"sv);
+	EXPECT_EQ(strlower("AbCäÄÈÑÕ"sv), "abcääèñõ"sv);
 }
 
 TEST(SplitTest, Split) {
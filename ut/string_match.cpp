@@ -0,0 +1,113 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include <locale.h>
+#include "common/string.h"
+#include "common/string_match.h"
+#include "common/unicode.h"
+
+namespace tiary {
+
+namespace {
+
+class CaseInsensitiveFinderTest : public ::testing::Test {
+protected:
+	// The finder looks up the locale only once
+	static void SetUpTestSuite() {
+		setlocale(LC_ALL, "zh_CN.UTF-8");
+	}
+};
+
+// What the finder should return
+size_t slow_find(std::wstring_view haystack, std::wstring_view needle) {
+	return strlower(haystack).find(strlower(needle));
+}
+
+void expect_find(std::wstring_view haystack, std::wstring_view needle) {
+	CaseInsensitiveFinder finder(needle);
+	size_t expected = slow_find(haystack, needle);
+	EXPECT_EQ(expected, finder.find(haystack)) << wstring_to_utf8(haystack) << " / " << wstring_to_utf8(needle);
+	EXPECT_EQ(expected != haystack.npos, finder.contains_utf8(wstring_to_utf8(haystack)))
+		<< wstring_to_utf8(haystack) << " / " << wstring_to_utf8(needle);
+}
+
+} // namespace
+
+TEST_F(CaseInsensitiveFinderTest, AsciiBlockBoundaries) {
+	// Matches crossing the 16- and 32-byte blocks, at the very beginning
+	// and the very end of the haystack
+	for (std::wstring_view needle: {L"x"sv, L"Xy"sv, L"xYz"sv, L"XYZxyzXYZxyzXYZx"sv, L"xyzXYZxyzXYZxyzXY"sv,
+			L"XyZxYzXyZxYzXyZxYzXyZxYzXyZxYzXyZ"sv}) {
+		for (size_t len = needle.size(); len <= 70; ++len) {
+			for (size_t pos = 0; pos + needle.size() <= len; ++pos) {
+				std::wstring haystack(len, L'a');
+				haystack.replace(pos, needle.size(), strlower(needle));
+				expect_find(haystack, needle);
+				// Almost a match
+				haystack[pos + needle.size() - 1] = L'a';
+				expect_find(haystack, needle);
+			}
+		}
+	}
+}
+
+TEST_F(CaseInsensitiveFinderTest, ShortNeedles) {
+	expect_find(L""sv, L"a"sv);
+	expect_find(L"A"sv, L"a"sv);
+	expect_find(L"a"sv, L"A"sv);
+	expect_find(L"bA"sv, L"a"sv);
+	expect_find(L"Ab"sv, L"aB"sv);
+	expect_find(L"aAb"sv, L"ab"sv);
+	expect_find(L"ba"sv, L"ab"sv);
+	expect_find(L"ä"sv, L"Ä"sv);
+	expect_find(L"xÄö"sv, L"äÖ"sv);
+
+	CaseInsensitiveFinder finder(L"Ab"sv);
+	EXPECT_EQ(3u, finder.find(L"abcAB"sv, 1));
+	EXPECT_EQ(L"abcAB"sv.npos, finder.find(L"abcAB"sv, 4));
+}
+
+TEST_F(CaseInsensitiveFinderTest, SpecialLowerCase) {
+	// U+212A KELVIN SIGN is lower-cased to ASCII 'k', and
+	// U+0130 LATIN CAPITAL LETTER I WITH DOT ABOVE to ASCII 'i'
+	EXPECT_TRUE(CaseInsensitiveFinder(L"k"sv).contains(L"K"sv));
+	EXPECT_TRUE(CaseInsensitiveFinder(L"K"sv).contains_utf8("1K2"sv));
+	EXPECT_TRUE(CaseInsensitiveFinder(L"K"sv).contains_utf8("K"sv));
+	EXPECT_TRUE(CaseInsensitiveFinder(L"i"sv).contains(L"İ"sv));
+	EXPECT_TRUE(CaseInsensitiveFinder(L"xi"sv).contains_utf8("Xİ"sv));
+	EXPECT_EQ(1u, CaseInsensitiveFinder(L"ki"sv).find(L"aKİ"sv));
+	expect_find(L"0123456789abcdef0123456789Kelvin"sv, L"kelvin"sv);
+	expect_find(L"İstanbul"sv, L"istanbul"sv);
+}
+
+TEST_F(CaseInsensitiveFinderTest, Sigma) {
+	for (std::wstring_view haystack: {L"σ"sv, L"ς"sv, L"Σ"sv, L"ΟΔΟΣ"sv, L"οδος"sv, L"οδοσ"sv}) {
+		for (std::wstring_view needle: {L"σ"sv, L"ς"sv, L"Σ"sv, L"οσ"sv, L"ος"sv, L"ΟΣ"sv}) {
+			expect_find(haystack, needle);
+		}
+	}
+	EXPECT_TRUE(CaseInsensitiveFinder(L"Σ"sv).contains(L"σ"sv));
+	EXPECT_TRUE(CaseInsensitiveFinder(L"σ"sv).contains_utf8("Σ"sv));
+}
+
+TEST_F(CaseInsensitiveFinderTest, InvalidUtf8) {
+	// Invalid bytes are decoded as '?', the same as utf8_to_wstring does
+	EXPECT_TRUE(CaseInsensitiveFinder(L"?"sv).contains_utf8("\xff"sv));
+	EXPECT_TRUE(CaseInsensitiveFinder(L"a?B"sv).contains_utf8("A\x80" "b"sv));
+	EXPECT_TRUE(CaseInsensitiveFinder(L"??"sv).contains_utf8("x\xc3\xc3"sv));
+	EXPECT_FALSE(CaseInsensitiveFinder(L"a"sv).contains_utf8("\xff\xfe"sv));
+	EXPECT_FALSE(CaseInsensitiveFinder(L"?"sv).contains_utf8("abc"sv));
+}
+
+} // namespace tiary
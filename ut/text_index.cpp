@@ -0,0 +1,116 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include <locale.h>
+#include <wctype.h>
+#include <algorithm>
+#include "diary/text_index.h"
+#include "common/string.h"
+#include "common/string_match.h"
+#include "common/unicode.h"
+
+namespace tiary {
+
+namespace {
+
+// Titles and texts of the entries, in UTF-8.  ID of each entry is its index
+constexpr std::pair<std::string_view, std::string_view> kEntries[] = {
+	{"Hello World"sv, "The quick brown fox jumps over the lazy dog. 123abc"sv},
+	{"\xe4\xb8\xad\xe6\x96\x87\xe6\x97\xa5\xe8\xae\xb0"sv, "\xe4\xbb\x8a\xe5\xa4\xa9\xe5\xa4\xa9\xe6\xb0\x94\xe5\xbe\x88\xe5\xa5\xbd, mixed\xe4\xb8\xad\xe6\x96\x87text"sv}, // 中文日记, 今天天气很好, mixed中文text
+	{"\xce\x9f\xce\x94\xce\x9f\xce\xa3"sv, "\xce\xbf\xce\xb4\xce\xbf\xcf\x82 \xce\xbf\xce\xb4\xce\xbf\xcf\x83\xce\xb1"sv}, // ΟΔΟΣ, οδος οδοσα
+	{"\xc4\xb0stanbul"sv, "KELVIN \xe2\x84\xaa and Istanbul"sv}, // İstanbul, KELVIN K and Istanbul
+	{"What?"sv, "Who?? a?b ?"sv},
+	{"bad\xff" "bytes"sv, "x\xc3\xc3y \x80\xe4\xb8z"sv},
+	{""sv, "\xe5\xa5\xbd"sv}, // 好
+};
+
+std::wstring upper(std::wstring_view s) {
+	std::wstring res(s);
+	for (wchar_t &c: res) {
+		c = towupper(c);
+	}
+	return res;
+}
+
+class TextIndexTest : public ::testing::Test {
+protected:
+	// StringMatch looks up the locale only once
+	static void SetUpTestSuite() {
+		setlocale(LC_ALL, "zh_CN.UTF-8");
+	}
+
+	void SetUp() override {
+		for (size_t i = 0; i < std::size(kEntries); ++i) {
+			index_.add(i, kEntries[i].first, kEntries[i].second);
+		}
+	}
+
+	// Every entry StringMatch finds the pattern in is a candidate
+	void expect_superset(std::wstring_view pattern) {
+		std::optional<std::vector<unsigned>> candidates = index_.candidates(pattern);
+		if (!candidates) {
+			return;
+		}
+		StringMatch match(pattern);
+		for (size_t i = 0; i < std::size(kEntries); ++i) {
+			if (match.basic_match_utf8(kEntries[i].first) || match.basic_match_utf8(kEntries[i].second)) {
+				EXPECT_TRUE(std::binary_search(candidates->begin(), candidates->end(), i))
+					<< wstring_to_utf8(pattern) << " / " << i;
+			}
+		}
+	}
+
+	TextIndex index_;
+};
+
+} // namespace
+
+TEST_F(TextIndexTest, Substrings) {
+	// Every substring of every title and text, most of which cut words at
+	// both ends
+	for (const auto &[title, text]: kEntries) {
+		for (std::string_view s: {title, text}) {
+			std::wstring w = utf8_to_wstring(s);
+			for (size_t pos = 0; pos < w.size(); ++pos) {
+				for (size_t len = 1; len <= 8 && pos + len <= w.size(); ++len) {
+					std::wstring_view pattern = std::wstring_view(w).substr(pos, len);
+					expect_superset(pattern);
+					expect_superset(upper(pattern));
+				}
+			}
+		}
+	}
+}
+
+TEST_F(TextIndexTest, Patterns) {
+	for (std::wstring_view pattern: {L"中"sv, L"天"sv, L"好"sv, L"文t"sv, L"d中"sv,
+			L"σ"sv, L"ς"sv, L"Σ"sv, L"οσ"sv, L"ος "sv,
+			L"i"sv, L"I"sv, L"istan"sv, L"İstan"sv, L"k"sv, L"kelvin K"sv,
+			L"?"sv, L"??"sv, L"a?b"sv, L"d?b"sv, L"x??y"sv, L"?z"sv,
+			L"ick bro"sv, L"3AB"sv, L"LO WO"sv, L"o"sv}) {
+		expect_superset(pattern);
+	}
+
+	// Sanity check: the index does narrow down the entries
+	EXPECT_EQ(std::vector<unsigned>({0}), index_.candidates(L"quick"sv));
+	EXPECT_EQ(std::vector<unsigned>({1, 6}), index_.candidates(L"好"sv));
+}
+
+TEST_F(TextIndexTest, Remove) {
+	index_.remove(0, kEntries[0].first, kEntries[0].second);
+	EXPECT_EQ(std::vector<unsigned>(), index_.candidates(L"quick"sv));
+	EXPECT_EQ(std::vector<unsigned>({1}), index_.candidates(L"中文"sv));
+}
+
+} // namespace tiary
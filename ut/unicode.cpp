@@ -31,6 +31,40 @@ TEST(UTF8, CountChars) {
 	EXPECT_EQ(6, utf8_count_chars((const char *)u8"A\u0080\u0800\u8000\U00010000\U0010ABCD"));
 }
 
+TEST(UTF8, Next) {
+	std::string_view s = "A\xce\xb1\xe5\x9b\xbd\xff\xe5\x9b"sv;
+	size_t pos = 0;
+	EXPECT_EQ(U'A', utf8_next(s, &pos));
+	EXPECT_EQ(1, pos);
+	EXPECT_EQ(U'α', utf8_next(s, &pos));
+	EXPECT_EQ(3, pos);
+	EXPECT_EQ(U'国', utf8_next(s, &pos));
+	EXPECT_EQ(6, pos);
+	EXPECT_EQ(U'?', utf8_next(s, &pos));
+	EXPECT_EQ(7, pos);
+	EXPECT_EQ(U'?', utf8_next(s, &pos)); // Truncated
+	EXPECT_EQ(8, pos);
+	EXPECT_EQ(U'?', utf8_next(s, &pos));
+	EXPECT_EQ(9, pos);
+}
+
+TEST(UTF8, Prev) {
+	std::string_view s = "A\xce\xb1\xe5\x9b\xbd\xff\xe5\x9b"sv;
+	size_t pos = s.length();
+	EXPECT_EQ(U'?', utf8_prev(s, &pos));
+	EXPECT_EQ(8, pos);
+	EXPECT_EQ(U'?', utf8_prev(s, &pos));
+	EXPECT_EQ(7, pos);
+	EXPECT_EQ(U'?', utf8_prev(s, &pos));
+	EXPECT_EQ(6, pos);
+	EXPECT_EQ(U'国', utf8_prev(s, &pos));
+	EXPECT_EQ(3, pos);
+	EXPECT_EQ(U'α', utf8_prev(s, &pos));
+	EXPECT_EQ(1, pos);
+	EXPECT_EQ(U'A', utf8_prev(s, &pos));
+	EXPECT_EQ(0, pos);
+}
+
 TEST(UTF8, FromWstring) {
 	EXPECT_EQ((const char *)u8"\uabcd\uaaaaABCD", wstring_to_utf8(L"\uabcd\uaaaaABCD"));
 	EXPECT_EQ((const char *)u8"\uabcd\uaaaaABCD", wstring_to_utf8(U"\uabcd\uaaaaABCD"));
@@ -66,6 +100,11 @@ TEST_F(WcWidthTest, ucs_width_str) {
 	EXPECT_EQ(4, ucs_width(U"\n国α"));
 }
 
+TEST_F(WcWidthTest, utf8_width) {
+	EXPECT_EQ(4, utf8_width((const char *)u8"\n国α"));
+	EXPECT_EQ(2, utf8_width("\xe5\x9b"));
+}
+
 TEST_F(WcWidthTest, max_chars_in_width) {
 	EXPECT_EQ(0, max_chars_in_width(L"\n国α", 0));
 	EXPECT_EQ(1, max_chars_in_width(L"\n国α", 1));
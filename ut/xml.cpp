@@ -0,0 +1,176 @@
+// -*- mode:c++; tab-width:4; -*-
+// vim:ft=cpp ts=4
+
+/***************************************************************************
+ *
+ * Tiary, a terminal-based diary keeping system for Unix-like systems
+ * Copyright (C) 2024, chys <admin@CHYS.INFO>
+ *
+ * This software is licensed under the 3-clause BSD license.
+ * See LICENSE in the source package and/or online info for details.
+ *
+ **************************************************************************/
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include "common/xml.h"
+#include "common/string.h"
+
+namespace tiary {
+
+namespace {
+
+// Records all events in a string
+class RecordHandler : public XMLScanHandler {
+public:
+	bool on_start(std::string_view name, XMLAttributes attributes) override {
+		events += '<';
+		events += name;
+		for (const XMLAttribute &attr: attributes) {
+			events += ' ';
+			events += attr.name;
+			events += '=';
+			events += attr.value;
+		}
+		events += '>';
+		return true;
+	}
+	bool on_end() override {
+		events += "</>"sv;
+		return true;
+	}
+	bool on_text(std::string_view text) override {
+		events += '[';
+		events += text;
+		events += ']';
+		return true;
+	}
+
+	std::string events;
+};
+
+std::string scan(std::string_view xml) {
+	RecordHandler handler;
+	if (!xml_scan(xml, handler)) {
+		return "error";
+	}
+	return handler.events;
+}
+
+// Same as above, but the XML is read in pieces of the given size
+std::string scan(std::string_view xml, size_t piece) {
+	RecordHandler handler;
+	if (!xml_scan([&](char *buffer, int len) {
+				size_t n = std::min({xml.size(), piece, size_t(len)});
+				memcpy(buffer, xml.data(), n);
+				xml.remove_prefix(n);
+				return int(n);
+			}, handler)) {
+		return "error";
+	}
+	return handler.events;
+}
+
+} // namespace
+
+TEST(XMLScan, Basic) {
+	EXPECT_EQ("<a x=1 y=2><b></>[text]</>"sv,
+			scan("<?xml version=\"1.0\"?>\n<a x=\"1\" y='2'><b/>text</a>"sv));
+	EXPECT_EQ("<a><b><c></></></>"sv, scan("<a><b><c></c></b></a>"sv));
+	EXPECT_EQ("<a x= y=2></>"sv, scan("<a x=\"\" y=\"2\"/>"sv));
+}
+
+TEST(XMLScan, Blanks) {
+	// Text consisting only of blanks is dropped, but others are kept as they are
+	EXPECT_EQ("<a><b></><c>[ x\n ]</></>"sv, scan("<a>\n  <b> \t</b>\r\n  <c> x\n </c>\n</a>\n"sv));
+	EXPECT_EQ("<a>[x]<b></>[ y ]</>"sv, scan("<a>x<b/> y </a>"sv));
+}
+
+TEST(XMLScan, Entities) {
+	EXPECT_EQ("<a v=<&\">[<&>\"'\r\n]</>"sv, scan("<a v=\"&lt;&amp;&quot;\">&lt;&amp;&gt;&quot;&apos;&#13;&#10;</a>"sv));
+	EXPECT_EQ("<a>[\xe4\xb8\xad\xe6\x96\x87]</>"sv, scan("<a>&#x4e2d;\xe6\x96\x87</a>"sv));
+}
+
+TEST(XMLScan, CDATA) {
+	EXPECT_EQ("<a>[<b>&amp;</b>]</>"sv, scan("<a><![CDATA[<b>&amp;</b>]]></a>"sv));
+	// Blank CDATA is dropped, too
+	EXPECT_EQ("<a></>"sv, scan("<a><![CDATA[  ]]></a>"sv));
+	EXPECT_EQ("<a>[x][ y ]</>"sv, scan("<a>x<![CDATA[ y ]]></a>"sv));
+}
+
+TEST(XMLScan, Malformed) {
+	EXPECT_EQ("error"sv, scan(""sv));
+	EXPECT_EQ("error"sv, scan("<a>"sv));
+	EXPECT_EQ("error"sv, scan("<a><b></a>"sv));
+	EXPECT_EQ("error"sv, scan("<a>&unknown;</a>"sv));
+	EXPECT_EQ("error"sv, scan("<a>\x01</a>"sv));
+}
+
+TEST(XMLScan, Pieces) {
+	std::string xml = "<a>"s;
+	for (int i = 0; i < 1000; ++i) {
+		xml += "\n  <entry n=\"" + std::to_string(i) + "\">text &amp; more</entry>";
+	}
+	xml += "\n</a>\n"sv;
+	std::string expected = scan(xml);
+	EXPECT_NE("error"sv, expected);
+	for (size_t piece: {1, 7, 4096}) {
+		EXPECT_EQ(expected, scan(xml, piece)) << piece;
+		EXPECT_EQ("error"sv, scan(std::string_view(xml).substr(0, xml.size() - 5), piece)) << piece;
+	}
+}
+
+TEST(XMLWriter, Format) {
+	std::string xml;
+	XMLWriter writer(&xml);
+	writer.declaration();
+	writer.start("a"sv, {{"x"sv, "1"sv}});
+	writer.empty("b"sv, {});
+	writer.start("c"sv);
+	writer.end("c"sv);
+	writer.start("d"sv);
+	writer.text_element("e"sv, "text"sv);
+	writer.end("d"sv);
+	writer.end("a"sv);
+	EXPECT_EQ("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+			"<a x=\"1\">\n"
+			"  <b/>\n"
+			"  <c/>\n"
+			"  <d>\n"
+			"    <e>text</e>\n"
+			"  </d>\n"
+			"</a>\n"sv, xml);
+}
+
+TEST(XMLWriter, Escape) {
+	std::string xml;
+	XMLWriter writer(&xml);
+	writer.empty("a"sv, {{"v"sv, "&<>\"'\t\r\n"sv}});
+	writer.text_element("b"sv, "&<>\"'\t\r\n"sv);
+	writer.text_element("c"sv, L"&<>\"'\t\r\n\u4e2d"sv);
+	EXPECT_EQ("<a v=\"&amp;&lt;&gt;&quot;'&#9;&#13;&#10;\"/>\n"
+			"<b>&amp;&lt;&gt;\"'\t&#13;\n</b>\n"
+			"<c>&amp;&lt;&gt;\"'\t&#13;\n\xe4\xb8\xad</c>\n"sv, xml);
+}
+
+TEST(XMLWriter, ControlCharacters) {
+	// XML can't have them, even escaped
+	std::string xml;
+	XMLWriter writer(&xml);
+	writer.empty("a"sv, {{"v"sv, "\x01x\x1f"sv}});
+	writer.text_element("b"sv, "\x00x\x7f\x1b"sv);
+	writer.text_element("c"sv, L"\x01x\x1f"sv);
+	EXPECT_EQ("<a v=\"?x?\"/>\n<b>?x\x7f?</b>\n<c>?x?</c>\n"sv, xml);
+}
+
+TEST(XMLWriter, RoundTrip) {
+	std::string_view text = "&amp; <tag> \"quoted\" 'single'\t\r\n\r\n \xe4\xb8\xad\xe6\x96\x87 ]]> end"sv;
+	std::string xml;
+	XMLWriter writer(&xml);
+	writer.start("a"sv, {{"v"sv, text}});
+	writer.text_element("b"sv, text);
+	writer.end("a"sv);
+	EXPECT_EQ("<a v="s + std::string(text) + "><b>[" + std::string(text) + "]</></>", scan(xml));
+}
+
+} // namespace tiary